@@ -108,4 +108,54 @@ TC.prototype={
   _tv:function(e){if(e.touches.length)this._draw(this._px(e.touches[0]));},
 };
 w.TinyChart=TC;
+
+/* /api/history.pack decoder -> same shape as /api/history JSON */
+var fmtHM=null,fmtDM=null;
+function decodeHistPack(buf){
+  var dv=new DataView(buf);
+  if(buf.byteLength<20||dv.getUint8(0)!==87||dv.getUint8(1)!==76||dv.getUint8(2)!==72||dv.getUint8(3)!==1)return null;
+  var n=dv.getUint16(4,true),flags=dv.getUint8(6),tier=dv.getUint8(7);
+  var base=dv.getUint32(8,true),hours=dv.getUint16(12,true),recentIdx=dv.getUint16(14,true);
+  var volStep=dv.getUint16(16,true)||1;
+  var mm=(flags&1)!==0,ax=(flags&4)!==0;
+  if(buf.byteLength<20+n*(8+(mm?4:0)+(ax?4:0)))return null;
+  var NONE=-32768,off=20,i;
+  var q=function(v){return v===NONE?NaN:v/10;};
+  var ts=new Float64Array(n),lv=new Float64Array(n),vol=new Float64Array(n),tp=new Float64Array(n);
+  var mins=mm?new Float64Array(n):null,maxs=mm?new Float64Array(n):null;
+  var wa=ax?new Float64Array(n):null,ca=ax?new Float64Array(n):null;
+  var t=Math.floor(base/60)*60;
+  for(i=0;i<n;i++,off+=2){t+=dv.getUint16(off,true)*60;ts[i]=t;}
+  for(i=0;i<n;i++,off+=2)lv[i]=dv.getInt16(off,true)/10;
+  for(i=0;i<n;i++,off+=2)vol[i]=dv.getInt16(off,true)*volStep/10;
+  for(i=0;i<n;i++,off+=2)tp[i]=q(dv.getInt16(off,true));
+  if(mm){
+    for(i=0;i<n;i++,off+=2)mins[i]=q(dv.getInt16(off,true));
+    for(i=0;i<n;i++,off+=2)maxs[i]=q(dv.getInt16(off,true));
+  }
+  if(ax){
+    for(i=0;i<n;i++,off+=2)wa[i]=q(dv.getInt16(off,true));
+    for(i=0;i<n;i++,off+=2)ca[i]=q(dv.getInt16(off,true));
+  }
+  if(!fmtHM){
+    fmtHM=new Intl.DateTimeFormat('uk-UA',{timeZone:'Europe/Kyiv',hour:'2-digit',minute:'2-digit'});
+    fmtDM=new Intl.DateTimeFormat('uk-UA',{timeZone:'Europe/Kyiv',day:'2-digit',month:'2-digit'});
+  }
+  var labels=new Array(n);
+  for(i=0;i<n;i++){
+    var d=new Date(ts[i]*1000);
+    labels[i]=(hours<=24||i>=recentIdx)?fmtHM.format(d):fmtDM.format(d);
+  }
+  var arr=function(a){return Array.prototype.map.call(a,function(v){return isNaN(v)?null:v;});};
+  var out={
+    labels:labels,values:arr(lv),volumes:arr(vol),
+    temps:arr(tp),
+    hours:hours,downsample:(flags&2)!==0,
+    tier:['raw','hour','day','month'][tier]||'raw'
+  };
+  if(mm){out.mins=arr(mins);out.maxs=arr(maxs);}
+  if(ax){out.water=arr(wa);out['case']=arr(ca);}
+  return out;
+}
+w.decodeHistPack=decodeHistPack;
 })(window);
@@ -7,19 +7,55 @@
 #define CONFIG_FILE "/config.json"
 #define FW_VERSION  "1.0.0"
 
+// Ultrasonic channels (one TRIG/ECHO pair and one barrel each)
+#define TANK_MAX 3
+
+// DS18B20 roles on the OneWire bus: air (speed of sound), water, enclosure
+#define TEMP_PROBES 3
+
+// Tank shape for the volume calculation (TankCal::shape, see geometry.h)
+enum TankShape : uint8_t {
+  SHAPE_VCYL  = 0,  // upright cylinder: barrel_diam_cm
+  SHAPE_HCYL  = 1,  // cylinder lying on its side: barrel_diam_cm × length_cm
+  SHAPE_RECT  = 2,  // box (IBC tote): width_cm × length_cm
+  SHAPE_CONE  = 3,  // upright cylinder on a cone of cone_cm: barrel_diam_cm
+  SHAPE_TABLE = 4,  // strapping table uploaded to /api/strap
+  SHAPE_COUNT
+};
+
+struct TankCal {
+  char     name[16];         // label and MQTT sub-topic
+  uint8_t  trig_pin;
+  uint8_t  echo_pin;
+  float    empty_dist_cm;    // distance when barrel is EMPTY (sensor→bottom)
+  float    full_dist_cm;     // distance when barrel is FULL  (sensor→water)
+  float    barrel_diam_cm;   // inner diameter, cm (0 = unknown)
+  uint8_t  shape;            // TankShape
+  float    width_cm;         // SHAPE_RECT
+  float    length_cm;        // SHAPE_HCYL, SHAPE_RECT
+  float    cone_cm;          // SHAPE_CONE: height of the conical bottom
+};
+
+// How a ping burst is reduced to one distance (Config::filter_mode)
+enum DistFilter : uint8_t {
+  FILTER_MEAN    = 0,  // plain mean of all echoes (legacy)
+  FILTER_MEDIAN  = 1,
+  FILTER_TRIMMED = 2,  // mean of echoes within filter_mad_k·MAD of the median
+};
+
 struct Config {
   // WiFi
   char wifi_ssid[64];
   char wifi_password[64];
 
-  // Sensor pins & calibration
-  uint8_t  trig_pin;         // default D5 (GPIO14)
-  uint8_t  echo_pin;         // default D6 (GPIO12)
-  float    empty_dist_cm;    // distance when barrel is EMPTY (sensor→bottom)
-  float    full_dist_cm;     // distance when barrel is FULL  (sensor→water)
-  float    barrel_diam_cm;   // inner diameter, cm (0 = unknown)
+  // Sensor pins & calibration; tanks[0] is the original single tank
+  uint8_t  tank_count;       // active channels (1..TANK_MAX)
+  TankCal  tanks[TANK_MAX];
   uint8_t  avg_samples;      // readings to average (1..10)
-  uint16_t measure_sec;      // measurement interval, seconds
+  uint8_t  filter_mode;      // DistFilter
+  float    filter_mad_k;     // outlier threshold, robust sigmas (1..10)
+  uint16_t measure_sec;      // measurement interval while level is stable, seconds
+  uint16_t measure_min_sec;  // fastest interval while level moves (5..measure_sec)
 
   // MQTT
   bool     mqtt_en;
@@ -28,6 +64,14 @@ struct Config {
   char     mqtt_user[32];
   char     mqtt_pass[32];
   char     mqtt_topic[64];   // base topic; /level /volume /status published
+  uint16_t mqtt_buf;         // readings kept in flash while the broker is unreachable (0 = off)
+  uint8_t  mqtt_drain;       // buffered readings replayed per second after reconnect
+  uint16_t mqtt_hb;          // republish an unchanged topic after this many seconds (0 = every reading)
+  float    mqtt_db_level;    // deadbands: level %, distance cm, volume L, temperature °C, rate L/h
+  float    mqtt_db_dist;
+  float    mqtt_db_vol;
+  float    mqtt_db_temp;
+  float    mqtt_db_rate;
 
   // Telegram
   bool     tg_en;
@@ -44,6 +88,7 @@ struct Config {
   // DS18B20 temperature sensor
   uint8_t  ds18_pin;         // data pin (default GPIO2 = D4)
   bool     ds18_en;          // enable temperature sensor
+  char     ds18_rom[TEMP_PROBES][17];  // ROM per role, 16 hex digits; "" = auto
 
   // System
   char     device_name[32];
@@ -51,22 +96,51 @@ struct Config {
 };
 
 // ---------- defaults ----------
+// Channel pins: D5/D6, D1/D2, D8/D7 (GPIO0/2/16 are boot straps or lack interrupts)
+static const uint8_t _tankDefTrig[TANK_MAX] = { 14, 5, 15 };
+static const uint8_t _tankDefEcho[TANK_MAX] = { 12, 4, 13 };
+
+// ECHO edges are timed in a pin-change ISR: GPIO16 has no interrupt on the
+// ESP8266 and GPIO6-11 belong to the flash chip.
+inline bool echoPinValid(uint8_t pin) { return pin >= 1 && pin <= 15 && (pin < 6 || pin > 11); }
+
+inline void tankDefaults(TankCal &t, uint8_t i) {
+  snprintf(t.name, sizeof(t.name), "tank%u", i + 1);
+  t.trig_pin       = _tankDefTrig[i];
+  t.echo_pin       = _tankDefEcho[i];
+  t.empty_dist_cm  = 110.0f;
+  t.full_dist_cm   = 25.0f;
+  t.barrel_diam_cm = 51.0f;
+  t.shape          = SHAPE_VCYL;
+  t.width_cm       = 0;
+  t.length_cm      = 0;
+  t.cone_cm        = 0;
+}
+
 inline void configDefaults(Config &c) {
   memset(&c, 0, sizeof(c));
   // Defaults below are prefilled for the current installation.
   strlcpy(c.wifi_ssid,    "Katya_5G:)", sizeof(c.wifi_ssid));
   strlcpy(c.wifi_password,"30101986",   sizeof(c.wifi_password));
-  c.trig_pin       = 14;   // D5
-  c.echo_pin       = 12;   // D6
-  c.empty_dist_cm  = 110.0f;
-  c.full_dist_cm   = 25.0f;
-  c.barrel_diam_cm = 51.0f;
+  c.tank_count     = 1;
+  for (uint8_t i = 0; i < TANK_MAX; i++) tankDefaults(c.tanks[i], i);
   c.avg_samples    = 10;
+  c.filter_mode    = FILTER_TRIMMED;
+  c.filter_mad_k   = 3.0f;
   c.measure_sec    = 60;
+  c.measure_min_sec = 5;
   c.mqtt_en        = true;
   strlcpy(c.mqtt_host,  "192.168.4.107", sizeof(c.mqtt_host));
   c.mqtt_port      = 1883;
   strlcpy(c.mqtt_topic, "watersensor", sizeof(c.mqtt_topic));
+  c.mqtt_buf       = 720;   // 12 h at the 60 s interval
+  c.mqtt_drain     = 5;
+  c.mqtt_hb        = 600;
+  c.mqtt_db_level  = 0.5f;
+  c.mqtt_db_dist   = 0.5f;
+  c.mqtt_db_vol    = 1.0f;
+  c.mqtt_db_temp   = 0.2f;
+  c.mqtt_db_rate   = 0.5f;
   c.tg_en          = true;
   c.tg_cmd_en      = true;
   c.tg_alert_low_en  = false;
@@ -84,14 +158,14 @@ inline void configDefaults(Config &c) {
 
 inline void logConfigSummary(const char *tag, const Config &c) {
   dbgPrintf(
-    "[CFG] %s | wifi_ssid='%s' trig=%u echo=%u ds18_en=%u ds18_pin=%u "
-    "empty=%.1f full=%.1f diam=%.1f avg=%u sec=%u mqtt=%u tg=%u tx=%u tal=%u tah=%u tb=%u\n",
+    "[CFG] %s | wifi_ssid='%s' tanks=%u trig=%u echo=%u ds18_en=%u ds18_pin=%u "
+    "empty=%.1f full=%.1f diam=%.1f avg=%u flt=%u k=%.1f sec=%u..%u mqtt=%u tg=%u tx=%u tal=%u tah=%u tb=%u\n",
     tag ? tag : "state",
     c.wifi_ssid,
-    c.trig_pin, c.echo_pin,
+    c.tank_count, c.tanks[0].trig_pin, c.tanks[0].echo_pin,
     c.ds18_en ? 1 : 0, c.ds18_pin,
-    c.empty_dist_cm, c.full_dist_cm, c.barrel_diam_cm,
-    c.avg_samples, c.measure_sec,
+    c.tanks[0].empty_dist_cm, c.tanks[0].full_dist_cm, c.tanks[0].barrel_diam_cm,
+    c.avg_samples, c.filter_mode, c.filter_mad_k, c.measure_min_sec, c.measure_sec,
     c.mqtt_en ? 1 : 0, c.tg_en ? 1 : 0,
     c.tg_cmd_en ? 1 : 0,
     c.tg_alert_low_en ? 1 : 0,
@@ -111,10 +185,56 @@ inline bool sanitizeConfig(Config &c) {
     }
   };
 
-  fixU8(c.trig_pin, 14, "trig_pin");
-  fixU8(c.echo_pin, 12, "echo_pin");
   fixU8(c.ds18_pin, 2,  "ds18_pin");
 
+  if (c.tank_count < 1 || c.tank_count > TANK_MAX) {
+    dbgPrintf("[CFG] Sanitize tank_count: %u -> 1\n", c.tank_count);
+    c.tank_count = 1;
+    changed = true;
+  }
+
+  for (uint8_t i = 0; i < TANK_MAX; i++) {
+    TankCal &t = c.tanks[i];
+    fixU8(t.trig_pin, _tankDefTrig[i], "trig_pin");
+    fixU8(t.echo_pin, _tankDefEcho[i], "echo_pin");
+    if (!echoPinValid(t.echo_pin)) {
+      dbgPrintf("[CFG] Sanitize tank%u echo_pin: GPIO%u has no interrupt -> %u\n",
+                i + 1, t.echo_pin, _tankDefEcho[i]);
+      t.echo_pin = _tankDefEcho[i];
+      changed = true;
+    }
+
+    if (t.barrel_diam_cm < 0 || t.barrel_diam_cm > 10000) {
+      float old = t.barrel_diam_cm;
+      t.barrel_diam_cm = 51.0f;
+      dbgPrintf("[CFG] Sanitize tank%u barrel_diam_cm: %.2f -> %.2f\n", i + 1, old, t.barrel_diam_cm);
+      changed = true;
+    }
+
+    if (t.empty_dist_cm <= 0 || t.full_dist_cm <= 0 || t.full_dist_cm >= t.empty_dist_cm) {
+      dbgPrintf("[CFG] Sanitize tank%u distances: empty=%.2f full=%.2f -> empty=110.00 full=25.00\n",
+                    i + 1, t.empty_dist_cm, t.full_dist_cm);
+      t.empty_dist_cm = 110.0f;
+      t.full_dist_cm  = 25.0f;
+      changed = true;
+    }
+
+    if (t.shape >= SHAPE_COUNT) {
+      dbgPrintf("[CFG] Sanitize tank%u shape: %u -> 0\n", i + 1, t.shape);
+      t.shape = SHAPE_VCYL;
+      changed = true;
+    }
+    float *dims[] = { &t.width_cm, &t.length_cm, &t.cone_cm };
+    for (float *d : dims) {
+      if (!(*d >= 0 && *d <= 10000)) { *d = 0; changed = true; }
+    }
+
+    if (!strlen(t.name)) {
+      snprintf(t.name, sizeof(t.name), "tank%u", i + 1);
+      changed = true;
+    }
+  }
+
   if (c.avg_samples < 1 || c.avg_samples > 10) {
     uint8_t old = c.avg_samples;
     c.avg_samples = 10;
@@ -122,6 +242,20 @@ inline bool sanitizeConfig(Config &c) {
     changed = true;
   }
 
+  if (c.filter_mode > FILTER_TRIMMED) {
+    uint8_t old = c.filter_mode;
+    c.filter_mode = FILTER_TRIMMED;
+    dbgPrintf("[CFG] Sanitize filter_mode: %u -> %u\n", old, c.filter_mode);
+    changed = true;
+  }
+
+  if (!(c.filter_mad_k >= 1.0f && c.filter_mad_k <= 10.0f)) {
+    float old = c.filter_mad_k;
+    c.filter_mad_k = 3.0f;
+    dbgPrintf("[CFG] Sanitize filter_mad_k: %.2f -> %.2f\n", old, c.filter_mad_k);
+    changed = true;
+  }
+
   if (c.measure_sec < 10 || c.measure_sec > 3600) {
     uint16_t old = c.measure_sec;
     c.measure_sec = 60;
@@ -129,26 +263,42 @@ inline bool sanitizeConfig(Config &c) {
     changed = true;
   }
 
+  if (c.measure_min_sec < 5 || c.measure_min_sec > c.measure_sec) {
+    uint16_t old = c.measure_min_sec;
+    c.measure_min_sec = c.measure_sec < 5 ? c.measure_sec : 5;
+    dbgPrintf("[CFG] Sanitize measure_min_sec: %u -> %u\n", old, c.measure_min_sec);
+    changed = true;
+  }
+
   if (c.mqtt_port == 0) {
     dbgPrintf("[CFG] Sanitize mqtt_port: %u -> %u\n", c.mqtt_port, 1883);
     c.mqtt_port = 1883;
     changed = true;
   }
 
-  if (c.barrel_diam_cm < 0 || c.barrel_diam_cm > 10000) {
-    float old = c.barrel_diam_cm;
-    c.barrel_diam_cm = 51.0f;
-    dbgPrintf("[CFG] Sanitize barrel_diam_cm: %.2f -> %.2f\n", old, c.barrel_diam_cm);
+  if (c.mqtt_buf > 2880) {
+    dbgPrintf("[CFG] Sanitize mqtt_buf: %u -> %u\n", c.mqtt_buf, 2880);
+    c.mqtt_buf = 2880;
     changed = true;
   }
-
-  if (c.empty_dist_cm <= 0 || c.full_dist_cm <= 0 || c.full_dist_cm >= c.empty_dist_cm) {
-    dbgPrintf("[CFG] Sanitize distances: empty=%.2f full=%.2f -> empty=110.00 full=25.00\n",
-                  c.empty_dist_cm, c.full_dist_cm);
-    c.empty_dist_cm = 110.0f;
-    c.full_dist_cm  = 25.0f;
+  if (c.mqtt_drain < 1 || c.mqtt_drain > 50) {
+    uint8_t old = c.mqtt_drain;
+    c.mqtt_drain = 5;
+    dbgPrintf("[CFG] Sanitize mqtt_drain: %u -> %u\n", old, c.mqtt_drain);
     changed = true;
   }
+  struct { float *v; float def; const char *name; } bands[] = {
+    { &c.mqtt_db_level, 0.5f, "mqtt_db_level" }, { &c.mqtt_db_dist, 0.5f, "mqtt_db_dist" },
+    { &c.mqtt_db_vol,   1.0f, "mqtt_db_vol" },   { &c.mqtt_db_temp, 0.2f, "mqtt_db_temp" },
+    { &c.mqtt_db_rate,  0.5f, "mqtt_db_rate" },
+  };
+  for (auto &b : bands) {
+    if (!(*b.v >= 0 && *b.v <= 10000)) {
+      dbgPrintf("[CFG] Sanitize %s: %.2f -> %.2f\n", b.name, *b.v, b.def);
+      *b.v = b.def;
+      changed = true;
+    }
+  }
 
   if (c.tg_alert_low <= 0 || c.tg_alert_low >= 100) {
     float old = c.tg_alert_low;
@@ -178,6 +328,31 @@ inline bool sanitizeConfig(Config &c) {
   return changed;
 }
 
+// ---------- tank calibration <-> JSON (keys tp/ep/ed/fd/bd/sh/bw/bl/bc) ----------
+inline void tankFromJson(TankCal &t, JsonObjectConst o, uint8_t i) {
+  t.trig_pin       = o["tp"] | _tankDefTrig[i];
+  t.echo_pin       = o["ep"] | _tankDefEcho[i];
+  t.empty_dist_cm  = o["ed"] | 110.0f;
+  t.full_dist_cm   = o["fd"] | 25.0f;
+  t.barrel_diam_cm = o["bd"] | 51.0f;
+  t.shape          = o["sh"] | (uint8_t)SHAPE_VCYL;
+  t.width_cm       = o["bw"] | 0.0f;
+  t.length_cm      = o["bl"] | 0.0f;
+  t.cone_cm        = o["bc"] | 0.0f;
+}
+
+inline void tankToJson(const TankCal &t, JsonObject o) {
+  o["tp"] = t.trig_pin;
+  o["ep"] = t.echo_pin;
+  o["ed"] = t.empty_dist_cm;
+  o["fd"] = t.full_dist_cm;
+  o["bd"] = t.barrel_diam_cm;
+  o["sh"] = t.shape;
+  o["bw"] = t.width_cm;
+  o["bl"] = t.length_cm;
+  o["bc"] = t.cone_cm;
+}
+
 // ---------- load ----------
 inline bool loadConfig(Config &c) {
   configDefaults(c);
@@ -199,19 +374,34 @@ inline bool loadConfig(Config &c) {
 
   strlcpy(c.wifi_ssid,     doc["ws"]    | "",          sizeof(c.wifi_ssid));
   strlcpy(c.wifi_password, doc["wp"]    | "",          sizeof(c.wifi_password));
-  c.trig_pin       = doc["tp"]  | 14;
-  c.echo_pin       = doc["ep"]  | 12;
-  c.empty_dist_cm  = doc["ed"]  | 110.0f;
-  c.full_dist_cm   = doc["fd"]  | 25.0f;
-  c.barrel_diam_cm = doc["bd"]  | 51.0f;
+  // Tank 0 keeps the original top-level keys; tanks 1.. live in "tk"
+  c.tank_count     = doc["nt"]  | 1;
+  strlcpy(c.tanks[0].name, doc["n0"] | "tank1", sizeof(c.tanks[0].name));
+  tankFromJson(c.tanks[0], doc.as<JsonObjectConst>(), 0);
+  for (uint8_t i = 1; i < TANK_MAX; i++) {
+    JsonObjectConst o = doc["tk"][i - 1];
+    strlcpy(c.tanks[i].name, o["n"] | "", sizeof(c.tanks[i].name));   // empty -> "tankN" in sanitize
+    tankFromJson(c.tanks[i], o, i);
+  }
   c.avg_samples    = doc["as"]  | 10;
+  c.filter_mode    = doc["fm"]  | (uint8_t)FILTER_TRIMMED;
+  c.filter_mad_k   = doc["fk"]  | 3.0f;
   c.measure_sec    = doc["ms"]  | 60;
+  c.measure_min_sec = doc["mi"] | 5;
   c.mqtt_en        = doc["me"]  | true;
   strlcpy(c.mqtt_host,  doc["mh"]  | "192.168.4.107", sizeof(c.mqtt_host));
   c.mqtt_port      = doc["mp"]  | 1883;
   strlcpy(c.mqtt_user,  doc["mu"]  | "",           sizeof(c.mqtt_user));
   strlcpy(c.mqtt_pass,  doc["mq"]  | "",           sizeof(c.mqtt_pass));
   strlcpy(c.mqtt_topic, doc["mt"]  | "watersensor",sizeof(c.mqtt_topic));
+  c.mqtt_buf       = doc["mb"]  | 720;
+  c.mqtt_drain     = doc["mr"]  | 5;
+  c.mqtt_hb        = doc["mhb"] | 600;
+  c.mqtt_db_level  = doc["mdl"] | 0.5f;
+  c.mqtt_db_dist   = doc["mdd"] | 0.5f;
+  c.mqtt_db_vol    = doc["mdv"] | 1.0f;
+  c.mqtt_db_temp   = doc["mdt"] | 0.2f;
+  c.mqtt_db_rate   = doc["mdr"] | 0.5f;
   c.tg_en          = doc["te"]  | true;
   c.tg_cmd_en      = doc["tx"]  | true;
   bool legacy_ta = doc["ta"] | false;
@@ -225,6 +415,9 @@ inline bool loadConfig(Config &c) {
   c.tg_daily       = doc["td"]  | true;
   c.ds18_pin       = doc["dp"]  | 2;
   c.ds18_en        = doc["de"]  | true;
+  strlcpy(c.ds18_rom[0], doc["da"] | "", sizeof(c.ds18_rom[0]));
+  strlcpy(c.ds18_rom[1], doc["dw"] | "", sizeof(c.ds18_rom[1]));
+  strlcpy(c.ds18_rom[2], doc["dc"] | "", sizeof(c.ds18_rom[2]));
   strlcpy(c.device_name, doc["dn"] | "watersensor", sizeof(c.device_name));
   strlcpy(c.ota_pass,    doc["op"] | "ota1234",     sizeof(c.ota_pass));
   sanitizeConfig(c);
@@ -238,19 +431,34 @@ inline bool saveConfig(Config &c) {
   DynamicJsonDocument doc(3072);
   doc["ws"] = c.wifi_ssid;
   doc["wp"] = c.wifi_password;
-  doc["tp"] = c.trig_pin;
-  doc["ep"] = c.echo_pin;
-  doc["ed"] = c.empty_dist_cm;
-  doc["fd"] = c.full_dist_cm;
-  doc["bd"] = c.barrel_diam_cm;
+  doc["nt"] = c.tank_count;
+  doc["n0"] = c.tanks[0].name;
+  tankToJson(c.tanks[0], doc.as<JsonObject>());
+  JsonArray tk = doc.createNestedArray("tk");
+  for (uint8_t i = 1; i < TANK_MAX; i++) {
+    JsonObject o = tk.createNestedObject();
+    o["n"] = c.tanks[i].name;
+    tankToJson(c.tanks[i], o);
+  }
   doc["as"] = c.avg_samples;
+  doc["fm"] = c.filter_mode;
+  doc["fk"] = c.filter_mad_k;
   doc["ms"] = c.measure_sec;
+  doc["mi"] = c.measure_min_sec;
   doc["me"] = c.mqtt_en;
   doc["mh"] = c.mqtt_host;
   doc["mp"] = c.mqtt_port;
   doc["mu"] = c.mqtt_user;
   doc["mq"] = c.mqtt_pass;
   doc["mt"] = c.mqtt_topic;
+  doc["mb"] = c.mqtt_buf;
+  doc["mr"] = c.mqtt_drain;
+  doc["mhb"] = c.mqtt_hb;
+  doc["mdl"] = c.mqtt_db_level;
+  doc["mdd"] = c.mqtt_db_dist;
+  doc["mdv"] = c.mqtt_db_vol;
+  doc["mdt"] = c.mqtt_db_temp;
+  doc["mdr"] = c.mqtt_db_rate;
   doc["te"] = c.tg_en;
   doc["tx"] = c.tg_cmd_en;
   doc["tal"] = c.tg_alert_low_en;
@@ -263,6 +471,9 @@ inline bool saveConfig(Config &c) {
   doc["td"] = c.tg_daily;
   doc["dp"] = c.ds18_pin;
   doc["de"] = c.ds18_en;
+  doc["da"] = c.ds18_rom[0];
+  doc["dw"] = c.ds18_rom[1];
+  doc["dc"] = c.ds18_rom[2];
   doc["dn"] = c.device_name;
   doc["op"] = c.ota_pass;
 
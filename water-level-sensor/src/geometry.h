@@ -0,0 +1,209 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+
+// ------------------------------------------------------------------
+// Tank geometry: litres held at a given water height (cm above the
+// empty level). Built-in shapes are closed-form; SHAPE_TABLE uses a
+// strapping table of (height, litres) points with monotone cubic
+// (Fritsch–Carlson) interpolation. Table slopes are computed once when
+// the table is loaded, so a lookup is a ≤6-step binary search plus one
+// cubic, independent of the reading.
+// ------------------------------------------------------------------
+#define STRAP_MAX_POINTS 64
+#define STRAP_MAX_BYTES  2048   // upload size limit for one CSV table
+
+struct StrapTable {
+  uint8_t n;
+  float   h[STRAP_MAX_POINTS];   // cm, strictly increasing
+  float   v[STRAP_MAX_POINTS];   // L, non-decreasing
+  float   m[STRAP_MAX_POINTS];   // dV/dh at each knot, L/cm
+};
+
+// Loaded tables, allocated only for tanks with SHAPE_TABLE
+static StrapTable *_strap[TANK_MAX] = {};
+
+static const char *const _strapPath[TANK_MAX] = {
+  "/strap.csv", "/strap_t1.csv", "/strap_t2.csv"
+};
+
+inline const char *strapPath(uint8_t tank) { return _strapPath[tank < TANK_MAX ? tank : 0]; }
+
+// Parse "height_cm,litres" lines (';', tab or space also separate the
+// columns). Blank lines, '#' comments and non-numeric lines such as a
+// header are skipped. Returns the number of points, or -1 if there are
+// more than STRAP_MAX_POINTS.
+inline int strapParse(const char *txt, float *h, float *v) {
+  int n = 0;
+  while (*txt) {
+    const char *eol = strchr(txt, '\n');
+    size_t len = eol ? (size_t)(eol - txt) : strlen(txt);
+    char line[48];
+    if (len < sizeof(line) && *txt != '#') {
+      memcpy(line, txt, len);
+      line[len] = '\0';
+      char *p = line, *e;
+      float a = strtof(p, &e);
+      if (e != p) {
+        p = e;
+        while (*p == ',' || *p == ';' || *p == '\t' || *p == ' ') p++;
+        float b = strtof(p, &e);
+        if (e != p) {
+          if (n >= STRAP_MAX_POINTS) return -1;
+          h[n] = a;
+          v[n] = b;
+          n++;
+        }
+      }
+    }
+    if (!eol) break;
+    txt = eol + 1;
+  }
+  return n;
+}
+
+// Validate the points in `t` and compute knot slopes. Interior slopes are
+// the weighted harmonic mean of the neighbouring secants (zero at a local
+// extremum), which keeps the curve monotone between knots.
+inline bool _strapBuild(StrapTable &t) {
+  if (t.n < 2) return false;
+  for (uint8_t i = 0; i < t.n; i++) {
+    if (!isfinite(t.h[i]) || !isfinite(t.v[i]) || t.v[i] < 0) return false;
+    if (i && (t.h[i] <= t.h[i - 1] || t.v[i] < t.v[i - 1])) return false;
+  }
+  float dPrev = 0, wPrev = 0;
+  for (uint8_t i = 0; i + 1 < t.n; i++) {
+    float w = t.h[i + 1] - t.h[i];
+    float d = (t.v[i + 1] - t.v[i]) / w;
+    if (i == 0) {
+      t.m[0] = d;
+    } else if (dPrev <= 0 || d <= 0) {
+      t.m[i] = 0;
+    } else {
+      float w1 = 2 * w + wPrev, w2 = w + 2 * wPrev;
+      t.m[i] = (w1 + w2) / (w1 / dPrev + w2 / d);
+    }
+    dPrev = d;
+    wPrev = w;
+  }
+  t.m[t.n - 1] = dPrev;
+  return true;
+}
+
+// Litres at height h; clamped to the first/last point outside the table.
+inline float _strapEval(const StrapTable &t, float h) {
+  if (h <= t.h[0])       return t.v[0];
+  if (h >= t.h[t.n - 1]) return t.v[t.n - 1];
+  uint8_t lo = 0, hi = t.n - 1;
+  while (hi - lo > 1) {
+    uint8_t mid = (lo + hi) / 2;
+    if (t.h[mid] <= h) lo = mid; else hi = mid;
+  }
+  float w = t.h[hi] - t.h[lo];
+  float s = (h - t.h[lo]) / w, s2 = s * s, s3 = s2 * s;
+  return (2 * s3 - 3 * s2 + 1) * t.v[lo] + (s3 - 2 * s2 + s) * w * t.m[lo] +
+         (-2 * s3 + 3 * s2) * t.v[hi] + (s3 - s2) * w * t.m[hi];
+}
+
+inline void strapFree(uint8_t tank) {
+  delete _strap[tank];
+  _strap[tank] = nullptr;
+}
+
+// Parse, validate and install a table from CSV text. Returns the number
+// of points, or -1 if the table is unusable (previous table kept).
+inline int strapSet(uint8_t tank, const char *csv) {
+  if (tank >= TANK_MAX) return -1;
+  StrapTable *t = new StrapTable;
+  if (!t) return -1;
+  int n = strapParse(csv, t->h, t->v);
+  t->n = n > 0 ? n : 0;
+  if (n < 0 || !_strapBuild(*t)) {
+    delete t;
+    return -1;
+  }
+  delete _strap[tank];
+  _strap[tank] = t;
+  return n;
+}
+
+inline bool strapLoad(uint8_t tank) {
+  strapFree(tank);
+  File f = LittleFS.open(strapPath(tank), "r");
+  if (!f) return false;
+  String csv = f.readString();
+  f.close();
+  int n = strapSet(tank, csv.c_str());
+  if (n < 0) dbgPrintf("[GEOM] %s invalid, volume unavailable\n", strapPath(tank));
+  else       dbgPrintf("[GEOM] tank%u strapping table: %d points\n", tank + 1, n);
+  return n > 0;
+}
+
+// Install and persist an uploaded table; the file is only written if the
+// table is valid.
+inline int strapSave(uint8_t tank, const String &csv) {
+  int n = strapSet(tank, csv.c_str());
+  if (n < 0) return -1;
+  File f = LittleFS.open(strapPath(tank), "w");
+  if (!f) return -1;
+  f.print(csv);
+  f.close();
+  return n;
+}
+
+inline void strapRemove(uint8_t tank) {
+  if (tank >= TANK_MAX) return;
+  LittleFS.remove(strapPath(tank));
+  strapFree(tank);
+}
+
+// Load the strapping tables needed by the configured shapes.
+inline void geometryInit(const Config &c) {
+  for (uint8_t i = 0; i < TANK_MAX; i++) {
+    if (i < c.tank_count && c.tanks[i].shape == SHAPE_TABLE) strapLoad(i);
+    else strapFree(i);
+  }
+}
+
+// Litres at water height h (cm above empty); 0 if the shape lacks its
+// dimensions, which callers treat as "volume unknown".
+inline float tankVolumeAt(const TankCal &t, uint8_t tank, float h) {
+  if (h < 0) h = 0;
+  float r = t.barrel_diam_cm / 2.0f;
+  float cm3;
+  switch (t.shape) {
+    case SHAPE_HCYL: {
+      if (r <= 0 || t.length_cm <= 0) return 0;
+      if (h > 2 * r) h = 2 * r;
+      float y = r - h;   // circular segment below the water line
+      cm3 = t.length_cm * (r * r * acosf(y / r) - y * sqrtf(h * (2 * r - h)));
+      break;
+    }
+    case SHAPE_RECT:
+      cm3 = t.width_cm * t.length_cm * h;
+      break;
+    case SHAPE_CONE: {
+      if (r <= 0) return 0;
+      float hc = t.cone_cm;
+      if (h < hc) {
+        float rh = r * h / hc;
+        cm3 = PI / 3.0f * rh * rh * h;
+      } else {
+        cm3 = PI * r * r * (hc / 3.0f + (h - hc));
+      }
+      break;
+    }
+    case SHAPE_TABLE:
+      return (tank < TANK_MAX && _strap[tank]) ? _strapEval(*_strap[tank], h) : 0;
+    default:
+      cm3 = PI * r * r * h;
+      break;
+  }
+  return cm3 > 0 ? cm3 / 1000.0f : 0;   // cm³ → L
+}
+
+// Litres at a level in % of the calibrated range (empty..full distance).
+inline float tankVolumePct(const TankCal &t, uint8_t tank, float pct) {
+  return tankVolumeAt(t, tank, (t.empty_dist_cm - t.full_dist_cm) * pct / 100.0f);
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <type_traits>
+
+// Streaming JSON writer for large API responses.
+// Output is assembled in a fixed scratch buffer and sent as HTTP chunks via
+// sendContent(), so a response never exists as a whole in RAM (no
+// JsonDocument, no String copy). Commas are inserted automatically; keep
+// nesting below 32 levels.
+
+#ifndef JSON_STREAM_BUF
+#define JSON_STREAM_BUF 256
+#endif
+
+class JsonStream {
+ public:
+  explicit JsonStream(ESP8266WebServer &srv) : _srv(srv) {}
+
+  // Send status line + headers; the body follows as chunks.
+  void begin(int code = 200) {
+    _srv.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _srv.send(code, F("application/json"), "");
+    _heapMin = ESP.getFreeHeap();
+  }
+
+  // Flush the tail and terminate the chunked body.
+  void end() {
+    flush();
+    _srv.sendContent("");
+  }
+
+  void beginObject()                              { _open('{'); }
+  void beginObject(const __FlashStringHelper *k)  { key(k); _open('{'); }
+  void endObject()                                { _close('}'); }
+  void beginArray()                               { _open('['); }
+  void beginArray(const __FlashStringHelper *k)   { key(k); _open('['); }
+  void endArray()                                 { _close(']'); }
+
+  void key(const __FlashStringHelper *k) {
+    _sep();
+    _put('"');
+    PGM_P p = reinterpret_cast<PGM_P>(k);
+    _writeP(p, strlen_P(p));
+    _put('"');
+    _put(':');
+    _afterKey = true;
+  }
+
+  void null()                 { _sep(); _write("null", 4); }
+  void value(bool v)          { _sep(); v ? _write("true", 4) : _write("false", 5); }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+  value(T v) {
+    char b[12];
+    _sep();
+    if (std::is_signed<T>::value) _write(b, snprintf(b, sizeof(b), "%ld", (long)v));
+    else                          _write(b, snprintf(b, sizeof(b), "%lu", (unsigned long)v));
+  }
+  void value(const char *s)   { _sep(); _string(s); }
+  void value(const String &s) { _sep(); _string(s.c_str()); }
+
+  // Fixed-point tenths ("12.3", "-0.5", "40").
+  void tenths(int32_t v) {
+    char b[14];
+    int n = 0;
+    _sep();
+    if (v < 0) { b[n++] = '-'; v = -v; }
+    n += snprintf(b + n, sizeof(b) - n, "%ld", (long)(v / 10));
+    if (v % 10) { b[n++] = '.'; b[n++] = (char)('0' + v % 10); }
+    _write(b, n);
+  }
+
+  // Float with up to `dec` decimals, trailing zeros trimmed; NaN -> null.
+  void number(float v, uint8_t dec = 1) {
+    if (isnan(v) || isinf(v)) { null(); return; }
+    if (dec == 1 && fabsf(v) < 2.0e8f) { tenths(lroundf(v * 10.0f)); return; }
+    char b[24];
+    _sep();
+    int n = snprintf(b, sizeof(b), "%.*f", dec, (double)v);
+    if (n <= 0 || n >= (int)sizeof(b)) { _write("0", 1); return; }
+    if (dec) {
+      while (n > 1 && b[n - 1] == '0') n--;
+      if (b[n - 1] == '.') n--;
+    }
+    if (n == 2 && b[0] == '-' && b[1] == '0') { b[0] = '0'; n = 1; }
+    _write(b, n);
+  }
+
+  // key + value shorthands
+  template <typename T>
+  void kv(const __FlashStringHelper *k, T v)                     { key(k); value(v); }
+  void kvNull(const __FlashStringHelper *k)                      { key(k); null(); }
+  void kvTenths(const __FlashStringHelper *k, int32_t v)         { key(k); tenths(v); }
+  void kvNumber(const __FlashStringHelper *k, float v, uint8_t dec = 1) { key(k); number(v, dec); }
+
+  void flush() {
+    if (_len) {
+      _srv.sendContent(_buf, _len);
+      _len = 0;
+    }
+    sampleHeap();
+  }
+
+  // Track the lowest free heap seen while this response was produced.
+  void sampleHeap() {
+    uint32_t h = ESP.getFreeHeap();
+    if (h < _heapMin) _heapMin = h;
+  }
+  uint32_t heapMin() const { return _heapMin; }
+
+ private:
+  void _open(char c) {
+    _sep();
+    _put(c);
+    if (_depth < 32) _first |= (1UL << _depth);
+    _depth++;
+  }
+
+  void _close(char c) {
+    if (_depth) _depth--;
+    _put(c);
+  }
+
+  // Comma before every element except the first one in its container.
+  void _sep() {
+    if (_afterKey) { _afterKey = false; return; }
+    if (!_depth) return;
+    uint32_t bit = (_depth <= 32) ? (1UL << (_depth - 1)) : 0;
+    if (_first & bit) _first &= ~bit;
+    else              _put(',');
+  }
+
+  void _string(const char *s) {
+    if (!s) { _write("null", 4); return; }
+    _put('"');
+    for (; *s; s++) {
+      char c = *s;
+      if (c == '"' || c == '\\') { _put('\\'); _put(c); }
+      else if ((uint8_t)c < 0x20) {
+        char b[7];
+        _write(b, snprintf(b, sizeof(b), "\\u%04x", (unsigned)(uint8_t)c));
+      } else _put(c);
+    }
+    _put('"');
+  }
+
+  void _put(char c) {
+    if (_len >= JSON_STREAM_BUF) flush();
+    _buf[_len++] = c;
+  }
+
+  void _write(const char *s, size_t n) {
+    while (n) {
+      if (_len >= JSON_STREAM_BUF) flush();
+      size_t run = JSON_STREAM_BUF - _len;
+      if (run > n) run = n;
+      memcpy(_buf + _len, s, run);
+      _len += run; s += run; n -= run;
+    }
+  }
+
+  void _writeP(PGM_P s, size_t n) {
+    while (n) {
+      if (_len >= JSON_STREAM_BUF) flush();
+      size_t run = JSON_STREAM_BUF - _len;
+      if (run > n) run = n;
+      memcpy_P(_buf + _len, s, run);
+      _len += run; s += run; n -= run;
+    }
+  }
+
+  ESP8266WebServer &_srv;
+  char     _buf[JSON_STREAM_BUF];
+  size_t   _len = 0;
+  uint32_t _first = 0;    // bit per depth: next element is the first one
+  uint8_t  _depth = 0;
+  bool     _afterKey = false;
+  uint32_t _heapMin = 0xFFFFFFFF;
+};
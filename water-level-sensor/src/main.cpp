@@ -16,35 +16,33 @@
 #include "config.h"
 #include "sensor.h"
 #include "storage.h"
+#include "scheduler.h"
+#include "profiler.h"
 #include "mqtt_handler.h"
 #include "telegram_handler.h"
 #include "webserver.h"
 
 // ── Globals ──────────────────────────────────────────────────────────────────
 Config     cfg;
-SensorData sens;
+SensorData &sens = tankData(0);   // primary tank (Telegram, boot message)
 ESP8266WebServer    webServer(80);
 ESP8266HTTPUpdateServer updater;
 
 bool apMode = false;
 bool bootPhase = true;
-volatile bool measureQueued = false;
-unsigned long tMeasureQueuedDue = 0;
 
-// Timers
-unsigned long tMeasure    = 0;
-unsigned long tRecentHist = 0;
-unsigned long tHourly     = 0;
-unsigned long tTelegram   = 0;
-unsigned long tMqtt       = 0;
-unsigned long tMdns       = 0;
+// Background measurement started from loop(), completed by measurePoll()
+bool measAsyncPending = false;
+bool measAsyncAlerts  = false;
+bool measAsyncPublish = false;
+
+// Scheduler task ids (see _schedSetup)
+int8_t taskMeasure     = -1;
+int8_t taskMeasQueued  = -1;
 
 // Daily summary
-int lastSummaryDay = -1;
+int lastSummaryDay = -1;       // tm_yday of the last daily summary
 String serialLine;
-bool tgBootMsgPending = false;
-unsigned long tWifiRetry = 0;
-unsigned long tBootMsgDue = 0;
 
 void doMeasureCallback();
 void doMeasureNoAlertsCallback();
@@ -81,15 +79,21 @@ static void serialHelp() {
   dbgPrintln(F("  cfg set <key> <value>"));
   dbgPrintln(F("  measure"));
   dbgPrintln(F("  wifi scan"));
+  dbgPrintln(F("  prof        (latency histograms since last prof, then reset)"));
   dbgPrintln(F("  reboot"));
   dbgPrintln(F("[SER] Examples:"));
   dbgPrintln(F("  cfg set tp 14"));
   dbgPrintln(F("  cfg set ep 12"));
   dbgPrintln(F("  cfg set dp 2"));
   dbgPrintln(F("  cfg set de true"));
+  dbgPrintln(F("  cfg set dw 28FF641E8216043C   (water probe ROM; da air, dc case, \"\" = auto)"));
   dbgPrintln(F("  cfg set ws MyWiFi"));
   dbgPrintln(F("  cfg set wp mypass"));
   dbgPrintln(F("  cfg set ms 60"));
+  dbgPrintln(F("  cfg set nt 2"));
+  dbgPrintln(F("  cfg set mb 1440      (MQTT outage buffer, readings; mr = replayed per second)"));
+  dbgPrintln(F("  cfg set mdl 1        (MQTT level deadband %; mdd cm, mdv L, mdt C, mdr L/h; mhb heartbeat s)"));
+  dbgPrintln(F("  cfg set tk1.ed 120   (tank 2 calibration: n tp ep ed fd bd sh bw bl bc)"));
   dbgPrintln(F("  cfg save"));
 }
 
@@ -98,6 +102,28 @@ static bool serialSetConfig(const String &keyRaw, String value) {
   value = _trimQuotes(value);
   bool bv;
 
+  // Tank calibration: "tk<i>.<key>" for any tank, plain keys for tank 0
+  TankCal *tank = &cfg.tanks[0];
+  bool tankKey = key.startsWith("tk") && key.length() > 4 && key[3] == '.';
+  if (tankKey) {
+    int i = key[2] - '0';
+    if (i < 0 || i >= TANK_MAX) return false;
+    tank = &cfg.tanks[i];
+    key = key.substring(4);
+    if (key == "n") { strlcpy(tank->name, value.c_str(), sizeof(tank->name)); return true; }
+  }
+  if (key == "n0") { strlcpy(tank->name, value.c_str(), sizeof(tank->name)); return true; }
+  if (key == "tp") { tank->trig_pin = (uint8_t)value.toInt(); return true; }
+  if (key == "ep") { tank->echo_pin = (uint8_t)value.toInt(); return true; }
+  if (key == "ed") { tank->empty_dist_cm = value.toFloat(); return true; }
+  if (key == "fd") { tank->full_dist_cm  = value.toFloat(); return true; }
+  if (key == "bd") { tank->barrel_diam_cm = value.toFloat(); return true; }
+  if (key == "sh") { tank->shape = (uint8_t)value.toInt(); return true; }
+  if (key == "bw") { tank->width_cm  = value.toFloat(); return true; }
+  if (key == "bl") { tank->length_cm = value.toFloat(); return true; }
+  if (key == "bc") { tank->cone_cm   = value.toFloat(); return true; }
+  if (tankKey) return false;
+
   // Strings
   if (key == "ws") { strlcpy(cfg.wifi_ssid, value.c_str(), sizeof(cfg.wifi_ssid)); return true; }
   if (key == "wp") { strlcpy(cfg.wifi_password, value.c_str(), sizeof(cfg.wifi_password)); return true; }
@@ -109,6 +135,9 @@ static bool serialSetConfig(const String &keyRaw, String value) {
   if (key == "tc") { strlcpy(cfg.tg_chat, value.c_str(), sizeof(cfg.tg_chat)); return true; }
   if (key == "dn") { strlcpy(cfg.device_name, value.c_str(), sizeof(cfg.device_name)); return true; }
   if (key == "op") { strlcpy(cfg.ota_pass, value.c_str(), sizeof(cfg.ota_pass)); return true; }
+  if (key == "da") { strlcpy(cfg.ds18_rom[TEMP_AIR],   value.c_str(), sizeof(cfg.ds18_rom[0])); return true; }
+  if (key == "dw") { strlcpy(cfg.ds18_rom[TEMP_WATER], value.c_str(), sizeof(cfg.ds18_rom[0])); return true; }
+  if (key == "dc") { strlcpy(cfg.ds18_rom[TEMP_CASE],  value.c_str(), sizeof(cfg.ds18_rom[0])); return true; }
 
   // Booleans
   if (key == "me") { if (!_parseBool(value, bv)) return false; cfg.mqtt_en = bv; return true; }
@@ -122,19 +151,26 @@ static bool serialSetConfig(const String &keyRaw, String value) {
   if (key == "de") { if (!_parseBool(value, bv)) return false; cfg.ds18_en = bv; return true; }
 
   // Integers
-  if (key == "tp") { cfg.trig_pin = (uint8_t)value.toInt(); return true; }
-  if (key == "ep") { cfg.echo_pin = (uint8_t)value.toInt(); return true; }
+  if (key == "nt") { cfg.tank_count = (uint8_t)value.toInt(); return true; }
   if (key == "dp") { cfg.ds18_pin = (uint8_t)value.toInt(); return true; }
   if (key == "as") { cfg.avg_samples = (uint8_t)value.toInt(); return true; }
+  if (key == "fm") { cfg.filter_mode = (uint8_t)value.toInt(); return true; }
   if (key == "ms") { cfg.measure_sec = (uint16_t)value.toInt(); return true; }
+  if (key == "mi") { cfg.measure_min_sec = (uint16_t)value.toInt(); return true; }
   if (key == "mp") { cfg.mqtt_port = (uint16_t)value.toInt(); return true; }
+  if (key == "mb") { cfg.mqtt_buf = (uint16_t)value.toInt(); return true; }
+  if (key == "mr") { cfg.mqtt_drain = (uint8_t)value.toInt(); return true; }
+  if (key == "mhb") { cfg.mqtt_hb = (uint16_t)value.toInt(); return true; }
 
   // Floats
-  if (key == "ed") { cfg.empty_dist_cm = value.toFloat(); return true; }
-  if (key == "fd") { cfg.full_dist_cm  = value.toFloat(); return true; }
-  if (key == "bd") { cfg.barrel_diam_cm = value.toFloat(); return true; }
+  if (key == "fk") { cfg.filter_mad_k = value.toFloat(); return true; }
   if (key == "tl") { cfg.tg_alert_low = value.toFloat(); return true; }
   if (key == "th") { cfg.tg_alert_high = value.toFloat(); return true; }
+  if (key == "mdl") { cfg.mqtt_db_level = value.toFloat(); return true; }
+  if (key == "mdd") { cfg.mqtt_db_dist  = value.toFloat(); return true; }
+  if (key == "mdv") { cfg.mqtt_db_vol   = value.toFloat(); return true; }
+  if (key == "mdt") { cfg.mqtt_db_temp  = value.toFloat(); return true; }
+  if (key == "mdr") { cfg.mqtt_db_rate  = value.toFloat(); return true; }
 
   return false;
 }
@@ -183,6 +219,10 @@ static void serialHandleCommand(String line) {
     dbgPrintf("[SER] wifi scan result: %s\n", json.c_str());
     return;
   }
+  if (line == "prof") {
+    profDump();
+    return;
+  }
   if (line == "reboot") {
     dbgPrintln(F("[SER] Rebooting..."));
     delay(100);
@@ -286,14 +326,48 @@ void setupArduinoOTA() {
 }
 
 // ── Measure callback ──────────────────────────────────────────────────────────
-static void _doMeasureCommon(bool allowAlerts) {
-  doMeasure(cfg, sens);
-  computeTrendStats(sens); // warm cache outside frequent /api/status requests
-  dbgPrintf("[Sensor] dist=%.1f cm  level=%.1f%%  vol=%.1f L  temp=%.1f°C\n",
-                sens.distance_cm, sens.level_pct, sens.volume_liters, sens.temp_c);
+static void _measureProcess(bool allowAlerts) {
+  for (uint8_t i = 0; i < cfg.tank_count; i++) {
+    SensorData &s = tankData(i);
+    levelFilterUpdate(cfg, s);
+    storageRollupAdd(s);  // hour/day/month min/max/avg tiers
+    {
+      PROF_SCOPE(PROF_TREND);
+      computeTrendStats(s); // warm cache outside frequent /api/status requests
+    }
+    dbgPrintf("[Sensor] %s dist=%.1f cm  level=%.1f%%  vol=%.1f L  temp=%.1f°C  echo=%u/%u sd=%.2f%s\n",
+                  cfg.tanks[i].name, s.distance_cm, s.level_pct, s.volume_liters, s.temp_c,
+                  s.quality.valid, s.quality.attempted, s.quality.sd_cm,
+                  measQualityPoor(s.quality) ? " (poor)" : "");
+    ssePushStatus(s);
+  }
+  measureCadenceUpdate(cfg);
+  schedSetPeriod(taskMeasure, (uint32_t)measureIntervalSec() * 1000UL);
   if (allowAlerts && !bootPhase) tgCheckAlerts(cfg, sens);
 }
 
+static void _mqttPublishAll() {
+  for (uint8_t i = 0; i < cfg.tank_count; i++) mqttPublish(cfg, tankData(i));
+}
+
+static void _doMeasureCommon(bool allowAlerts) {
+  // doMeasure() joins a background burst in flight; finish its work here too
+  bool joined = measAsyncPending;
+  measAsyncPending = false;
+  doMeasure(cfg);
+  _measureProcess(allowAlerts || (joined && measAsyncAlerts));
+  if (joined && measAsyncPublish) _mqttPublishAll();
+}
+
+// Start a non-blocking measurement; loop() finishes it via measurePoll().
+static void _measureBegin(bool allowAlerts, bool publish) {
+  if (!measAsyncPending) measAsyncAlerts = measAsyncPublish = false;
+  measureStart(cfg);
+  measAsyncPending = true;
+  measAsyncAlerts  |= allowAlerts;
+  measAsyncPublish |= publish;
+}
+
 void doMeasureCallback() {
   _doMeasureCommon(true);
 }
@@ -303,8 +377,87 @@ void doMeasureNoAlertsCallback() {
 }
 
 void queueMeasureNoAlertsCallback() {
-  measureQueued = true;
-  tMeasureQueuedDue = millis() + 5000UL; // let HTTP response/TCP flush before heavy work
+  schedDelay(taskMeasQueued, 5000UL); // let HTTP response/TCP flush before heavy work
+}
+
+// ── Scheduled tasks ───────────────────────────────────────────────────────────
+static void _taskMeasure() {
+  _measureBegin(true, true);
+}
+
+// Manual measure requested from HTTP handler (run here to avoid blocking request context).
+static void _taskMeasQueued() {
+  _measureBegin(false, false);
+  // Avoid extra network burst right after /api/measure HTTP response; periodic publish will follow.
+  schedDelay(taskMeasure, (uint32_t)measureIntervalSec() * 1000UL);
+}
+
+// Recent snapshots for graph (1 point / minute, last 60 points)
+static void _taskRecentHist() {
+  for (uint8_t i = 0; i < cfg.tank_count; i++) storageWriteRecent(tankData(i));
+  ssePushHistory();
+}
+
+// Hourly snapshot for history
+static void _taskHourly() {
+  for (uint8_t i = 0; i < cfg.tank_count; i++) storageWrite(tankData(i));
+  ssePushHistory();
+}
+
+// MQTT keep-alive + auto-discovery
+static void _taskMqtt() {
+  mqttLoop(cfg);
+  if (mqttConnected()) mqttDiscovery(cfg);  // no-op after first send
+}
+
+// Deferred startup Telegram message, once the system is fully up.
+static void _taskTgBoot() {
+  tgBootMessage(cfg, sens);
+}
+
+// Asks for a getUpdates poll; tgPoll() in loop() runs it.
+static void _taskTelegram() {
+  if (cfg.tg_en) tgLoop(cfg, sens);
+}
+
+// Daily summary on the first run of each day's 00:xx hour. Keyed on the day,
+// not the 00:00 minute, which a delayed run can step over. Nothing before
+// NTP sync (the clock would read 1970-01-01 00:xx).
+static void _taskDaily() {
+  if (!cfg.tg_en || !cfg.tg_daily) return;
+  time_t t = time(nullptr);
+  if ((uint32_t)t < HIST_TS_VALID_MIN) return;
+  struct tm *ti = localtime(&t);
+  if (!ti) return;
+  if (ti->tm_hour == 0 && ti->tm_yday != lastSummaryDay) {
+    tgDailySummary(cfg, sens);
+    lastSummaryDay = ti->tm_yday;
+  }
+}
+
+static void _taskWifi() {
+  if (WiFi.status() != WL_CONNECTED) {
+    dbgPrintln(F("[WiFi] Reconnecting..."));
+    WiFi.reconnect();
+  }
+}
+
+// Priorities: measurement timing first, then connectivity, flash writes,
+// Telegram (TLS, slowest) last. Budgets are the run times we expect; a
+// longer run shows up as an overrun in /api/tasks.
+static void _schedSetup() {
+  // name, fn, period ms, prio, budget µs, first run in ms (-1: idle one-shot)
+  taskMeasQueued = schedAdd("meas_manual", _taskMeasQueued, 0, 0, 2000, -1);
+  if (apMode) return;
+  uint32_t meas = (uint32_t)measureIntervalSec() * 1000UL;
+  taskMeasure    = schedAdd("measure",     _taskMeasure,    meas,      0, 2000, meas);
+  schedAdd("wifi",        _taskWifi,       5000UL,    1, 5000);
+  schedAdd("mqtt",        _taskMqtt,       1000UL,    1, 50000);
+  schedAdd("hist_recent", _taskRecentHist, 60000UL,   2, 50000,  60000L);
+  schedAdd("hist_hourly", _taskHourly,     3600000UL, 2, 100000, 3600000L);
+  schedAdd("telegram",    _taskTelegram,   10000UL,   3, 1000);
+  schedAdd("daily",       _taskDaily,      30000UL,   4, 20000);
+  if (cfg.tg_en) schedAdd("tg_boot", _taskTgBoot, 0, 3, 20000, 8000L);
 }
 
 // ── setup ────────────────────────────────────────────────────────────────────
@@ -328,9 +481,10 @@ void setup() {
   }
 
   // Sensor
+  geometryInit(cfg);
   initSensor(cfg);
   initTempSensor(cfg);
-  storageInit();
+  storageInit(cfg.tank_count);
 
   // WiFi
   if (!connectWiFi()) {
@@ -350,101 +504,44 @@ void setup() {
   }
 
   // Web server
-  webSetup(webServer, updater, cfg, sens, doMeasureNoAlertsCallback, queueMeasureNoAlertsCallback);
+  webSetup(webServer, updater, cfg, doMeasureNoAlertsCallback, queueMeasureNoAlertsCallback);
   webServer.begin();
   dbgPrintln(F("[HTTP] Server started"));
 
   // First measurement
   doMeasureCallback();
-  tMeasure = millis();
 
   // Store first point in history right away
   if (!apMode) {
-    storageWriteRecent(sens); // recent minute-cache (first point)
-    tRecentHist = millis();
-    storageWrite(sens);
-    tHourly = millis();
-    tgBootMsgPending = cfg.tg_en;
-    tBootMsgDue = millis() + 8000UL;
+    for (uint8_t i = 0; i < cfg.tank_count; i++) {
+      storageWriteRecent(tankData(i)); // recent minute-cache (first point)
+      storageWrite(tankData(i));
+    }
   }
+  _schedSetup();
   bootPhase = false;
 }
 
 // ── loop ─────────────────────────────────────────────────────────────────────
 void loop() {
-  serialPoll();
-  webServer.handleClient();
-  MDNS.update();
-
-  // Manual measure requested from HTTP handler (run here to avoid blocking request context).
-  if (measureQueued && (long)(millis() - tMeasureQueuedDue) >= 0) {
-    measureQueued = false;
-    doMeasureNoAlertsCallback();
-    // Avoid extra network burst right after /api/measure HTTP response; periodic publish will follow.
-    tMeasure = millis();
+  PROF_SCOPE(PROF_LOOP);
+  { PROF_SCOPE(PROF_SERIAL); serialPoll(); }
+  { PROF_SCOPE(PROF_HTTP);   webServer.handleClient(); }
+  { PROF_SCOPE(PROF_SSE);    sseLoop(); }
+  { PROF_SCOPE(PROF_MDNS);   MDNS.update(); }
+
+  if (measAsyncPending) {
+    PROF_SCOPE(PROF_MEAS);
+    if (measurePoll(cfg)) {
+      measAsyncPending = false;
+      _measureProcess(measAsyncAlerts);
+      if (measAsyncPublish) _mqttPublishAll();
+    }
   }
 
   if (!apMode) {
-    ArduinoOTA.handle();
-
-    unsigned long now = millis();
-
-    // Periodic measurement
-    if (now - tMeasure >= (unsigned long)cfg.measure_sec * 1000UL) {
-      doMeasureCallback();
-      mqttPublish(cfg, sens);
-      tMeasure = now;
-    }
-
-    // Recent snapshots for graph (1 point / minute, last 60 points)
-    if (now - tRecentHist >= 60000UL) {
-      storageWriteRecent(sens);
-      tRecentHist = now;
-    }
-
-    // Hourly snapshot for history
-    if (now - tHourly >= 3600000UL) {
-      storageWrite(sens);
-      tHourly = now;
-    }
-
-    // MQTT keep-alive + auto-discovery
-    if (now - tMqtt >= 1000UL) {
-      mqttLoop(cfg);
-      if (mqttConnected()) mqttDiscovery(cfg);  // no-op after first send
-      tMqtt = now;
-    }
-
-    // Defer startup Telegram message until the system is fully up.
-    if (tgBootMsgPending && now >= tBootMsgDue) {
-      tgBootMessage(cfg, sens);
-      tgBootMsgPending = false;
-    }
-
-    // Telegram polling
-    if (cfg.tg_en && now - tTelegram >= 10000UL) {
-      tgLoop(cfg, sens);
-      tTelegram = now;
-    }
-
-    // Daily summary at midnight
-    if (cfg.tg_en && cfg.tg_daily) {
-      time_t t = time(nullptr);
-      struct tm *ti = localtime(&t);
-      if (ti->tm_hour == 0 && ti->tm_min == 0 && ti->tm_mday != lastSummaryDay) {
-        tgDailySummary(cfg, sens);
-        lastSummaryDay = ti->tm_mday;
-      }
-    }
-
-    // WiFi watchdog
-    if (WiFi.status() != WL_CONNECTED) {
-      if (now - tWifiRetry >= 5000UL) {
-        dbgPrintln(F("[WiFi] Reconnecting..."));
-        WiFi.reconnect();
-        tWifiRetry = now;
-      }
-    }
+    { PROF_SCOPE(PROF_OTA); ArduinoOTA.handle(); }
+    { PROF_SCOPE(PROF_TG);  tgPoll(cfg, sens); }
   }
-
+  { PROF_SCOPE(PROF_SCHED); schedRun(); }
 }
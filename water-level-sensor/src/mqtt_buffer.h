@@ -0,0 +1,133 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "sensor.h"
+#include "storage.h"
+
+// ------------------------------------------------------------------
+// MQTT store-and-forward: readings that could not be published (broker
+// or WiFi down) are appended to a fixed-record ring in LittleFS (same
+// header/record layout as the recent-history rings, see storage.h) and
+// replayed oldest first, at most `mqtt_drain` per second, once the
+// broker is back. A full ring overwrites its oldest reading. The ring
+// size follows `mqtt_buf`; a changed size recreates the file (empty).
+// ------------------------------------------------------------------
+#define MQTT_BUF_FILE    "/mqtt_buf.bin"
+#define MQTT_BUF_NO_TEMP INT16_MIN    // temperature not available
+
+struct MqttBufRecord {
+  uint32_t ts;
+  float    level;     // %
+  float    dist;      // cm
+  float    volume;    // L
+  float    free_l;    // L
+  int16_t  temp_c100[TEMP_PROBES];   // air, water, case: 0.01 °C
+  uint8_t  tank;
+  uint8_t  pings;     // valid echoes << 4 | pings sent, as HistRecord
+  uint8_t  sd_mm;     // spread of the valid echoes, mm
+};
+static_assert(sizeof(MqttBufRecord) <= 32, "_storageInitRing pre-fills records of up to 32 bytes");
+
+struct MqttBufStats {
+  uint32_t stored;    // readings buffered
+  uint32_t sent;      // replayed to the broker
+  uint32_t lost;      // overwritten while the ring was full
+};
+
+static HistRing     _mqttBuf = { MQTT_BUF_FILE, 0, sizeof(MqttBufRecord), {0, 0}, false };
+static MqttBufStats _mqttBufStats = {};
+
+inline const MqttBufStats &mqttBufStats() { return _mqttBufStats; }
+inline uint16_t mqttBufCount()    { return _mqttBuf.ready ? _mqttBuf.hdr.count : 0; }
+inline uint16_t mqttBufCapacity() { return _mqttBuf.maxRec; }
+
+// Open the ring with `mqtt_buf` records; 0 removes it.
+inline void mqttBufInit(const Config &c) {
+  _mqttBuf.ready  = false;
+  _mqttBuf.maxRec = c.mqtt_buf;
+  if (!c.mqtt_buf) {
+    LittleFS.remove(MQTT_BUF_FILE);
+    return;
+  }
+  if (_storageInitRing(_mqttBuf) && _mqttBuf.hdr.count)
+    dbgPrintf("[MQTT] %u buffered readings waiting\n", _mqttBuf.hdr.count);
+}
+
+inline MqttBufRecord mqttBufRecordOf(const SensorData &s) {
+  MqttBufRecord r;
+  memset(&r, 0, sizeof(r));
+  r.ts     = s.timestamp;
+  r.level  = s.level_pct;
+  r.dist   = s.distance_cm;
+  r.volume = s.volume_liters;
+  r.free_l = s.free_liters;
+  const float t[TEMP_PROBES] = { s.temp_c, s.water_c, s.case_c };
+  for (uint8_t i = 0; i < TEMP_PROBES; i++)
+    r.temp_c100[i] = isnan(t[i]) ? MQTT_BUF_NO_TEMP : (int16_t)lroundf(t[i] * 100.0f);
+  r.tank = s.tank;
+  HistRecord h = histRecordOf(s);
+  r.pings = h.pings;
+  r.sd_mm = h.sd_mm;
+  return r;
+}
+
+static bool _mqttBufWriteHeader(File &f, const HistHeader &hdr) {
+  f.seek(0);
+  if (f.write((const uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) {
+    _mqttBuf.hdr = hdr;
+    return true;
+  }
+  _mqttBuf.ready = false;   // reload from flash on next access
+  return false;
+}
+
+// Buffer a reading for later; readings without a synced clock are not
+// kept since their time could not be told afterwards.
+inline void mqttBufPush(const SensorData &s) {
+  if (!_mqttBuf.maxRec || s.timestamp < HIST_TS_VALID_MIN) return;
+  if (!_mqttBuf.ready && !_storageInitRing(_mqttBuf)) return;
+  File f = LittleFS.open(MQTT_BUF_FILE, "r+");
+  if (!f) {
+    _mqttBuf.ready = false;
+    return;
+  }
+  MqttBufRecord rec = mqttBufRecordOf(s);
+  HistHeader hdr = _mqttBuf.hdr;
+  f.seek(sizeof(hdr) + (uint32_t)hdr.head * _mqttBuf.recSize);
+  bool ok = f.write((const uint8_t *)&rec, _mqttBuf.recSize) == _mqttBuf.recSize;
+  hdr.head = (hdr.head + 1) % _mqttBuf.maxRec;
+  if (hdr.count < _mqttBuf.maxRec) hdr.count++;
+  else                             _mqttBufStats.lost++;
+  if (ok && _mqttBufWriteHeader(f, hdr)) _mqttBufStats.stored++;
+  f.close();
+}
+
+// Replay up to `maxN` of the oldest readings through send(rec), stopping
+// at the first one it refuses. Sent readings are removed with a single
+// header write. Returns how many were sent.
+template <typename Send>
+inline uint16_t mqttBufDrain(uint16_t maxN, Send send) {
+  if (!mqttBufCount() || !maxN) return 0;
+  File f = LittleFS.open(MQTT_BUF_FILE, "r+");
+  if (!f) {
+    _mqttBuf.ready = false;
+    return 0;
+  }
+  HistHeader hdr = _mqttBuf.hdr;
+  uint16_t tail = (hdr.head + _mqttBuf.maxRec - hdr.count) % _mqttBuf.maxRec;
+  uint16_t done = 0;
+  while (done < maxN && done < hdr.count) {
+    MqttBufRecord rec;
+    f.seek(sizeof(hdr) + (uint32_t)((tail + done) % _mqttBuf.maxRec) * _mqttBuf.recSize);
+    if (f.read((uint8_t *)&rec, _mqttBuf.recSize) != _mqttBuf.recSize || !send(rec)) break;
+    done++;
+  }
+  if (done) {
+    hdr.count -= done;
+    _mqttBufWriteHeader(f, hdr);
+    _mqttBufStats.sent += done;
+  }
+  f.close();
+  return done;
+}
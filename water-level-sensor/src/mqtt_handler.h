@@ -5,6 +5,7 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "sensor.h"
+#include "mqtt_buffer.h"
 
 static WiFiClient   _mqttWifiClient;
 static PubSubClient _mqttClient(_mqttWifiClient);
@@ -17,14 +18,50 @@ static String _availTopic() {
   return String(F("watersensor/")) + String(ESP.getChipId(), HEX) + F("/status");
 }
 
+// ── Per-tank base topic ───────────────────────────────────────────────────────
+// Tank 0 publishes under mqtt_topic as before, further tanks under
+// mqtt_topic/<tank name>.
+static void _mqttTankBase(const Config &c, uint8_t tank, char *out, size_t len) {
+  if (tank == 0) strlcpy(out, c.mqtt_topic, len);
+  else           snprintf(out, len, "%s/%s", c.mqtt_topic, c.tanks[tank].name);
+}
+
 // ── Setup ─────────────────────────────────────────────────────────────────────
 inline void mqttSetup(const Config &c) {
   if (!c.mqtt_en) return;
   _mqttEnabled = true;
   _mqttClient.setServer(c.mqtt_host, c.mqtt_port);
   _mqttClient.setBufferSize(512);   // needed for discovery payloads
+  mqttBufInit(c);
 }
 
+// ── Publish-on-change ─────────────────────────────────────────────────────────
+// Each topic remembers the value it last published. A reading is published
+// on a topic only if it moved by more than the metric's deadband or the
+// topic has been quiet for mqtt_hb seconds; <base>/json goes out whenever
+// any other topic of the reading did. mqtt_hb = 0 publishes every reading.
+// After a reconnect everything is published once again.
+enum MqttMetric : uint8_t {
+  MQM_LEVEL, MQM_DIST, MQM_VOLUME, MQM_FREE, MQM_ECHO, MQM_LEVEL_F, MQM_RATE,
+  MQM_TEMP, MQM_WATER, MQM_CASE, MQM_JSON, MQM_COUNT
+};
+
+struct MqttLast {
+  float         v;
+  unsigned long ms;     // millis() of the last publish
+  bool          sent;
+};
+
+struct MqttPubStats {
+  uint32_t sent;
+  uint32_t suppressed;
+};
+
+static MqttLast     _mqttLast[TANK_MAX][MQM_COUNT];
+static MqttPubStats _mqttPubStats = {};
+
+inline const MqttPubStats &mqttPubStats() { return _mqttPubStats; }
+
 // ── Connect (with LWT) ────────────────────────────────────────────────────────
 static bool _mqttConnect(const Config &c) {
   if (_mqttClient.connected()) return true;
@@ -43,6 +80,7 @@ static bool _mqttConnect(const Config &c) {
     dbgPrintln(F("[MQTT] connected"));
     _mqttClient.publish(avail.c_str(), "online", true);
     _mqttDiscoverySent = false;   // re-send discovery after reconnect
+    memset(_mqttLast, 0, sizeof(_mqttLast));   // and every topic with the next reading
   } else {
     dbgPrintf("[MQTT] failed rc=%d\n", _mqttClient.state());
   }
@@ -98,77 +136,181 @@ inline void mqttDiscovery(const Config &c) {
     _mqttClient.publish(discTopic, payload, true);
   };
 
-  // Build state topics from config base topic
-  String base = c.mqtt_topic;
-  char tLevel[80], tVolume[80], tFree[80], tDist[80], tTemp[80];
-  snprintf(tLevel,  sizeof(tLevel),  "%s/level",       base.c_str());
-  snprintf(tVolume, sizeof(tVolume), "%s/volume",      base.c_str());
-  snprintf(tFree,   sizeof(tFree),   "%s/free",        base.c_str());
-  snprintf(tDist,   sizeof(tDist),   "%s/distance",    base.c_str());
-  snprintf(tTemp,   sizeof(tTemp),   "%s/temperature", base.c_str());
-
-  // Publish discovery for each entity
-  pubDisc("level",    (devName + " Уровень").c_str(),      tLevel,  "%",  "",            "mdi:waves");
-  pubDisc("volume",   (devName + " Объём").c_str(),        tVolume, "L",  "volume",      "mdi:barrel");
-  pubDisc("free",     (devName + " Свободно").c_str(),     tFree,   "L",  "volume",      "mdi:barrel-outline");
-  pubDisc("distance", (devName + " Расстояние").c_str(),   tDist,   "cm", "distance",    "mdi:ruler");
+  // Per-tank entities; tank 0 keeps its original unique ids
+  for (uint8_t i = 0; i < c.tank_count; i++) {
+    char base[64];
+    _mqttTankBase(c, i, base, sizeof(base));
+    String pre  = i ? String('t') + i + '_' : String();
+    String name = i ? devName + ' ' + c.tanks[i].name : devName;
+
+    char tLevel[80], tVolume[80], tFree[80], tDist[80], tLevelF[80], tRate[80], tEcho[80];
+    snprintf(tLevel,  sizeof(tLevel),  "%s/level",       base);
+    snprintf(tVolume, sizeof(tVolume), "%s/volume",      base);
+    snprintf(tFree,   sizeof(tFree),   "%s/free",        base);
+    snprintf(tDist,   sizeof(tDist),   "%s/distance",    base);
+    snprintf(tLevelF, sizeof(tLevelF), "%s/level_filtered", base);
+    snprintf(tRate,   sizeof(tRate),   "%s/rate",        base);
+    snprintf(tEcho,   sizeof(tEcho),   "%s/echo_ratio",  base);
+
+    pubDisc((pre + "level").c_str(),    (name + " Уровень").c_str(),      tLevel,  "%",  "",         "mdi:waves");
+    pubDisc((pre + "volume").c_str(),   (name + " Объём").c_str(),        tVolume, "L",  "volume",   "mdi:barrel");
+    pubDisc((pre + "free").c_str(),     (name + " Свободно").c_str(),     tFree,   "L",  "volume",   "mdi:barrel-outline");
+    pubDisc((pre + "distance").c_str(), (name + " Расстояние").c_str(),   tDist,   "cm", "distance", "mdi:ruler");
+    pubDisc((pre + "level_f").c_str(),  (name + " Уровень (фильтр)").c_str(), tLevelF, "%", "",      "mdi:waves");
+    pubDisc((pre + "rate").c_str(),     (name + " Расход").c_str(),       tRate,   "L/h", "",        "mdi:chart-line");
+    pubDisc((pre + "echo").c_str(),     (name + " Качество эха").c_str(), tEcho,   "%",  "",         "mdi:signal");
+    yield();
+  }
+
+  // DS18B20 probes are per device, published with tank 0
+  char tTemp[80];
+  snprintf(tTemp, sizeof(tTemp), "%s/temperature", c.mqtt_topic);
   pubDisc("temp",     (devName + " Температура").c_str(),  tTemp,   "°C", "temperature", "mdi:thermometer");
+  if (tempProbePresent(TEMP_WATER)) {
+    snprintf(tTemp, sizeof(tTemp), "%s/water_temp", c.mqtt_topic);
+    pubDisc("temp_water", (devName + " Температура воды").c_str(), tTemp, "°C", "temperature", "mdi:coolant-temperature");
+  }
+  if (tempProbePresent(TEMP_CASE)) {
+    snprintf(tTemp, sizeof(tTemp), "%s/case_temp", c.mqtt_topic);
+    pubDisc("temp_case", (devName + " Температура корпуса").c_str(), tTemp, "°C", "temperature", "mdi:thermometer-lines");
+  }
 
   _mqttDiscoverySent = true;
   dbgPrintln(F("[MQTT] HA discovery published"));
 }
 
+// ── Replay of buffered readings ───────────────────────────────────────────────
+// Same fields as <base>/json with the original "ts" and "buffered":true;
+// not retained, so the retained state stays the latest live reading.
+static bool _mqttReplay(const Config &c, const MqttBufRecord &r) {
+  char base[64], topic[80], json[256];
+  _mqttTankBase(c, r.tank < c.tank_count ? r.tank : 0, base, sizeof(base));
+  int n = snprintf(json, sizeof(json),
+    "{\"level\":%.1f,\"dist\":%.1f,\"vol\":%.1f,\"free\":%.1f",
+    r.level, r.dist, r.volume, r.free_l);
+  const char *key[TEMP_PROBES] = { "temp", "water", "case" };
+  for (uint8_t i = 0; i < TEMP_PROBES; i++) {
+    if (r.temp_c100[i] == MQTT_BUF_NO_TEMP) continue;
+    n += snprintf(json + n, sizeof(json) - n, ",\"%s\":%.1f", key[i], r.temp_c100[i] / 100.0f);
+  }
+  if (r.pings)
+    n += snprintf(json + n, sizeof(json) - n, ",\"pings\":%u,\"echoes\":%u,\"sd\":%.2f",
+                  r.pings & 0x0F, r.pings >> 4, r.sd_mm / 10.0f);
+  snprintf(json + n, sizeof(json) - n, ",\"ts\":%lu,\"buffered\":true}", (unsigned long)r.ts);
+  snprintf(topic, sizeof(topic), "%s/json", base);
+  return _mqttClient.publish(topic, json, false);
+}
+
 // ── Loop ──────────────────────────────────────────────────────────────────────
+// Called once per second: the drain rate is mqtt_drain readings per call.
 inline void mqttLoop(const Config &c) {
   if (!_mqttEnabled) return;
   if (!_mqttConnect(c)) return;
   _mqttClient.loop();
+  if (mqttBufCount() && _mqttClient.connected()) {
+    mqttBufDrain(c.mqtt_drain, [&](const MqttBufRecord &r) { return _mqttReplay(c, r); });
+    if (!mqttBufCount()) dbgPrintf("[MQTT] buffer drained, %lu readings replayed\n",
+                                   (unsigned long)mqttBufStats().sent);
+  }
+}
+
+static bool _mqttDue(const Config &c, const MqttLast &l, float v, float band) {
+  if (!l.sent || !c.mqtt_hb || millis() - l.ms >= c.mqtt_hb * 1000UL) return true;
+  return fabsf(v - l.v) > band;
+}
+
+// Publish `v` on <base>/<sub> if due; true if it went out.
+static bool _mqttPubValue(const Config &c, uint8_t tank, uint8_t m, const char *base,
+                          const char *sub, const char *fmt, float v, float band) {
+  MqttLast &l = _mqttLast[tank][m];
+  if (!_mqttDue(c, l, v, band)) {
+    _mqttPubStats.suppressed++;
+    return false;
+  }
+  char topic[80], payload[32];
+  snprintf(topic, sizeof(topic), "%s/%s", base, sub);
+  snprintf(payload, sizeof(payload), fmt, v);
+  if (!_mqttClient.publish(topic, payload, true)) return false;
+  l = { v, millis(), true };
+  _mqttPubStats.sent++;
+  return true;
 }
 
 // ── Publish sensor data ───────────────────────────────────────────────────────
 inline void mqttPublish(const Config &c, const SensorData &s) {
   if (!_mqttEnabled || !s.valid) return;
-  if (!_mqttConnect(c)) return;
+  if (!_mqttConnect(c)) {
+    mqttBufPush(s);   // replayed by mqttLoop() after reconnect
+    return;
+  }
 
-  char topic[80], payload[32];
+  char base[64], topic[80];
+  uint8_t t = s.tank < TANK_MAX ? s.tank : 0;
+  _mqttTankBase(c, t, base, sizeof(base));
+  bool any = false;
 
-  snprintf(topic, sizeof(topic), "%s/level",    c.mqtt_topic);
-  snprintf(payload, sizeof(payload), "%.1f", s.level_pct);
-  _mqttClient.publish(topic, payload, true);
+  any |= _mqttPubValue(c, t, MQM_LEVEL, base, "level",    "%.1f", s.level_pct,   c.mqtt_db_level);
+  any |= _mqttPubValue(c, t, MQM_DIST,  base, "distance", "%.1f", s.distance_cm, c.mqtt_db_dist);
 
-  snprintf(topic, sizeof(topic), "%s/distance", c.mqtt_topic);
-  snprintf(payload, sizeof(payload), "%.1f", s.distance_cm);
-  _mqttClient.publish(topic, payload, true);
+  if (s.total_liters > 0) {
+    any |= _mqttPubValue(c, t, MQM_VOLUME, base, "volume", "%.1f", s.volume_liters, c.mqtt_db_vol);
+    any |= _mqttPubValue(c, t, MQM_FREE,   base, "free",   "%.1f", s.free_liters,   c.mqtt_db_vol);
+  }
 
-  if (c.barrel_diam_cm > 0) {
-    snprintf(topic, sizeof(topic), "%s/volume", c.mqtt_topic);
-    snprintf(payload, sizeof(payload), "%.1f", s.volume_liters);
-    _mqttClient.publish(topic, payload, true);
+  // Echo ratio moves in whole pings; any change is published
+  any |= _mqttPubValue(c, t, MQM_ECHO, base, "echo_ratio", "%.0f",
+                       measValidRatio(s.quality.valid, s.quality.attempted) * 100.0f, 0.0f);
 
-    snprintf(topic, sizeof(topic), "%s/free", c.mqtt_topic);
-    snprintf(payload, sizeof(payload), "%.1f", s.free_liters);
-    _mqttClient.publish(topic, payload, true);
+  if (t == 0) {
+    const char *sub[TEMP_PROBES] = { "temperature", "water_temp", "case_temp" };
+    float       val[TEMP_PROBES] = { s.temp_c, s.water_c, s.case_c };
+    for (uint8_t r = 0; r < TEMP_PROBES; r++) {
+      if (isnan(val[r])) continue;
+      any |= _mqttPubValue(c, t, MQM_TEMP + r, base, sub[r], "%.1f", val[r], c.mqtt_db_temp);
+    }
   }
 
-  if (!isnan(s.temp_c)) {
-    snprintf(topic, sizeof(topic), "%s/temperature", c.mqtt_topic);
-    snprintf(payload, sizeof(payload), "%.1f", s.temp_c);
-    _mqttClient.publish(topic, payload, true);
+  if (!isnan(s.kf_level_pct))
+    any |= _mqttPubValue(c, t, MQM_LEVEL_F, base, "level_filtered", "%.2f", s.kf_level_pct, c.mqtt_db_level);
+
+  if (!isnan(s.kf_rate_lph))
+    any |= _mqttPubValue(c, t, MQM_RATE, base, "rate", "%.2f", s.kf_rate_lph, c.mqtt_db_rate);
+
+  MqttLast &lj = _mqttLast[t][MQM_JSON];
+  if (!any && !_mqttDue(c, lj, 0, 0)) {
+    _mqttPubStats.suppressed++;
+    return;
   }
 
   // Full JSON message
-  char json[256];
-  if (!isnan(s.temp_c)) {
-    snprintf(json, sizeof(json),
-      "{\"level\":%.1f,\"dist\":%.1f,\"vol\":%.1f,\"free\":%.1f,\"temp\":%.1f,\"ts\":%lu}",
-      s.level_pct, s.distance_cm, s.volume_liters, s.free_liters, s.temp_c, (unsigned long)s.timestamp);
-  } else {
-    snprintf(json, sizeof(json),
-      "{\"level\":%.1f,\"dist\":%.1f,\"vol\":%.1f,\"free\":%.1f,\"ts\":%lu}",
-      s.level_pct, s.distance_cm, s.volume_liters, s.free_liters, (unsigned long)s.timestamp);
+  char json[384];
+  int n = snprintf(json, sizeof(json),
+    "{\"level\":%.1f,\"dist\":%.1f,\"vol\":%.1f,\"free\":%.1f",
+    s.level_pct, s.distance_cm, s.volume_liters, s.free_liters);
+  if (!isnan(s.temp_c))
+    n += snprintf(json + n, sizeof(json) - n, ",\"temp\":%.1f", s.temp_c);
+  if (!isnan(s.water_c))
+    n += snprintf(json + n, sizeof(json) - n, ",\"water\":%.1f", s.water_c);
+  if (!isnan(s.case_c))
+    n += snprintf(json + n, sizeof(json) - n, ",\"case\":%.1f", s.case_c);
+  if (!isnan(s.kf_level_pct))
+    n += snprintf(json + n, sizeof(json) - n, ",\"lvf\":%.2f,\"lvf_var\":%.4f",
+                  s.kf_level_pct, s.kf_level_var);
+  if (!isnan(s.kf_rate_lph))
+    n += snprintf(json + n, sizeof(json) - n, ",\"rate\":%.2f,\"rate_var\":%.3f",
+                  s.kf_rate_lph, s.kf_rate_var);
+  const MeasQuality &q = s.quality;
+  n += snprintf(json + n, sizeof(json) - n,
+                ",\"pings\":%u,\"echoes\":%u,\"tmo\":%u,\"min\":%.1f,\"max\":%.1f,\"sd\":%.2f",
+                q.attempted, q.valid, q.timeouts, q.min_cm, q.max_cm, q.sd_cm);
+  snprintf(json + n, sizeof(json) - n, ",\"ts\":%lu}", (unsigned long)s.timestamp);
+  snprintf(topic, sizeof(topic), "%s/json", base);
+  if (!_mqttClient.publish(topic, json, true)) {
+    mqttBufPush(s);
+    return;
   }
-  snprintf(topic, sizeof(topic), "%s/json", c.mqtt_topic);
-  _mqttClient.publish(topic, json, true);
+  lj = { 0, millis(), true };
+  _mqttPubStats.sent++;
 }
 
 inline bool mqttConnected() {
@@ -0,0 +1,125 @@
+#pragma once
+#include <Arduino.h>
+#include "debug_log.h"
+
+// ------------------------------------------------------------------
+// Latency profiler: fixed table of probes, one per loop() call site,
+// scheduler task and HTTP route. A probe is two micros() reads and a
+// bucket increment (~2 µs). Durations go into log2 buckets: bucket b
+// holds [2^b, 2^(b+1)) µs, the last one everything from ~0.5 s up.
+// Bucket counters are 16-bit; when one would overflow, all buckets of the
+// probe are halved (the histogram then leans towards recent calls), while
+// `count` and `max_us` keep the exact totals. Served at /api/profile and
+// dumped by the `prof` serial command.
+// ------------------------------------------------------------------
+#define PROF_MAX      56     // 10 loop sites + tasks + routes + upload handlers; ~52 B each
+#define PROF_BUCKETS  20
+
+// Fixed probes for the call sites in loop(); tasks and routes register
+// theirs at startup with profRegister().
+enum ProfSite : int8_t {
+  PROF_LOOP, PROF_SERIAL, PROF_HTTP, PROF_SSE, PROF_MDNS, PROF_MEAS, PROF_OTA, PROF_TG,
+  PROF_SCHED, PROF_TREND, PROF_FIXED
+};
+
+// Probe groups, reported as "group"
+enum ProfGroup : uint8_t {
+  PROF_G_LOOP, PROF_G_TASK, PROF_G_GET, PROF_G_POST, PROF_G_DELETE, PROF_G_UPLOAD, PROF_G_OTHER
+};
+
+struct ProfProbe {
+  const char *name;
+  uint8_t     group;
+  uint16_t    hist[PROF_BUCKETS];
+  uint32_t    count;
+  uint32_t    maxUs;
+};
+
+static ProfProbe _prof[PROF_MAX] = {
+  { "loop" }, { "serial" }, { "http" }, { "sse" }, { "mdns" }, { "measure_poll" }, { "ota" },
+  { "telegram_io" }, { "scheduler" }, { "trend" },
+};
+static uint8_t _profCount = PROF_FIXED;
+
+static const char *const _profGroupName[] = { "loop", "task", "GET", "POST", "DELETE", "upload", "other" };
+inline const char *profGroupName(uint8_t g) { return _profGroupName[g <= PROF_G_OTHER ? g : PROF_G_OTHER]; }
+
+inline uint8_t profCount() { return _profCount; }
+inline const ProfProbe &profProbe(uint8_t id) { return _prof[id < _profCount ? id : 0]; }
+
+// Returns the probe id, or -1 when the table is full (profRecord ignores -1).
+inline int8_t profRegister(const char *name, uint8_t group) {
+  if (_profCount >= PROF_MAX) {
+    dbgPrintf("[PROF] table full, %s not profiled\n", name);
+    return -1;
+  }
+  ProfProbe &p = _prof[_profCount];
+  memset(&p, 0, sizeof(p));
+  p.name  = name;
+  p.group = group;
+  return (int8_t)_profCount++;
+}
+
+inline void profRecord(int8_t id, uint32_t us) {
+  if (id < 0 || id >= _profCount) return;
+  ProfProbe &p = _prof[id];
+  uint8_t b = us ? 31 - __builtin_clz(us) : 0;
+  if (b >= PROF_BUCKETS) b = PROF_BUCKETS - 1;
+  if (p.hist[b] == 0xFFFF) {
+    for (uint8_t i = 0; i < PROF_BUCKETS; i++) p.hist[i] >>= 1;
+  }
+  p.hist[b]++;
+  p.count++;
+  if (us > p.maxUs) p.maxUs = us;
+}
+
+// Times the enclosing scope into probe `id`.
+struct ProfScope {
+  int8_t   id;
+  uint32_t t0;
+  explicit ProfScope(int8_t i) : id(i), t0(micros()) {}
+  ~ProfScope() { profRecord(id, micros() - t0); }
+};
+#define PROF_CAT2(a, b) a##b
+#define PROF_CAT(a, b)  PROF_CAT2(a, b)
+#define PROF_SCOPE(id)  ProfScope PROF_CAT(_profScope, __LINE__)(id)
+
+// Percentile estimate in µs (q in 0..1): linear within the log2 bucket
+// that holds the q-th sample; capped at max_us. 0 without samples.
+inline uint32_t profPercentile(const ProfProbe &p, float q) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < PROF_BUCKETS; i++) total += p.hist[i];
+  if (!total) return 0;
+  float want = q * total, cum = 0;
+  for (uint8_t i = 0; i < PROF_BUCKETS; i++) {
+    if (!p.hist[i]) continue;
+    if (cum + p.hist[i] >= want) {
+      float lo = i ? (float)(1UL << i) : 0.0f, hi = (float)(2UL << i);
+      uint32_t v = (uint32_t)(lo + (hi - lo) * (want - cum) / p.hist[i]);
+      return v < p.maxUs ? v : p.maxUs;
+    }
+    cum += p.hist[i];
+  }
+  return p.maxUs;
+}
+
+inline void profReset() {
+  for (uint8_t i = 0; i < _profCount; i++) {
+    memset(_prof[i].hist, 0, sizeof(_prof[i].hist));
+    _prof[i].count = _prof[i].maxUs = 0;
+  }
+}
+
+// Serial dump of all probes that saw a call, then reset.
+inline void profDump() {
+  dbgPrintln(F("[PROF] group  name                       count     p50 us     p99 us     max us"));
+  for (uint8_t i = 0; i < _profCount; i++) {
+    const ProfProbe &p = _prof[i];
+    if (!p.count) continue;
+    dbgPrintf("[PROF] %-6s %-24s %7lu %10lu %10lu %10lu\n", profGroupName(p.group), p.name,
+              (unsigned long)p.count, (unsigned long)profPercentile(p, 0.5f),
+              (unsigned long)profPercentile(p, 0.99f), (unsigned long)p.maxUs);
+    yield();
+  }
+  profReset();
+}
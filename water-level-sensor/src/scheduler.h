@@ -0,0 +1,131 @@
+#pragma once
+#include <Arduino.h>
+#include "debug_log.h"
+#include "profiler.h"
+
+// ------------------------------------------------------------------
+// Cooperative scheduler for the timed work in loop(): a fixed table of
+// periodic and one-shot tasks. schedRun() runs at most one due task per
+// loop() pass, the lowest `prio` first (earliest deadline among equals),
+// so the web server is serviced between any two tasks however long they
+// take. Each task records how late it started and how long it ran; a run
+// longer than its budget is counted as an overrun. Stats are served at
+// /api/tasks; run times also go into the task's profiler histogram.
+// A periodic task keeps its grid (next = due + period) unless it fell a
+// whole period behind, then it restarts from now instead of catching up.
+// ------------------------------------------------------------------
+#define SCHED_MAX_TASKS 12
+
+typedef void (*SchedFn)();
+
+struct SchedTask {
+  const char   *name;
+  SchedFn       fn;
+  uint32_t      periodMs;    // 0 = one-shot
+  uint32_t      budgetUs;    // expected worst-case run time
+  uint8_t       prio;        // 0 runs first
+  bool          armed;       // due is valid
+  unsigned long due;         // millis()
+  int8_t        prof;        // profiler probe
+
+  uint32_t      runs;
+  uint32_t      overruns;    // runs longer than budgetUs
+  uint32_t      lastUs;      // duration of the last run
+  uint32_t      maxUs;
+  uint64_t      sumUs;
+  uint32_t      lateMaxMs;   // start delay past `due`
+  uint32_t      lateSumMs;
+};
+
+static SchedTask _sched[SCHED_MAX_TASKS];
+static uint8_t   _schedCount = 0;
+
+inline uint8_t schedCount() { return _schedCount; }
+inline const SchedTask &schedTask(uint8_t id) { return _sched[id < _schedCount ? id : 0]; }
+
+// Register a task; the first run is `firstMs` from now (one-shots with
+// firstMs < 0 stay idle until schedDelay()). Returns the task id, or -1
+// when the table is full.
+inline int8_t schedAdd(const char *name, SchedFn fn, uint32_t periodMs, uint8_t prio,
+                       uint32_t budgetUs, long firstMs = 0) {
+  if (_schedCount >= SCHED_MAX_TASKS) {
+    dbgPrintf("[SCHED] table full, %s not added\n", name);
+    return -1;
+  }
+  SchedTask &t = _sched[_schedCount];
+  memset(&t, 0, sizeof(t));
+  t.name     = name;
+  t.fn       = fn;
+  t.periodMs = periodMs;
+  t.prio     = prio;
+  t.budgetUs = budgetUs;
+  t.armed    = firstMs >= 0;
+  t.due      = millis() + (firstMs > 0 ? firstMs : 0);
+  t.prof     = profRegister(name, PROF_G_TASK);
+  return (int8_t)_schedCount++;
+}
+
+// Next run `ms` from now; also arms an idle one-shot.
+inline void schedDelay(int8_t id, uint32_t ms) {
+  if (id < 0 || id >= _schedCount) return;
+  _sched[id].due   = millis() + ms;
+  _sched[id].armed = true;
+}
+
+// Change the period, keeping the time of the last run: the next run is
+// the last start + new period.
+inline void schedSetPeriod(int8_t id, uint32_t ms) {
+  if (id < 0 || id >= _schedCount) return;
+  SchedTask &t = _sched[id];
+  if (t.periodMs == ms) return;
+  if (t.armed) t.due = t.due - t.periodMs + ms;
+  t.periodMs = ms;
+}
+
+inline void schedResetStats() {
+  for (uint8_t i = 0; i < _schedCount; i++) {
+    SchedTask &t = _sched[i];
+    t.runs = t.overruns = t.lastUs = t.maxUs = t.lateMaxMs = t.lateSumMs = 0;
+    t.sumUs = 0;
+  }
+}
+
+// Run the most urgent due task, if any. Returns true if one ran.
+inline bool schedRun() {
+  unsigned long now = millis();
+  int8_t pick = -1;
+  for (uint8_t i = 0; i < _schedCount; i++) {
+    const SchedTask &t = _sched[i];
+    if (!t.armed || (long)(now - t.due) < 0) continue;
+    if (pick < 0 || t.prio < _sched[pick].prio ||
+        (t.prio == _sched[pick].prio && (long)(t.due - _sched[pick].due) < 0)) pick = i;
+  }
+  if (pick < 0) return false;
+
+  SchedTask &t = _sched[pick];
+  uint32_t late = now - t.due;
+  if (t.periodMs) {
+    t.due += t.periodMs;
+    if ((long)(now - t.due) >= 0) t.due = now + t.periodMs;
+  } else {
+    t.armed = false;
+  }
+
+  uint32_t t0 = micros();
+  t.fn();
+  uint32_t us = micros() - t0;
+
+  profRecord(t.prof, us);
+  t.runs++;
+  t.lastUs     = us;
+  t.sumUs     += us;
+  t.lateSumMs += late;
+  if (late > t.lateMaxMs) t.lateMaxMs = late;
+  if (us > t.budgetUs) {
+    t.overruns++;
+    if (us > t.maxUs) dbgPrintf("[SCHED] %s ran %lu us (budget %lu)\n", t.name,
+                                (unsigned long)us, (unsigned long)t.budgetUs);
+  }
+  if (us > t.maxUs) t.maxUs = us;
+  return true;
+}
@@ -1,8 +1,38 @@
 #pragma once
 #include <Arduino.h>
-#include <OneWire.h>
-#include <DallasTemperature.h>
 #include "config.h"
+#include "geometry.h"
+#include "temperature.h"
+
+#define MEAS_MAX_SAMPLES  10   // pings per burst (Config::avg_samples upper bound)
+
+// Per-reading quality: how many pings came back and how well they agree.
+// A reading is "poor" when fewer than QUAL_MIN_RATIO of the pings gave a
+// usable echo or the echoes spread wider than QUAL_MAX_SD_CM; poor readings
+// are still published, but weigh less in the level filter and are not used
+// as anchors for consumption trends or alerts.
+#define QUAL_MIN_RATIO  0.5f   // valid / attempted
+#define QUAL_MAX_SD_CM  2.0f   // standard deviation of the valid echoes, cm
+
+struct MeasQuality {
+  uint8_t  attempted;      // pings sent
+  uint8_t  valid;          // echoes within 0..500 cm
+  uint8_t  timeouts;       // pings without a complete echo
+  float    min_cm;         // shortest valid echo, cm (-1 without echoes)
+  float    max_cm;         // longest valid echo, cm (-1 without echoes)
+  float    sd_cm;          // standard deviation of the valid echoes, cm
+  float    echo_us;        // filtered echo round trip, µs (0 without echoes)
+};
+
+// Share of pings that returned a valid echo; 1 when unknown (attempted 0)
+inline float measValidRatio(uint8_t valid, uint8_t attempted) {
+  return attempted ? (float)valid / attempted : 1.0f;
+}
+
+inline bool measQualityPoor(uint8_t valid, uint8_t attempted, float sd_cm) {
+  return measValidRatio(valid, attempted) < QUAL_MIN_RATIO || sd_cm > QUAL_MAX_SD_CM;
+}
+inline bool measQualityPoor(const MeasQuality &q) { return measQualityPoor(q.valid, q.attempted, q.sd_cm); }
 
 struct SensorData {
   float    distance_cm;    // raw measured distance, cm
@@ -10,54 +40,49 @@ struct SensorData {
   float    volume_liters;  // current volume, L  (0 if diameter unknown)
   float    free_liters;    // free space volume, L
   float    total_liters;   // total barrel volume, L
-  float    temp_c;         // DS18B20 temperature, °C  (NAN if unavailable)
+  float    temp_c;         // DS18B20 air probe, °C  (NAN if unavailable)
+  float    water_c;        // DS18B20 water probe, °C  (NAN if unavailable)
+  float    case_c;         // DS18B20 enclosure probe, °C  (NAN if unavailable)
+  float    sound_cm_us;    // conversion factor used for distance_cm
   uint32_t timestamp;      // Unix time of last reading
   bool     valid;          // measurement OK
-};
+  uint8_t  tank;           // channel index into Config::tanks
 
-// DS18B20 driver state (allocated on first initTempSensor call)
-static OneWire*           _ds18_ow = nullptr;
-static DallasTemperature* _ds18_dt = nullptr;
+  // Burst statistics (see _burstFilter); distance_cm is chosen by filter_mode
+  float    dist_median_cm;  // median of the burst, cm (-1 without echoes)
+  float    dist_trim_cm;    // mean of echoes within k·MAD of the median, cm
+  float    dist_mad_cm;     // median absolute deviation, cm
+  uint8_t  dist_outliers;   // echoes rejected by the MAD test
+  uint8_t  burst_n;         // valid echoes in burst[]
+  float    burst[MEAS_MAX_SAMPLES];  // raw distances in ping order, cm
+  MeasQuality quality;      // ping/echo counts and spread of this reading
 
-// ------------------------------------------------------------------
-// Single HC-SR04 pulse measurement, returns distance in cm or -1 on timeout
-// ------------------------------------------------------------------
-static float _hcsr04_once(uint8_t trig, uint8_t echo) {
-  digitalWrite(trig, LOW);
-  delayMicroseconds(2);
-  digitalWrite(trig, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(trig, LOW);
+  // Level estimator (see levelFilterUpdate); NAN until the first valid reading
+  float    kf_level_pct;    // filtered level, %
+  float    kf_level_var;    // its variance, %²
+  float    kf_rate_lph;     // rate of change, L/h (+ fill, − draw; NAN if volume unknown)
+  float    kf_rate_var;     // its variance, (L/h)²
+};
 
-  unsigned long dur = pulseIn(echo, HIGH, 30000UL); // 30 ms timeout ≈ 5 m
-  if (dur == 0) return -1.0f;
-  return dur * 0.01715f;  // cm = µs × (34300 cm/s / 2 / 1e6)
-}
+// Data generation: bumped whenever the current reading or stored history
+// changes. Web handlers derive ETags from it.
+static uint32_t _dataGen = 0;
+inline uint32_t dataGeneration()    { return _dataGen; }
+inline void     dataGenerationBump() { _dataGen++; }
 
-// ------------------------------------------------------------------
-// Averaged measurement
-// ------------------------------------------------------------------
-inline float measureDistance(const Config &c) {
-  float sum = 0;
-  int   ok  = 0;
-  for (int i = 0; i < c.avg_samples; i++) {
-    float d = _hcsr04_once(c.trig_pin, c.echo_pin);
-    if (d > 0 && d < 500) { sum += d; ok++; }
-    delay(50);
-    yield();
-  }
-  return ok ? sum / ok : -1.0f;
-}
+// Latest reading per channel; tankData(0) is the primary tank
+static SensorData _tanks[TANK_MAX] = {};
+inline SensorData &tankData(uint8_t i) { return _tanks[i < TANK_MAX ? i : 0]; }
 
 // ------------------------------------------------------------------
 // Compute level% and volumes from raw distance
 // ------------------------------------------------------------------
-inline void computeLevel(const Config &c, float dist_cm, SensorData &s) {
+inline void computeLevel(const TankCal &t, float dist_cm, SensorData &s) {
   s.distance_cm = dist_cm;
   s.valid       = (dist_cm > 0);
 
   // level%: 0 when empty (dist == empty_dist), 100 when full (dist == full_dist)
-  float range = c.empty_dist_cm - c.full_dist_cm;
+  float range = t.empty_dist_cm - t.full_dist_cm;
   if (!s.valid || range <= 0) {
     s.level_pct     = 0;
     s.volume_liters = 0;
@@ -65,14 +90,13 @@ inline void computeLevel(const Config &c, float dist_cm, SensorData &s) {
     s.total_liters  = 0;
     return;
   }
-  float pct = (c.empty_dist_cm - dist_cm) / range * 100.0f;
+  float pct = (t.empty_dist_cm - dist_cm) / range * 100.0f;
   s.level_pct = constrain(pct, 0.0f, 100.0f);
 
-  if (c.barrel_diam_cm > 0) {
-    float r  = c.barrel_diam_cm / 2.0f;
-    float h  = c.empty_dist_cm - c.full_dist_cm;          // barrel height, cm
-    s.total_liters  = PI * r * r * h / 1000.0f;            // cm³ → L
-    s.volume_liters = s.total_liters * s.level_pct / 100.0f;
+  // Volume follows the tank shape; level% stays linear in height
+  s.total_liters = tankVolumeAt(t, s.tank, range);
+  if (s.total_liters > 0) {
+    s.volume_liters = tankVolumeAt(t, s.tank, range * s.level_pct / 100.0f);
     s.free_liters   = s.total_liters - s.volume_liters;
   } else {
     s.total_liters = s.volume_liters = s.free_liters = 0;
@@ -80,49 +104,427 @@ inline void computeLevel(const Config &c, float dist_cm, SensorData &s) {
 }
 
 // ------------------------------------------------------------------
-// DS18B20 initialisation (call once after config is loaded)
+// HC-SR04 echo capture
+// The echo pin interrupts on both edges and the ISR timestamps them, so
+// nothing waits on the pin. _echoEdges: 0 armed, 1 echo high, 2 pulse
+// complete, 3 disarmed (edges ignored).
 // ------------------------------------------------------------------
-inline void initTempSensor(const Config &c) {
-  if (!c.ds18_en) return;
-  _ds18_ow = new OneWire(c.ds18_pin);
-  _ds18_dt = new DallasTemperature(_ds18_ow);
-  _ds18_dt->begin();
-  _ds18_dt->setResolution(10);           // 10-bit ≈ 187 ms conversion
-  _ds18_dt->setWaitForConversion(false); // async — we poll below
-  dbgPrintf("[DS18B20] init on GPIO%u  devices: %u\n",
-                c.ds18_pin, _ds18_dt->getDeviceCount());
+static uint8_t           _echoPin   = 255;
+static volatile uint32_t _echoRise  = 0;
+static volatile uint32_t _echoFall  = 0;
+static volatile uint8_t  _echoEdges = 3;
+
+static void IRAM_ATTR _echoIsr() {
+  uint32_t t = micros();
+  if (_echoEdges >= 2) return;
+  if (digitalRead(_echoPin)) { _echoRise = t; _echoEdges = 1; }
+  else if (_echoEdges == 1)  { _echoFall = t; _echoEdges = 2; }
+}
+
+static void _echoAttach(uint8_t pin) {
+  if (_echoPin != 255) detachInterrupt(digitalPinToInterrupt(_echoPin));
+  _echoPin = pin;
+  attachInterrupt(digitalPinToInterrupt(pin), _echoIsr, CHANGE);
+}
+
+// Trigger one ping; the ISR fills in the echo edges.
+static uint32_t _hcsr04Ping(uint8_t trig) {
+  _echoEdges = 0;
+  digitalWrite(trig, LOW);
+  delayMicroseconds(2);
+  digitalWrite(trig, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(trig, LOW);
+  return micros();
+}
+
+// ------------------------------------------------------------------
+// Speed of sound in air: 331.3·√(1 + T/273.15) m/s, i.e. ≈ 0.01715 cm/µs
+// (round trip halved) at 20 °C and ±3 % over −10..40 °C. When the DS18B20
+// has no reading the last good temperature is used, then 20 °C.
+// ------------------------------------------------------------------
+#define SOUND_FALLBACK_C 20.0f
+
+static float _soundLastTempC = NAN;
+
+inline float soundCmPerUs(float temp_c) {
+  if (!isnan(temp_c) && temp_c > -40.0f && temp_c < 60.0f) _soundLastTempC = temp_c;  // 85 = DS18B20 reset value
+  float t = isnan(_soundLastTempC) ? SOUND_FALLBACK_C : _soundLastTempC;
+  return 331.3f * sqrtf(1.0f + t / 273.15f) * 0.5e-4f;  // m/s → cm/µs, halved
 }
 
 // ------------------------------------------------------------------
-// Full measurement cycle
+// Measurement state machine
+// measureStart() triggers the first ping, measurePoll() is called from
+// loop() and advances the burst; each call only checks timestamps, so
+// loop() keeps serving HTTP/MQTT/OTA while a burst runs. The DS18B20s
+// convert during the burst and are only read after the last ping, one
+// probe per pass: OneWire bit-banging masks interrupts and would skew
+// echo timestamps.
+// With several tanks the pings go round-robin (tank1, tank2, …, tank1, …)
+// with the full gap in between, so only one transducer is ever in flight
+// and a neighbour's late echo cannot be taken for our own.
 // ------------------------------------------------------------------
-inline void doMeasure(const Config &c, SensorData &s) {
-  // Kick off DS18B20 conversion before HC-SR04 (runs concurrently)
-  if (_ds18_dt) _ds18_dt->requestTemperatures();
+#define MEAS_ECHO_TMO_US  32000UL  // ≈ 5 m round trip + trigger latency
+#define MEAS_PING_GAP_MS  50UL     // let stray echoes of the last ping die out
+
+enum MeasState : uint8_t { MEAS_IDLE, MEAS_ECHO, MEAS_GAP, MEAS_TEMP };
+
+struct MeasBurst {
+  MeasState     state;
+  uint8_t       tanks;                      // channels in this cycle
+  uint8_t       ch;                         // channel of the ping in flight
+  uint8_t       want;                       // pings per channel
+  uint8_t       done;                       // pings finished, all channels
+  uint8_t       ok[TANK_MAX];               // echoes in echo_us[ch]
+  uint8_t       tmo[TANK_MAX];              // pings without a complete echo
+  float         echo_us[TANK_MAX][MEAS_MAX_SAMPLES];  // echo pulse widths, µs
+  uint32_t      tPing;                      // micros() at last trigger
+  unsigned long tGap;                       // millis() when last ping finished
+};
+static MeasBurst _meas = {};
 
-  float dist = measureDistance(c);   // ~50–250 ms depending on avg_samples
-  computeLevel(c, dist, s);
+inline bool measureBusy() { return _meas.state != MEAS_IDLE; }
 
-  // Wait for DS18B20 conversion to finish (max 200 ms at 10-bit)
-  if (_ds18_dt) {
-    unsigned long tw = millis();
-    while (!_ds18_dt->isConversionComplete() && millis() - tw < 250UL) {
-      delay(5); yield();
+static void _measPing(const Config &c) {
+  const TankCal &t = c.tanks[_meas.ch];
+  if (t.echo_pin != _echoPin) _echoAttach(t.echo_pin);
+  _meas.tPing = _hcsr04Ping(t.trig_pin);
+  _meas.state = MEAS_ECHO;
+}
+
+// Begin a burst on every channel. Returns false if one is already running.
+inline bool measureStart(const Config &c) {
+  if (measureBusy()) return false;
+  tempRequest();
+  _meas.tanks  = constrain(c.tank_count, 1, TANK_MAX);
+  _meas.want   = constrain(c.avg_samples, 1, MEAS_MAX_SAMPLES);
+  _meas.ch     = 0;
+  _meas.done   = 0;
+  memset(_meas.ok, 0, sizeof(_meas.ok));
+  memset(_meas.tmo, 0, sizeof(_meas.tmo));
+  _measPing(c);
+  return true;
+}
+
+// ------------------------------------------------------------------
+// Burst filter: median, MAD and the mean of inliers, computed on stack
+// copies with an insertion sort (n ≤ MEAS_MAX_SAMPLES, no heap). A single
+// multipath echo off the barrel wall moves the median by at most one rank
+// and is excluded from the trimmed mean.
+// ------------------------------------------------------------------
+#define MEAS_MAD_FLOOR_CM 0.3f  // echo jitter; a tight burst must not flag everything
+
+static void _sortSmall(float *v, uint8_t n) {
+  for (uint8_t i = 1; i < n; i++) {
+    float x = v[i];
+    uint8_t j = i;
+    while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+    v[j] = x;
+  }
+}
+
+static float _medianSorted(const float *v, uint8_t n) {
+  return (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) * 0.5f;
+}
+
+// Filters the echo times `us` themselves; `k` (cm/µs) only scales the
+// statistics into cm. Fills the burst fields and the spread part of
+// s.quality and returns the echo time for filter_mode (-1 when no ping
+// produced an echo).
+static float _burstFilter(const Config &c, const float *us, uint8_t n, float k, SensorData &s) {
+  s.burst_n       = n;
+  s.dist_outliers = 0;
+  s.quality.valid = n;
+  for (uint8_t i = 0; i < n; i++) s.burst[i] = us[i] * k;
+  if (!n) {
+    s.dist_median_cm = s.dist_trim_cm = -1.0f;
+    s.dist_mad_cm    = 0;
+    s.quality.min_cm = s.quality.max_cm = -1.0f;
+    s.quality.sd_cm  = 0;
+    return -1.0f;
+  }
+
+  float v[MEAS_MAX_SAMPLES], dev[MEAS_MAX_SAMPLES];
+  memcpy(v, us, n * sizeof(float));
+  _sortSmall(v, n);
+  float med = _medianSorted(v, n);
+
+  float sum = 0;
+  for (uint8_t i = 0; i < n; i++) { sum += v[i]; dev[i] = fabsf(v[i] - med); }
+  _sortSmall(dev, n);
+  float mad = _medianSorted(dev, n);
+
+  // 1.4826·MAD estimates sigma for normal noise; with filter_mad_k ≥ 1 at least half
+  // of the burst always passes, so the trimmed mean is defined.
+  float floorUs = MEAS_MAD_FLOOR_CM / k;
+  float lim  = c.filter_mad_k * 1.4826f * (mad > floorUs ? mad : floorUs);
+  float tsum = 0;
+  uint8_t tn = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (fabsf(v[i] - med) <= lim) { tsum += v[i]; tn++; }
+  }
+
+  float trim = tsum / tn;
+  s.dist_median_cm = med * k;
+  s.dist_mad_cm    = mad * k;
+  s.dist_trim_cm   = trim * k;
+  s.dist_outliers  = n - tn;
+
+  float mean = sum / n, ss = 0;
+  for (uint8_t i = 0; i < n; i++) ss += (v[i] - mean) * (v[i] - mean);
+  s.quality.min_cm = v[0] * k;
+  s.quality.max_cm = v[n - 1] * k;
+  s.quality.sd_cm  = n > 1 ? sqrtf(ss / (n - 1)) * k : 0;
+
+  switch (c.filter_mode) {
+    case FILTER_MEAN:   return mean;
+    case FILTER_MEDIAN: return med;
+    default:            return trim;
+  }
+}
+
+// Echo times are converted only here, once the temperature is known. The
+// air probe serves all tanks, they share the air temperature.
+static void _measFinish(const Config &c) {
+  float temp = tempC(TEMP_AIR);
+  float k = soundCmPerUs(temp);
+  uint32_t now = time(nullptr);
+
+  for (uint8_t ch = 0; ch < _meas.tanks; ch++) {
+    SensorData &s = _tanks[ch];
+    s.tank   = ch;
+    s.temp_c  = temp;
+    s.water_c = tempC(TEMP_WATER);
+    s.case_c  = tempC(TEMP_CASE);
+
+    float us[MEAS_MAX_SAMPLES];
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < _meas.ok[ch]; i++) {
+      float d = _meas.echo_us[ch][i] * k;
+      if (d > 0 && d < 500) us[n++] = _meas.echo_us[ch][i];
     }
-    float t = _ds18_dt->getTempCByIndex(0);
-    s.temp_c = (t == DEVICE_DISCONNECTED_C) ? NAN : t;
-  } else {
-    s.temp_c = NAN;
+    s.quality.attempted = _meas.want;
+    s.quality.timeouts  = _meas.tmo[ch];
+    float e = _burstFilter(c, us, n, k, s);
+    s.sound_cm_us     = k;
+    s.quality.echo_us = e > 0 ? e : 0;
+    computeLevel(c.tanks[ch], e > 0 ? e * k : -1.0f, s);
+    s.timestamp = now;
+  }
+  dataGenerationBump();
+}
+
+// Advance the running burst. Returns true exactly once, when tankData()
+// has been filled with the completed readings of all channels.
+inline bool measurePoll(const Config &c) {
+  switch (_meas.state) {
+    case MEAS_IDLE:
+      return false;
+
+    case MEAS_ECHO: {
+      if (_echoEdges != 2 && micros() - _meas.tPing < MEAS_ECHO_TMO_US) return false;
+      uint8_t ch = _meas.ch;
+      if (_echoEdges == 2) {
+        uint32_t us = _echoFall - _echoRise;
+        if (us > 0) _meas.echo_us[ch][_meas.ok[ch]++] = us;
+      } else {
+        _meas.tmo[ch]++;
+      }
+      _echoEdges = 3;
+      _meas.done++;
+      _meas.ch    = (ch + 1) % _meas.tanks;
+      _meas.tGap  = millis();
+      _meas.state = (_meas.done < _meas.want * _meas.tanks) ? MEAS_GAP : MEAS_TEMP;
+      return false;
+    }
+
+    case MEAS_GAP:
+      if (millis() - _meas.tGap < MEAS_PING_GAP_MS) return false;
+      _measPing(c);
+      return false;
+
+    case MEAS_TEMP:
+      if (!tempReady() || !tempCollect()) return false;
+      _measFinish(c);
+      _meas.state = MEAS_IDLE;
+      return true;
+  }
+  return false;
+}
+
+// ------------------------------------------------------------------
+// Full measurement cycle, blocking (boot, serial/Telegram commands).
+// Joins a burst already started by loop() instead of starting a second one.
+// ------------------------------------------------------------------
+inline void doMeasure(const Config &c) {
+  measureStart(c);
+  while (!measurePoll(c)) delay(1);
+}
+
+// ------------------------------------------------------------------
+// Level estimator: constant-velocity Kalman filter over level (%) and its
+// rate (%/h), updated once per completed measurement. Measurement noise
+// comes from the burst itself (robust sigma of the echoes / √inliers) plus
+// a per-reading floor for what averaging cannot remove (ripples, air
+// currents), so a noisy burst moves the estimate less than a tight one;
+// it is further divided by the share of pings that returned an echo, so a
+// reading built from 2 of 10 pings counts a fifth of a full one.
+// A reading more
+// than KF_GATE sigmas off the prediction (refill, bucket drawn) restarts
+// the filter at that reading instead of being smoothed away; KF_RUN misses
+// beyond 1 sigma on the same side (slow fill, tap opened) re-open the rate
+// variance so the estimate follows the new trend within a few readings.
+// Each tank has its own filter, selected by SensorData::tank.
+// ------------------------------------------------------------------
+#define KF_ACCEL_Q   4.0f    // process noise: rate may drift ~2 %/h per √hour
+#define KF_MEAS_SD   0.4f    // per-reading noise floor, cm
+#define KF_RATE_P0   400.0f  // initial rate variance, (%/h)²
+#define KF_GATE      4.0f    // innovation gate, sigmas
+#define KF_MAX_DT_H  6.0f    // longer gaps restart the filter
+#define KF_RUN       3       // same-side 1-sigma misses that signal a new trend
+
+struct LevelKalman {
+  bool          init;
+  float         lv, rate;        // %, %/h
+  float         p00, p01, p11;   // covariance
+  int8_t        run;             // consecutive 1-sigma misses (+ above, − below)
+  bool          jumped;          // last update restarted on a gated jump
+  unsigned long tMs;             // millis() of last update
+};
+static LevelKalman _kfTank[TANK_MAX] = {};
+
+static void _kfReset(LevelKalman &kf, float lv, float r) {
+  kf.init = true;
+  kf.lv   = lv;
+  kf.rate = 0;
+  kf.p00  = r;
+  kf.p01  = 0;
+  kf.p11  = KF_RATE_P0;
+  kf.run  = 0;
+}
+
+inline void levelFilterUpdate(const Config &c, SensorData &s) {
+  uint8_t t = s.tank < TANK_MAX ? s.tank : 0;
+  LevelKalman &kf = _kfTank[t];
+  float range = c.tanks[t].empty_dist_cm - c.tanks[t].full_dist_cm;
+  kf.jumped = false;
+  if (s.valid && range > 0) {
+    // Measurement variance in %²
+    uint8_t inl = s.burst_n > s.dist_outliers ? s.burst_n - s.dist_outliers : 1;
+    float sd = 1.4826f * s.dist_mad_cm;
+    if (sd < MEAS_MAD_FLOOR_CM) sd = MEAS_MAD_FLOOR_CM;
+    float cm2 = sd * sd / inl + KF_MEAS_SD * KF_MEAS_SD;
+    float r = cm2 * (100.0f / range) * (100.0f / range);
+    r /= measValidRatio(s.quality.valid, s.quality.attempted);
+
+    float dt = (millis() - kf.tMs) / 3600000.0f;
+    if (!kf.init || dt > KF_MAX_DT_H) {
+      _kfReset(kf, s.level_pct, r);
+    } else {
+      // Predict
+      kf.lv  += kf.rate * dt;
+      float q = KF_ACCEL_Q;
+      float p00 = kf.p00 + dt * (2 * kf.p01 + dt * kf.p11) + q * dt * dt * dt / 3;
+      float p01 = kf.p01 + dt * kf.p11 + q * dt * dt / 2;
+      float p11 = kf.p11 + q * dt;
+      // Update
+      float y  = s.level_pct - kf.lv;
+      float sv = p00 + r;
+      if (y * y > KF_GATE * KF_GATE * sv) {
+        dbgPrintf("[KF] jump %.1f%% (%.1f sigma), restart\n", y, fabsf(y) / sqrtf(sv));
+        _kfReset(kf, s.level_pct, r);
+        kf.jumped = true;
+      } else {
+        float k0 = p00 / sv, k1 = p01 / sv;
+        kf.lv   += k0 * y;
+        kf.rate += k1 * y;
+        kf.p00 = (1 - k0) * p00;
+        kf.p01 = (1 - k0) * p01;
+        kf.p11 = p11 - k1 * p01;
+
+        if (y * y > sv) kf.run = (y > 0) ? (kf.run > 0 ? kf.run + 1 : 1)
+                                          : (kf.run < 0 ? kf.run - 1 : -1);
+        else            kf.run = 0;
+        if (kf.run >= KF_RUN || kf.run <= -KF_RUN) {
+          if (kf.p11 < KF_RATE_P0) kf.p11 = KF_RATE_P0;
+          kf.run = 0;
+        }
+      }
+    }
+    kf.tMs = millis();
   }
 
-  s.timestamp = time(nullptr);
+  if (!kf.init) {
+    s.kf_level_pct = NAN;
+    s.kf_rate_lph  = NAN;
+    s.kf_level_var = NAN;
+    s.kf_rate_var  = NAN;
+    return;
+  }
+  // L per % at the filtered level (not constant for non-prismatic tanks)
+  float lv  = constrain(kf.lv, 0.5f, 99.5f);
+  float lph = s.total_liters > 0 ? tankVolumePct(c.tanks[t], t, lv + 0.5f) -
+                                   tankVolumePct(c.tanks[t], t, lv - 0.5f) : NAN;
+  s.kf_level_pct = constrain(kf.lv, 0.0f, 100.0f);
+  s.kf_level_var = kf.p00;
+  s.kf_rate_lph  = kf.rate * lph;
+  s.kf_rate_var  = kf.p11 * lph * lph;
+}
+
+// ------------------------------------------------------------------
+// Adaptive cadence: measure every measure_min_sec while the level moves
+// (filtered rate significant, a jump, or close to an enabled alert
+// threshold) and double the interval after each quiet reading, up to
+// measure_sec. Loop() schedules the next burst from measureIntervalSec().
+// One burst covers all tanks, so any moving tank keeps the short interval.
+// ------------------------------------------------------------------
+#define CADENCE_RATE_MIN  3.0f  // %/h; slower drift counts as stable
+#define CADENCE_RATE_SIG  2.0f  // rate must also exceed this many sigmas
+#define CADENCE_NEAR_PCT  3.0f  // band around alert thresholds, %
+
+static uint16_t _measIntervalSec = 0;
+
+inline uint16_t measureIntervalSec() { return _measIntervalSec; }
+
+inline void measureCadenceUpdate(const Config &c) {
+  bool moving = false;
+  for (uint8_t i = 0; i < c.tank_count && i < TANK_MAX && !moving; i++) {
+    const LevelKalman &kf = _kfTank[i];
+    moving = kf.jumped;
+    if (kf.init && !moving) {
+      float r = fabsf(kf.rate);
+      moving = r > CADENCE_RATE_MIN && r * r > CADENCE_RATE_SIG * CADENCE_RATE_SIG * kf.p11;
+    }
+  }
+  const SensorData &s = _tanks[0];  // alerts watch the primary tank
+  if (s.valid && c.tg_en) {
+    if (c.tg_alert_low_en  && fabsf(s.level_pct - c.tg_alert_low)  < CADENCE_NEAR_PCT) moving = true;
+    if (c.tg_alert_high_en && fabsf(s.level_pct - c.tg_alert_high) < CADENCE_NEAR_PCT) moving = true;
+  }
+
+  uint16_t prev = _measIntervalSec;
+  if (moving || !prev) {
+    _measIntervalSec = c.measure_min_sec;
+  } else {
+    uint32_t next = (uint32_t)prev * 2;
+    _measIntervalSec = next > c.measure_sec ? c.measure_sec : next;
+  }
+  if (_measIntervalSec < c.measure_min_sec) _measIntervalSec = c.measure_min_sec;
+  if (_measIntervalSec != prev)
+    dbgPrintf("[Sensor] interval %u -> %u s%s\n", prev, _measIntervalSec, moving ? " (moving)" : "");
 }
 
 // ------------------------------------------------------------------
 // Pin setup
 // ------------------------------------------------------------------
 inline void initSensor(const Config &c) {
-  pinMode(c.trig_pin, OUTPUT);
-  pinMode(c.echo_pin, INPUT);
-  digitalWrite(c.trig_pin, LOW);
+  for (uint8_t i = 0; i < c.tank_count; i++) {
+    const TankCal &t = c.tanks[i];
+    pinMode(t.trig_pin, OUTPUT);
+    pinMode(t.echo_pin, INPUT);
+    digitalWrite(t.trig_pin, LOW);
+    _tanks[i].tank = i;
+  }
+  _echoAttach(c.tanks[0].echo_pin);
 }
@@ -3,74 +3,200 @@
 #include <LittleFS.h>
 #include "sensor.h"
 
-// Circular buffers stored in LittleFS:
-// - Hourly history (long-term)
-// - Recent minute snapshots (last 60 min)
-// Format:  header(4 bytes)  + MAX_REC * Record(16 bytes)
+// Circular buffers stored in LittleFS, one set per tank channel:
+// - Hourly history (long-term), packed format v3 (see below)
+// - Recent minute snapshots (last 60 min), fixed records
+// Tank 0 keeps the original file names; tank N adds a "_tN" suffix.
+// Fixed-record format:  [tag(4 bytes)] + header(4 bytes) + maxRec * Record(28 bytes)
+//   tag (recent rings): uint8 magic + uint8 version + uint8 record size + uint8 0
 //   header: uint16 head, uint16 count
 //   Record: uint32 ts + float level_pct + float volume_liters + float temp_c
+//           + float water_c + float case_c + uint8 pings + uint8 sd_mm + uint16 echo_us
+//           (v1 hourly files: first 16 bytes only)
+// Recent-ring record layouts, each a prefix of the next:
+//   1 = 16 bytes (ts..temp_c), 2 = 24 bytes (+ water_c, case_c),
+//   3 = 28 bytes (+ pings, sd_mm, 2 pad), 4 = 28 bytes (echo_us in the pad).
+// Files from before the tag (layouts 1-3) are untagged and told apart by
+// size; they and tagged files of an older layout are converted to the
+// current one when loaded or restored.
 
-#define HIST_FILE        "/hist.bin"
-#define HIST_RECENT_FILE "/hist_recent.bin"
-#define MAX_REC          2160  // 90 days × 24 h (hourly snapshots)
-#define MAX_RECENT_REC   60    // last 60 minutes (1 point / minute)
+#define HIST_FILE           "/hist.bin"
+#define HIST_RECENT_FILE    "/hist_recent.bin"
+#define HIST_LEGACY_FILE    "/hist_v1.bin"   // v1 hourly ring while it is being migrated
+#define HIST_LEGACY_MAX_REC 2160  // v1 hourly ring: 90 days × 24 h fixed records
+#define HIST_V1_REC_SIZE    16    // v1 record: ts, level, volume, temp_c
+#define MAX_RECENT_REC      60    // last 60 minutes (1 point / minute)
+#define HIST_MAX_HOURS      8784  // longest /api/history window (366 days)
+#define HIST_TS_VALID_MIN   1600000000UL  // older timestamps mean NTP has not synced
+#define HIST_RECENT_MAGIC   0xA9
+#define HIST_RECENT_VERSION 4     // record layout of the recent rings (see above)
+#define HIST_RECENT_UNTAGGED 3    // last layout written without a tag
 
 struct HistRecord {
   uint32_t ts;
   float    level;    // %
   float    volume;   // L (0 if unknown)
-  float    temp_c;   // °C (NAN if unavailable)
+  float    temp_c;   // air probe, °C (NAN if unavailable)
+  float    water_c;  // water probe, °C (NAN if unavailable)
+  float    case_c;   // enclosure probe, °C (NAN if unavailable)
+  uint8_t  pings;    // reading quality: valid echoes << 4 | pings sent (0 = not recorded)
+  uint8_t  sd_mm;    // spread of the valid echoes, mm (saturates at 255)
+  uint16_t echo_us;  // filtered echo round trip, µs (0 = not recorded; not kept hourly)
 };
+static_assert(sizeof(HistRecord) == 28, "echo_us must stay in the former padding");
+
+inline HistRecord histRecordOf(const SensorData &s) {
+  const MeasQuality &q = s.quality;
+  float sd = q.sd_cm * 10.0f;
+  HistRecord rec = { s.timestamp, s.level_pct, s.volume_liters, s.temp_c, s.water_c, s.case_c,
+                     (uint8_t)((q.valid & 0x0F) << 4 | (q.attempted & 0x0F)),
+                     (uint8_t)(sd < 255.0f ? lroundf(sd) : 255),
+                     (uint16_t)lroundf(q.echo_us) };
+  return rec;
+}
+
+// Records written before quality was tracked count as good.
+inline bool histRecordPoor(const HistRecord &r) {
+  return r.pings && measQualityPoor(r.pings >> 4, r.pings & 0x0F, r.sd_mm / 10.0f);
+}
 
 struct HistHeader {
   uint16_t head;   // next write index
-  uint16_t count;  // total stored (0..MAX_REC)
+  uint16_t count;  // total stored (0..maxRec)
+};
+
+struct HistRingTag {
+  uint8_t magic;     // HIST_RECENT_MAGIC
+  uint8_t version;   // record layout
+  uint8_t recSize;   // bytes per record
+  uint8_t reserved;
 };
 
-inline bool _storageInitRing(const char *path, uint16_t maxRec) {
+// On-flash record size of each recent-ring layout, indexed by version - 1.
+static const uint8_t _histRecentRecSize[HIST_RECENT_VERSION] = { HIST_V1_REC_SIZE, 24, 28, sizeof(HistRecord) };
+
+// Ring descriptor with an authoritative in-RAM copy of the on-flash header.
+// Loaded and validated once by _storageInitRing(); count/head queries are
+// served from RAM and the file is only opened for real record I/O.
+struct HistRing {
+  const char *path;
+  uint16_t    maxRec;
+  uint8_t     recSize; // bytes per record
+  HistHeader  hdr;
+  bool        ready;   // hdr mirrors a validated file
+  uint8_t     version; // HistRingTag version, 0 = untagged file
+};
+
+static_assert(TANK_MAX == 3, "per-tank file tables below list three tanks");
+
+static HistRing _ringRecent[TANK_MAX] = {
+  { HIST_RECENT_FILE,        MAX_RECENT_REC, sizeof(HistRecord), {0, 0}, false, HIST_RECENT_VERSION },
+  { "/hist_recent_t1.bin",   MAX_RECENT_REC, sizeof(HistRecord), {0, 0}, false, HIST_RECENT_VERSION },
+  { "/hist_recent_t2.bin",   MAX_RECENT_REC, sizeof(HistRecord), {0, 0}, false, HIST_RECENT_VERSION },
+};
+
+inline uint8_t _storageTank(uint8_t tank) { return tank < TANK_MAX ? tank : 0; }
+
+// File offset of the HistHeader: tagged rings start with a HistRingTag.
+inline uint8_t _storageRingHdrPos(uint8_t version) { return version ? sizeof(HistRingTag) : 0; }
+
+inline size_t _storageRingFileSize(uint16_t maxRec, uint8_t recSize = sizeof(HistRecord),
+                                   uint8_t version = 0) {
+  return _storageRingHdrPos(version) + sizeof(HistHeader) + (size_t)maxRec * recSize;
+}
+
+inline size_t storageRecentFileSize() {
+  return _storageRingFileSize(MAX_RECENT_REC, sizeof(HistRecord), HIST_RECENT_VERSION);
+}
+
+// Check size, tag and header of an open fixed-record file.
+inline bool _storageRingFileValid(File &f, uint16_t maxRec, uint8_t recSize, uint8_t version,
+                                  HistHeader &hdr) {
+  if (f.size() != _storageRingFileSize(maxRec, recSize, version)) return false;
+  if (version) {
+    HistRingTag tag;
+    if (f.read((uint8_t*)&tag, sizeof(tag)) != sizeof(tag) || tag.magic != HIST_RECENT_MAGIC ||
+        tag.version != version || tag.recSize != recSize) return false;
+  }
+  return f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+         hdr.head < maxRec && hdr.count <= maxRec;
+}
+
+inline bool storageValidateRingFile(const char *path, uint16_t maxRec, HistHeader *outHdr = nullptr,
+                                    uint8_t recSize = sizeof(HistRecord), uint8_t version = 0) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return false;
+  HistHeader hdr;
+  bool ok = _storageRingFileValid(f, maxRec, recSize, version, hdr);
+  f.close();
+  if (ok && outHdr) *outHdr = hdr;
+  return ok;
+}
+
+// Layout (version) of a recent-ring file in an older layout, 0 if none:
+// untagged from before the tag, or tagged with an older version.
+inline uint8_t _storageRingOldVersion(const char *path, const HistRing &r) {
+  for (uint8_t v = 1; v < HIST_RECENT_VERSION; v++) {
+    uint8_t size = _histRecentRecSize[v - 1];
+    if ((v <= HIST_RECENT_UNTAGGED && storageValidateRingFile(path, r.maxRec, nullptr, size)) ||
+        (v >= HIST_RECENT_UNTAGGED && storageValidateRingFile(path, r.maxRec, nullptr, size, v))) return v;
+  }
+  return 0;
+}
+
+inline bool _storageRingMigrate(HistRing &r, const char *oldPath, uint8_t oldVersion);
+
+inline bool _storageInitRing(HistRing &r) {
+  r.ready = false;
+  r.hdr = {0, 0};
+  // Tagged rings: a file in an older layout is parked as "<path>.old" and
+  // converted; a leftover one means an earlier conversion was interrupted.
+  if (r.version) {
+    String oldPath = String(r.path) + ".old";
+    if (!LittleFS.exists(oldPath.c_str()) && _storageRingOldVersion(r.path, r)) {
+      LittleFS.rename(r.path, oldPath.c_str());
+    }
+    if (LittleFS.exists(oldPath.c_str())) {
+      uint8_t v = _storageRingOldVersion(oldPath.c_str(), r);
+      if (v && _storageRingMigrate(r, oldPath.c_str(), v)) return true;
+      dbgPrintf("[HIST] %s conversion failed, starting empty\n", r.path);
+      LittleFS.remove(oldPath.c_str());
+    }
+  }
   // Recreate history if file format/size changed (e.g. firmware upgrade).
-  if (LittleFS.exists(path)) {
-    File f = LittleFS.open(path, "r");
+  if (LittleFS.exists(r.path)) {
+    File f = LittleFS.open(r.path, "r");
     bool valid = false;
     if (f) {
       HistHeader hdr;
-      if (f.size() == (size_t)(sizeof(HistHeader) + (size_t)maxRec * sizeof(HistRecord)) &&
-          f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
-          hdr.head < maxRec && hdr.count <= maxRec) {
+      if (_storageRingFileValid(f, r.maxRec, r.recSize, r.version, hdr)) {
+        r.hdr = hdr;
         valid = true;
       }
       f.close();
     }
-    if (valid) return true;
-    LittleFS.remove(path);
+    if (valid) { r.ready = true; return true; }
+    LittleFS.remove(r.path);
   }
   // Create blank file
-  File f = LittleFS.open(path, "w");
+  File f = LittleFS.open(r.path, "w");
   if (!f) return false;
+  if (r.version) {
+    HistRingTag tag = { HIST_RECENT_MAGIC, r.version, r.recSize, 0 };
+    f.write((uint8_t*)&tag, sizeof(tag));
+  }
   HistHeader hdr = {0, 0};
   f.write((uint8_t*)&hdr, sizeof(hdr));
   // Pre-allocate space
-  HistRecord blank = {0, 0, 0, NAN};
-  for (uint16_t i = 0; i < maxRec; i++) f.write((uint8_t*)&blank, sizeof(blank));
+  uint8_t blank[32] = {0};
+  for (uint16_t i = 0; i < r.maxRec; i++) f.write(blank, r.recSize);
   f.close();
+  r.ready = true;
   return true;
 }
 
-inline bool storageValidateRingFile(const char *path, uint16_t maxRec, HistHeader *outHdr = nullptr) {
-  File f = LittleFS.open(path, "r");
-  if (!f) return false;
-  HistHeader hdr;
-  bool ok =
-    f.size() == (size_t)(sizeof(HistHeader) + (size_t)maxRec * sizeof(HistRecord)) &&
-    f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
-    hdr.head < maxRec && hdr.count <= maxRec;
-  f.close();
-  if (ok && outHdr) *outHdr = hdr;
-  return ok;
-}
-
-inline bool storageReplaceRingFile(const char *tmpPath, const char *dstPath, uint16_t maxRec) {
-  if (!storageValidateRingFile(tmpPath, maxRec)) return false;
+// Move an uploaded file into place; falls back to a copy when rename fails.
+inline bool _storageMoveFile(const char *tmpPath, const char *dstPath) {
   LittleFS.remove(dstPath);
   if (LittleFS.rename(tmpPath, dstPath)) return true;
   // Fallback for filesystems that may fail rename across existing paths.
@@ -87,109 +213,1235 @@ inline bool storageReplaceRingFile(const char *tmpPath, const char *dstPath, uin
   }
   out.close();
   in.close();
-  bool ok = storageValidateRingFile(dstPath, maxRec);
-  if (ok) LittleFS.remove(tmpPath);
+  LittleFS.remove(tmpPath);
+  return true;
+}
+
+// Restore a ring from an upload; a tagged ring also takes its older
+// layouts, converted in place.
+inline bool storageReplaceRingFile(const char *tmpPath, HistRing &r) {
+  uint8_t legacy = r.version ? _storageRingOldVersion(tmpPath, r) : 0;
+  if (!legacy && !storageValidateRingFile(tmpPath, r.maxRec, nullptr, r.recSize, r.version)) return false;
+  r.ready = false;
+  bool ok;
+  if (legacy) {
+    String oldPath = String(r.path) + ".old";
+    ok = _storageMoveFile(tmpPath, oldPath.c_str()) && _storageRingMigrate(r, oldPath.c_str(), legacy);
+  } else {
+    LittleFS.remove((String(r.path) + ".old").c_str());
+    ok = _storageMoveFile(tmpPath, r.path) &&
+         storageValidateRingFile(r.path, r.maxRec, nullptr, r.recSize, r.version);
+  }
+  _storageInitRing(r);
+  dataGenerationBump();
   return ok;
 }
 
-inline void storageInit() {
-  _storageInitRing(HIST_FILE, MAX_REC);
-  _storageInitRing(HIST_RECENT_FILE, MAX_RECENT_REC);
+// ------------------------------------------------------------------
+// Packed hourly history (format v3)
+//
+// File:  HistPackHeader(8 bytes) + HIST_BLOCKS * HistBlock(256 bytes)
+// Blocks form a ring; `head` is the open block new records are appended to.
+// Every block is decodable on its own: it starts from ts0 and zero values,
+// and each record is stored as deltas from the previous one:
+//   tag byte: 2-bit width code per field, ts | level<<2 | vol<<4 | temp<<6
+//             0 = no change, 1 = int8, 2 = int16, 3 = int32 (temps: 3 = NaN)
+//   aux tag (v3): water | case<<2 | pings<<4 | sd<<5, upper bits zero;
+//           the pings and sd bits flag a raw byte that differs from the
+//           previous record (both start at 0 in each block)
+//   ts    : delta from prev.ts + cadence, seconds; jitter within
+//           HIST_TS_TOL_S is folded into "on cadence"
+//   level : delta, 0.1 %
+//   vol   : 0.1 L, residual against prev.vol scaled by the level change
+//           (volume tracks level linearly); |residual| <= HIST_VOL_TOL is dropped
+//   temp, water, case: delta from last non-NaN value, 0.1 °C
+//   pings, sd: HistRecord::pings / sd_mm as is, one byte each when flagged
+// A typical hour costs ~4-5 bytes instead of 16, so the same ~34 KB that held
+// 90 days of v1 records holds about a year. v2 rings (no aux tag) are
+// re-encoded to v3 when loaded; that second pass can add the ts and vol
+// tolerances once more.
+// ------------------------------------------------------------------
+#define HIST_FMT_VERSION     3
+#define HIST_FMT_MIN_VERSION 2     // oldest packed version that is upgraded on load
+#define HIST_PACK_MAGIC      0xA7
+#define HIST_BLOCK_SIZE      256
+#define HIST_BLOCKS          136   // 136 × 256 B ≈ 34 KB, same flash as v1
+#define HIST_CADENCE_S       3600  // expected spacing of hourly records
+#define HIST_PACK_MAX_REC_B  22    // 2 tags + 4 + 4 + 4 + 3 × 2 + 2
+#define HIST_TS_TOL_S        30    // max timestamp error introduced by encoding, s
+#define HIST_VOL_TOL         1     // max volume error introduced by encoding, 0.1 L
+
+struct HistPackHeader {
+  uint8_t  magic;    // HIST_PACK_MAGIC
+  uint8_t  version;  // HIST_FMT_VERSION
+  uint16_t head;     // open (newest) block
+  uint16_t blocks;   // blocks in use (0..HIST_BLOCKS)
+  uint16_t cadence;  // seconds, base for timestamp deltas
+};
+
+struct HistBlockHdr {
+  uint32_t ts0;      // timestamp of the first record
+  uint16_t count;    // records in block
+  uint16_t used;     // payload bytes in use
+};
+
+#define HIST_BLOCK_PAYLOAD (HIST_BLOCK_SIZE - sizeof(HistBlockHdr))
+
+struct HistBlock {
+  HistBlockHdr h;
+  uint8_t      data[HIST_BLOCK_PAYLOAD];
+};
+static_assert(sizeof(HistBlock) == HIST_BLOCK_SIZE, "HistBlock must fill one block");
+
+// Codec state between consecutive records of one block.
+struct HistPackState {
+  uint32_t ts;
+  int32_t  level;  // 0.1 %
+  int32_t  vol;    // 0.1 L
+  int32_t  temp;   // 0.1 °C, last non-NaN value
+  int32_t  water;  // 0.1 °C, last non-NaN value
+  int32_t  cas;    // 0.1 °C, last non-NaN value
+  uint8_t  pings;  // HistRecord::pings of the previous record
+  uint8_t  sd;     // HistRecord::sd_mm of the previous record
+  uint16_t pos;    // payload offset of the next record
+  uint16_t n;      // records consumed
+};
+
+struct HistPackRing {
+  const char    *path;
+  HistPackHeader hdr;
+  HistBlock      open;                   // RAM copy of the open block
+  HistPackState  tail;                   // codec state after the newest record
+  uint8_t        blkCount[HIST_BLOCKS];  // records per physical block
+  uint32_t       blkTs0[HIST_BLOCKS];    // first timestamp per physical block (time index)
+  uint16_t       count;                  // total records
+  bool           ready;
+};
+
+// ~1 KB each (open block + block index): tank 0's ring is static, the
+// others are allocated on first use, so channels never enabled cost no RAM.
+static HistPackRing  _ringHourly0 = { HIST_FILE, {}, {}, {}, {}, {}, 0, false };
+static HistPackRing *_ringHourly[TANK_MAX] = { &_ringHourly0 };
+
+static const char *const _ringHourlyPath[TANK_MAX] = {
+  HIST_FILE, "/hist_t1.bin", "/hist_t2.bin"
+};
+
+inline HistPackRing &storageHourlyRing(uint8_t tank = 0) {
+  tank = _storageTank(tank);
+  if (!_ringHourly[tank]) {
+    HistPackRing *r = new HistPackRing();
+    if (!r) return _ringHourly0;
+    r->path = _ringHourlyPath[tank];
+    _ringHourly[tank] = r;
+  }
+  return *_ringHourly[tank];
+}
+inline HistRing     &storageRecentRing(uint8_t tank = 0) { return _ringRecent[_storageTank(tank)]; }
+
+inline size_t storagePackFileSize() {
+  return sizeof(HistPackHeader) + (size_t)HIST_BLOCKS * HIST_BLOCK_SIZE;
 }
 
-inline void _storageWriteRing(const char *path, uint16_t maxRec, const SensorData &s) {
-  File f = LittleFS.open(path, "r+");
-  if (!f) { storageInit(); f = LittleFS.open(path, "r+"); }
-  if (!f) return;
+inline uint32_t _storageBlockOffset(uint16_t phys) {
+  return sizeof(HistPackHeader) + (uint32_t)phys * HIST_BLOCK_SIZE;
+}
 
-  HistHeader hdr;
-  f.read((uint8_t*)&hdr, sizeof(hdr));
-  if (hdr.head >= maxRec || hdr.count > maxRec) {
-    f.close();
-    _storageInitRing(path, maxRec);
-    f = LittleFS.open(path, "r+");
+// Physical index of the oldest block in use.
+inline uint16_t _storagePackOldest(const HistPackRing &r) {
+  return (uint16_t)((r.hdr.head + HIST_BLOCKS + 1 - r.hdr.blocks) % HIST_BLOCKS);
+}
+
+inline void _histPackReset(HistPackState &st, uint32_t ts0, uint16_t cadence) {
+  st.ts = ts0 - cadence;   // first record then encodes as "on cadence"
+  st.level = st.vol = st.temp = st.water = st.cas = 0;
+  st.pings = st.sd = 0;
+  st.pos = st.n = 0;
+}
+
+inline int32_t _histQ(float v) { return (int32_t)lroundf(v * 10.0f); }
+
+static const uint8_t _histPackWidth[4] = {0, 1, 2, 4};
+
+inline uint8_t _histPackCode(int32_t d) {
+  if (d == 0) return 0;
+  if (d >= -128 && d <= 127) return 1;
+  if (d >= -32768 && d <= 32767) return 2;
+  return 3;
+}
+
+inline uint8_t *_histPackPut(uint8_t *p, int32_t v, uint8_t code) {
+  for (uint8_t i = 0; i < _histPackWidth[code]; i++) *p++ = (uint8_t)((uint32_t)v >> (8 * i));
+  return p;
+}
+
+inline int32_t _histPackGet(const uint8_t *&p, uint8_t code) {
+  uint8_t w = _histPackWidth[code];
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < w; i++) v |= (uint32_t)p[i] << (8 * i);
+  p += w;
+  if (w && w < 4 && (v & (1UL << (8 * w - 1)))) v |= ~0UL << (8 * w);  // sign-extend
+  return (int32_t)v;
+}
+
+// Volume expected at `level` if it scales with level like the previous record.
+inline int32_t _histPredictVol(const HistPackState &st, int32_t level) {
+  if (st.level <= 0) return st.vol;
+  return (int32_t)(((int64_t)level * st.vol + st.level / 2) / st.level);
+}
+
+// Temperature field: delta from the last non-NaN value, code 3 for NaN.
+inline uint8_t _histPackTemp(float v, int32_t last, int32_t &d) {
+  if (isnan(v)) { d = 0; return 3; }
+  d = constrain(_histQ(v) - last, -32768, 32767);
+  return _histPackCode(d);
+}
+
+// Encode `rec` after state `st` into out[] (HIST_PACK_MAX_REC_B bytes) and
+// advance `st` to what the decoder will see. Returns the encoded length.
+// `ver` 2 drops the water/case and quality fields.
+inline uint8_t _histPackEncode(HistPackState &st, uint16_t cadence, uint8_t ver,
+                               const HistRecord &rec, uint8_t *out) {
+  int32_t dTs = (int32_t)(rec.ts - st.ts - cadence);
+  if (dTs >= -HIST_TS_TOL_S && dTs <= HIST_TS_TOL_S) dTs = 0;
+  int32_t lv   = _histQ(rec.level);
+  int32_t pred = _histPredictVol(st, lv);
+  int32_t dV   = _histQ(rec.volume) - pred;
+  if (dV >= -HIST_VOL_TOL && dV <= HIST_VOL_TOL) dV = 0;
+  int32_t dT, dW = 0, dC = 0;
+  uint8_t cTe = _histPackTemp(rec.temp_c, st.temp, dT);
+  uint8_t cWa = 3, cCa = 3;
+  bool fPi = false, fSd = false;
+  if (ver >= 3) {
+    cWa = _histPackTemp(rec.water_c, st.water, dW);
+    cCa = _histPackTemp(rec.case_c, st.cas, dC);
+    fPi = rec.pings != st.pings;
+    fSd = rec.sd_mm != st.sd;
+  }
+
+  uint8_t cTs = _histPackCode(dTs);
+  uint8_t cLv = _histPackCode(lv - st.level);
+  uint8_t cVo = _histPackCode(dV);
+
+  uint8_t *p = out;
+  *p++ = (uint8_t)(cTs | (cLv << 2) | (cVo << 4) | (cTe << 6));
+  if (ver >= 3) *p++ = (uint8_t)(cWa | (cCa << 2) | (fPi << 4) | (fSd << 5));
+  p = _histPackPut(p, dTs, cTs);
+  p = _histPackPut(p, lv - st.level, cLv);
+  p = _histPackPut(p, dV, cVo);
+  if (cTe != 3) p = _histPackPut(p, dT, cTe);
+  if (cWa != 3) p = _histPackPut(p, dW, cWa);
+  if (cCa != 3) p = _histPackPut(p, dC, cCa);
+  if (fPi) *p++ = rec.pings;
+  if (fSd) *p++ = rec.sd_mm;
+
+  uint8_t len = (uint8_t)(p - out);
+  st.ts += cadence + dTs;
+  st.level = lv;
+  st.vol = pred + dV;
+  st.temp  += dT;
+  st.water += dW;
+  st.cas   += dC;
+  if (ver >= 3) { st.pings = rec.pings; st.sd = rec.sd_mm; }
+  st.pos += len;
+  st.n++;
+  return len;
+}
+
+// Decode the next record of block `b`. False at end of block or on corrupt data.
+inline bool _histPackDecode(const HistBlock &b, uint16_t cadence, uint8_t ver,
+                            HistPackState &st, HistRecord &out) {
+  if (st.n >= b.h.count || st.pos >= b.h.used) return false;
+  uint8_t tags = ver >= 3 ? 2 : 1;
+  if (st.pos + tags > b.h.used) return false;
+  uint8_t tag = b.data[st.pos];
+  uint8_t aux = ver >= 3 ? b.data[st.pos + 1] : 0x0F;
+  uint8_t cTs = tag & 3, cLv = (tag >> 2) & 3, cVo = (tag >> 4) & 3, cTe = tag >> 6;
+  uint8_t cWa = aux & 3, cCa = (aux >> 2) & 3;
+  bool fPi = ver >= 3 && (aux & 0x10), fSd = ver >= 3 && (aux & 0x20);
+  if (aux >> 6) return false;
+  auto tw = [](uint8_t c) { return c == 3 ? 0 : _histPackWidth[c]; };
+  uint16_t len = tags + _histPackWidth[cTs] + _histPackWidth[cLv] + _histPackWidth[cVo] +
+                 tw(cTe) + tw(cWa) + tw(cCa) + fPi + fSd;
+  if (st.pos + len > b.h.used) return false;
+
+  const uint8_t *p = b.data + st.pos + tags;
+  st.ts    += cadence + _histPackGet(p, cTs);
+  int32_t lv = st.level + _histPackGet(p, cLv);
+  st.vol    = _histPredictVol(st, lv) + _histPackGet(p, cVo);
+  st.level  = lv;
+  if (cTe != 3) st.temp  += _histPackGet(p, cTe);
+  if (cWa != 3) st.water += _histPackGet(p, cWa);
+  if (cCa != 3) st.cas   += _histPackGet(p, cCa);
+  if (fPi) st.pings = *p++;
+  if (fSd) st.sd    = *p++;
+  st.pos += len;
+  st.n++;
+
+  out.ts      = st.ts;
+  out.level   = st.level / 10.0f;
+  out.volume  = st.vol / 10.0f;
+  out.temp_c  = (cTe == 3) ? NAN : st.temp / 10.0f;
+  out.water_c = (cWa == 3) ? NAN : st.water / 10.0f;
+  out.case_c  = (cCa == 3) ? NAN : st.cas / 10.0f;
+  out.pings   = st.pings;
+  out.sd_mm   = st.sd;
+  out.echo_us = 0;   // minute snapshots only
+  return true;
+}
+
+inline bool _storagePackInit(HistPackRing &r);
+
+// ------------------------------------------------------------------
+// Ring cursor: walks a logical range of a ring in block-sized reads.
+// Logical index 0 is the oldest record.
+// Fixed-record rings: a range crosses the physical end of the file at most
+// once, so it is read as at most two sequential spans; each refill is a
+// single seek + read of up to HIST_CURSOR_BLOCK records.
+// Packed rings: each refill decodes up to HIST_CURSOR_BLOCK records from a
+// block that was read with one 256-byte read (the open block comes from RAM).
+// ------------------------------------------------------------------
+#define HIST_CURSOR_BLOCK ((int)(256 / sizeof(HistRecord)))   // 9 × 28 B = 252 B, one LittleFS page
+
+struct HistCursor {
+  File          f;
+  HistPackRing *pack    = nullptr;   // null for fixed-record rings
+  uint16_t      maxRec  = 0;
+  uint8_t       recSize = 0;   // on-flash record size (fixed-record rings)
+  uint8_t       recPos  = 0;   // file offset of record 0 (fixed-record rings)
+  uint16_t      oldest  = 0;   // physical index of logical 0 (record or block)
+  uint16_t      next    = 0;   // next logical index to load (forward) / one past it (reverse)
+  uint16_t      left    = 0;   // records not yet loaded into buf
+  bool          reverse = false;
+  uint8_t       bufLen  = 0;
+  uint8_t       bufPos  = 0;
+  HistRecord    buf[HIST_CURSOR_BLOCK];
+  // packed rings only
+  uint16_t      blk     = 0;   // logical block held in `block`
+  int16_t       rec     = 0;   // reverse: next record within `block` to deliver
+  HistPackState st;
+  HistBlock     block;
+};
+
+// A cursor is ~560 B (record buffer + one packed block), too much for a
+// web handler's stack, so history walkers share this one. Each runs to
+// completion from loop() and closes it before the next one opens it.
+static HistCursor _histCursor;
+inline HistCursor &storageCursor() { return _histCursor; }
+
+// Open a cursor over logical records [first, first + n) of ring `r`.
+// Forward yields oldest→newest, reverse yields newest→oldest.
+inline bool storageCursorOpen(HistCursor &c, HistRing &r, bool reverse,
+                              uint16_t first = 0, uint16_t n = 0xFFFF) {
+  c.left = 0;
+  c.bufLen = c.bufPos = 0;
+  c.pack = nullptr;
+  if (r.recSize > sizeof(HistRecord) || r.recSize < HIST_V1_REC_SIZE) return false;
+  if (!r.ready && !_storageInitRing(r)) return false;
+  if (first >= r.hdr.count) return false;
+  if (n > r.hdr.count - first) n = r.hdr.count - first;
+  if (n == 0) return false;
+
+  c.f = LittleFS.open(r.path, "r");
+  if (!c.f) { _storageInitRing(r); return false; }
+  c.maxRec  = r.maxRec;
+  c.recSize = r.recSize;
+  c.recPos  = _storageRingHdrPos(r.version) + sizeof(HistHeader);
+  c.oldest  = (uint16_t)(((int)r.hdr.head - (int)r.hdr.count + r.maxRec) % r.maxRec);
+  c.reverse = reverse;
+  c.left    = n;
+  c.next    = reverse ? (uint16_t)(first + n) : first;
+  return true;
+}
+
+// Load logical block `lb` of the packed ring into c.block and rewind the codec.
+inline bool _storageCursorLoadBlock(HistCursor &c, uint16_t lb) {
+  HistPackRing &r = *c.pack;
+  if (lb >= r.hdr.blocks) return false;
+  uint16_t phys = (uint16_t)((c.oldest + lb) % HIST_BLOCKS);
+  if (phys == r.hdr.head) {
+    c.block = r.open;
+  } else {
+    yield();
+    if (!c.f.seek(_storageBlockOffset(phys)) ||
+        c.f.read((uint8_t*)&c.block, sizeof(c.block)) != sizeof(c.block)) return false;
+  }
+  if (c.block.h.count != r.blkCount[phys] || c.block.h.used > HIST_BLOCK_PAYLOAD) return false;
+  c.blk = lb;
+  _histPackReset(c.st, c.block.h.ts0, r.hdr.cadence);
+  return true;
+}
+
+inline bool storageCursorOpen(HistCursor &c, HistPackRing &r, bool reverse,
+                              uint16_t first = 0, uint16_t n = 0xFFFF) {
+  // Before touching `c`: a format upgrade walks the old file with the
+  // shared cursor.
+  if (!r.ready && !_storagePackInit(r)) return false;
+  c.left = 0;
+  c.bufLen = c.bufPos = 0;
+  c.pack = nullptr;
+  if (first >= r.count) return false;
+  if (n > r.count - first) n = r.count - first;
+  if (n == 0) return false;
+
+  c.f = LittleFS.open(r.path, "r");
+  if (!c.f) { r.ready = false; return false; }
+  c.pack    = &r;
+  c.oldest  = _storagePackOldest(r);
+  c.reverse = reverse;
+  c.left    = n;
+
+  // Locate the block holding the first record to deliver (RAM counts only).
+  uint16_t target = reverse ? (uint16_t)(first + n - 1) : first;
+  uint16_t lb = 0, base = 0;
+  while (lb < r.hdr.blocks) {
+    uint8_t cnt = r.blkCount[(c.oldest + lb) % HIST_BLOCKS];
+    if (base + cnt > target) break;
+    base += cnt;
+    lb++;
+  }
+  if (!_storageCursorLoadBlock(c, lb)) { c.f.close(); c.left = 0; return false; }
+  c.rec = (int16_t)(target - base);
+  if (!reverse) {
+    HistRecord skip;
+    for (int16_t i = 0; i < c.rec; i++) {
+      if (!_histPackDecode(c.block, r.hdr.cadence, r.hdr.version, c.st, skip)) { c.left = 0; break; }
+    }
+  }
+  return c.left > 0;
+}
+
+inline bool _storageCursorFillPacked(HistCursor &c) {
+  uint16_t cadence = c.pack->hdr.cadence;
+  uint8_t  ver     = c.pack->hdr.version;
+  uint8_t run = 0;
+  if (!c.reverse) {
+    while (run < HIST_CURSOR_BLOCK && c.left > 0) {
+      if (c.st.n >= c.block.h.count && !_storageCursorLoadBlock(c, c.blk + 1)) break;
+      if (!_histPackDecode(c.block, cadence, ver, c.st, c.buf[run])) break;
+      run++;
+      c.left--;
+    }
+  } else {
+    // Records decode only forward, so decode the segment ending at c.rec
+    // from the block start and serve it back to front.
+    if (c.rec < 0) {
+      if (c.blk == 0 || !_storageCursorLoadBlock(c, c.blk - 1)) { c.left = 0; return false; }
+      c.rec = (int16_t)c.block.h.count - 1;
+    }
+    int16_t segStart = (c.rec / HIST_CURSOR_BLOCK) * HIST_CURSOR_BLOCK;
+    if (c.rec - segStart + 1 > c.left) segStart = c.rec + 1 - c.left;
+    _histPackReset(c.st, c.block.h.ts0, cadence);
+    HistRecord skip;
+    for (int16_t i = 0; i < segStart; i++) {
+      if (!_histPackDecode(c.block, cadence, ver, c.st, skip)) { c.left = 0; return false; }
+    }
+    for (int16_t i = segStart; i <= c.rec; i++) {
+      if (!_histPackDecode(c.block, cadence, ver, c.st, c.buf[run])) break;
+      run++;
+    }
+    c.left = (run == c.rec - segStart + 1) ? c.left - run : 0;
+    c.rec = segStart - 1;
+  }
+  if (run == 0) { c.left = 0; return false; }
+  c.bufLen = run;
+  c.bufPos = 0;
+  return true;
+}
+
+inline bool _storageCursorFill(HistCursor &c) {
+  if (c.left == 0 || !c.f) return false;
+  if (c.pack) return _storageCursorFillPacked(c);
+  uint16_t run, startPhys;
+  if (!c.reverse) {
+    uint16_t phys = (uint16_t)(((uint32_t)c.oldest + c.next) % c.maxRec);
+    run = c.maxRec - phys;                      // up to the physical end of file
+    if (run > c.left) run = c.left;
+    if (run > HIST_CURSOR_BLOCK) run = HIST_CURSOR_BLOCK;
+    startPhys = phys;
+    c.next += run;
+  } else {
+    uint16_t phys = (uint16_t)(((uint32_t)c.oldest + c.next - 1) % c.maxRec);
+    run = phys + 1;                             // down to the physical start of file
+    if (run > c.left) run = c.left;
+    if (run > HIST_CURSOR_BLOCK) run = HIST_CURSOR_BLOCK;
+    startPhys = phys + 1 - run;
+    c.next -= run;
+  }
+  yield(); // one yield per block keeps WDT happy on long scans
+  size_t bytes = (size_t)run * c.recSize;
+  if (!c.f.seek(c.recPos + (uint32_t)startPhys * c.recSize) ||
+      c.f.read((uint8_t*)c.buf, bytes) != bytes) {
+    c.left = 0;
+    return false;
+  }
+  // Older layouts are a prefix of HistRecord (v1 hourly, recent layouts
+  // 1-2): spread them out in place, last first, defaulting the rest.
+  for (int i = c.recSize < sizeof(HistRecord) ? run - 1 : -1; i >= 0; i--) {
+    HistRecord rec = {0, 0, 0, NAN, NAN, NAN, 0, 0, 0};
+    memcpy(&rec, (uint8_t*)c.buf + (size_t)i * c.recSize, c.recSize);
+    c.buf[i] = rec;
+  }
+  c.left -= run;
+  c.bufLen = (uint8_t)run;
+  c.bufPos = 0;
+  return true;
+}
+
+inline bool storageCursorNext(HistCursor &c, HistRecord &out) {
+  if (c.bufPos >= c.bufLen && !_storageCursorFill(c)) return false;
+  // Reverse blocks are read in file order and served back to front.
+  out = c.reverse ? c.buf[c.bufLen - 1 - c.bufPos] : c.buf[c.bufPos];
+  c.bufPos++;
+  return true;
+}
+
+inline void storageCursorClose(HistCursor &c) {
+  if (c.f) c.f.close();
+  c.left = 0;
+  c.bufLen = c.bufPos = 0;
+}
+
+// Convert a recent-ring file in an older layout (parked at `oldPath`,
+// layout `oldVersion`) into a fresh ring, oldest record in slot 0.
+inline bool _storageRingMigrate(HistRing &r, const char *oldPath, uint8_t oldVersion) {
+  uint8_t oldSize = _histRecentRecSize[oldVersion - 1];
+  HistHeader old;
+  uint32_t oldPos = 0;   // file offset of the header: layout 3 exists with and without a tag
+  if (storageValidateRingFile(oldPath, r.maxRec, &old, oldSize, oldVersion)) oldPos = sizeof(HistRingTag);
+  else if (!storageValidateRingFile(oldPath, r.maxRec, &old, oldSize)) return false;
+  File in = LittleFS.open(oldPath, "r");
+  File out = LittleFS.open(r.path, "w");
+  HistRingTag tag = { HIST_RECENT_MAGIC, r.version, r.recSize, 0 };
+  HistHeader hdr = { (uint16_t)(old.count % r.maxRec), old.count };
+  bool ok = in && out &&
+            out.write((uint8_t*)&tag, sizeof(tag)) == sizeof(tag) &&
+            out.write((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr);
+  uint16_t oldest = (uint16_t)((old.head + r.maxRec - old.count) % r.maxRec);
+  for (uint16_t i = 0; ok && i < r.maxRec; i++) {
+    HistRecord rec = {};   // blank slot
+    if (i < old.count) {
+      rec = {0, 0, 0, NAN, NAN, NAN, 0, 0, 0};
+      ok = in.seek(oldPos + sizeof(HistHeader) + (uint32_t)((oldest + i) % r.maxRec) * oldSize) &&
+           in.read((uint8_t*)&rec, oldSize) == oldSize;
+      if (oldVersion < 4) rec.echo_us = 0;   // padding in layout 3
+    }
+    ok = ok && out.write((uint8_t*)&rec, r.recSize) == r.recSize;
+  }
+  if (in) in.close();
+  if (out) out.close();
+  if (!ok) return false;
+  LittleFS.remove(oldPath);
+  r.hdr = hdr;
+  r.ready = true;
+  dbgPrintf("[HIST] %s converted layout %u -> %u: %u records\n",
+            r.path, oldVersion, r.version, hdr.count);
+  return true;
+}
+
+// ------------------------------------------------------------------
+// Packed ring: load / create / migrate / append
+// ------------------------------------------------------------------
+inline bool _storagePackHeaderValid(const HistPackHeader &h) {
+  return h.magic == HIST_PACK_MAGIC && h.version >= HIST_FMT_MIN_VERSION &&
+         h.version <= HIST_FMT_VERSION && h.cadence > 0 &&
+         h.head < HIST_BLOCKS && h.blocks <= HIST_BLOCKS &&
+         (h.blocks == HIST_BLOCKS || h.head + 1 == h.blocks || (h.blocks == 0 && h.head == 0));
+}
+
+inline bool storageValidatePackFile(const char *path) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return false;
+  HistPackHeader hdr;
+  bool ok = f.size() == storagePackFileSize() &&
+            f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+            _storagePackHeaderValid(hdr);
+  f.close();
+  return ok;
+}
+
+// Load the packed file into RAM state: header, per-block counts and the open block.
+inline bool _storagePackLoad(HistPackRing &r) {
+  File f = LittleFS.open(r.path, "r");
+  if (!f) return false;
+  bool ok = f.size() == storagePackFileSize() &&
+            f.read((uint8_t*)&r.hdr, sizeof(r.hdr)) == sizeof(r.hdr) &&
+            _storagePackHeaderValid(r.hdr);
+  memset(r.blkCount, 0, sizeof(r.blkCount));
+  memset(r.blkTs0, 0, sizeof(r.blkTs0));
+  memset(&r.open, 0, sizeof(r.open));
+  r.count = 0;
+  uint16_t oldest = _storagePackOldest(r);
+  for (uint16_t lb = 0; ok && lb < r.hdr.blocks; lb++) {
+    uint16_t phys = (uint16_t)((oldest + lb) % HIST_BLOCKS);
+    HistBlockHdr bh;
+    ok = f.seek(_storageBlockOffset(phys)) &&
+         f.read((uint8_t*)&bh, sizeof(bh)) == sizeof(bh) &&
+         bh.used <= HIST_BLOCK_PAYLOAD && bh.count <= bh.used;
+    if (!ok) break;
+    r.blkCount[phys] = (uint8_t)bh.count;
+    r.blkTs0[phys] = bh.ts0;
+    r.count += bh.count;
+  }
+  // The time index needs ts0 rising from the oldest block to the newest.
+  // Power lost between writing a new block into the evicted oldest slot
+  // and writing the header that moves `head` onto it leaves the newest
+  // data in the oldest position. Walk back from the open block and drop
+  // (count 0, ts0 0) the block that breaks the order and anything older;
+  // the cursor never reaches records it does not count.
+  uint32_t limit = UINT32_MAX;
+  for (int lb = ok ? (int)r.hdr.blocks - 1 : -1; lb >= 0; lb--) {
+    uint16_t phys = (uint16_t)((oldest + lb) % HIST_BLOCKS);
+    if (limit && r.blkTs0[phys] <= limit) {
+      limit = r.blkTs0[phys];
+      continue;
+    }
+    if (limit) dbgPrintf("[HIST] block %u out of time order, dropping %d block(s)\n", phys, lb + 1);
+    limit = 0;
+    r.count -= r.blkCount[phys];
+    r.blkCount[phys] = 0;
+    r.blkTs0[phys] = 0;
+  }
+  if (ok && r.hdr.blocks) {
+    ok = f.seek(_storageBlockOffset(r.hdr.head)) &&
+         f.read((uint8_t*)&r.open, sizeof(r.open)) == sizeof(r.open);
+  }
+  f.close();
+  if (!ok) return false;
+
+  // Rebuild the encoder state from the open block. A torn tail (power loss
+  // mid-append) is trimmed to the last record that decodes cleanly.
+  _histPackReset(r.tail, r.open.h.ts0, r.hdr.cadence);
+  HistRecord rec;
+  while (_histPackDecode(r.open, r.hdr.cadence, r.hdr.version, r.tail, rec)) {}
+  if (r.hdr.blocks && r.tail.n != r.open.h.count) {
+    dbgPrintf("[HIST] open block trimmed %u -> %u records\n", r.open.h.count, r.tail.n);
+    r.count -= r.open.h.count - r.tail.n;
+    r.open.h.count = r.tail.n;
+    r.open.h.used = r.tail.pos;
+    r.blkCount[r.hdr.head] = (uint8_t)r.tail.n;
+  }
+  r.ready = true;
+  return true;
+}
+
+inline bool _storagePackCreate(HistPackRing &r) {
+  File f = LittleFS.open(r.path, "w");
+  if (!f) return false;
+  HistPackHeader hdr = { HIST_PACK_MAGIC, HIST_FMT_VERSION, 0, 0, HIST_CADENCE_S };
+  bool ok = f.write((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr);
+  // Pre-allocate space
+  uint8_t zero[64] = {0};
+  for (uint32_t i = 0; ok && i < (uint32_t)HIST_BLOCKS * HIST_BLOCK_SIZE; i += sizeof(zero)) {
+    ok = f.write(zero, sizeof(zero)) == sizeof(zero);
+  }
+  f.close();
+  if (!ok) return false;
+  r.hdr = hdr;
+  memset(r.blkCount, 0, sizeof(r.blkCount));
+  memset(r.blkTs0, 0, sizeof(r.blkTs0));
+  memset(&r.open, 0, sizeof(r.open));
+  _histPackReset(r.tail, 0, hdr.cadence);
+  r.count = 0;
+  r.ready = true;
+  return true;
+}
+
+// Write the open block's payload from byte `from`, then its header.
+inline bool _storagePackWriteOpen(HistPackRing &r, File &f, uint16_t from) {
+  uint32_t off = _storageBlockOffset(r.hdr.head);
+  uint16_t n = r.open.h.used - from;
+  bool ok = true;
+  if (n) ok = f.seek(off + sizeof(HistBlockHdr) + from) && f.write(r.open.data + from, n) == n;
+  return ok && f.seek(off) && f.write((uint8_t*)&r.open.h, sizeof(r.open.h)) == sizeof(r.open.h);
+}
+
+inline bool _storagePackWriteHeader(HistPackRing &r, File &f) {
+  return f.seek(0) && f.write((uint8_t*)&r.hdr, sizeof(r.hdr)) == sizeof(r.hdr);
+}
+
+// Append one record. With `sync` the new bytes and headers go to flash at
+// once; bulk loaders pass false and the block is written when it closes.
+inline bool _storagePackAppend(HistPackRing &r, File &f, const HistRecord &rec, bool sync) {
+  uint8_t enc[HIST_PACK_MAX_REC_B];
+  HistPackState st = r.tail;
+  uint8_t len = 0;
+  bool newBlock = (r.hdr.blocks == 0);
+  if (!newBlock) {
+    len = _histPackEncode(st, r.hdr.cadence, r.hdr.version, rec, enc);
+    newBlock = r.open.h.used + len > HIST_BLOCK_PAYLOAD;
+  }
+  if (newBlock) {
+    if (r.hdr.blocks && !sync && !_storagePackWriteOpen(r, f, 0)) return false;
+    if (r.hdr.blocks == 0) {
+      r.hdr.head = 0;
+      r.hdr.blocks = 1;
+    } else {
+      r.hdr.head = (r.hdr.head + 1) % HIST_BLOCKS;
+      if (r.hdr.blocks < HIST_BLOCKS) r.hdr.blocks++;
+      else r.count -= r.blkCount[r.hdr.head];   // evict the oldest block
+    }
+    r.blkCount[r.hdr.head] = 0;
+    r.blkTs0[r.hdr.head] = rec.ts;
+    r.open.h.ts0 = rec.ts;
+    r.open.h.count = 0;
+    r.open.h.used = 0;
+    _histPackReset(st, rec.ts, r.hdr.cadence);
+    len = _histPackEncode(st, r.hdr.cadence, r.hdr.version, rec, enc);
+  }
+
+  uint16_t from = r.open.h.used;
+  memcpy(r.open.data + from, enc, len);
+  r.open.h.used += len;
+  r.open.h.count++;
+  r.blkCount[r.hdr.head]++;
+  r.count++;
+  r.tail = st;
+
+  if (!sync) return true;
+  return _storagePackWriteOpen(r, f, newBlock ? 0 : from) &&
+         (!newBlock || _storagePackWriteHeader(r, f));
+}
+
+// Re-encode every record of `src` into a fresh packed ring `r`.
+template <typename Ring>
+inline bool _storagePackRebuild(HistPackRing &r, Ring &src) {
+  LittleFS.remove(r.path);
+  if (!_storagePackCreate(r)) return false;
+
+  File f = LittleFS.open(r.path, "r+");
+  if (!f) { r.ready = false; return false; }
+  bool ok = true;
+  HistCursor &cur = storageCursor();
+  if (storageCursorOpen(cur, src, false)) {
+    HistRecord rec;
+    while (ok && storageCursorNext(cur, rec)) {
+      if (rec.ts == 0) continue;
+      ok = _storagePackAppend(r, f, rec, false);
+    }
+    storageCursorClose(cur);
+  }
+  ok = ok && (!r.hdr.blocks || _storagePackWriteOpen(r, f, 0)) && _storagePackWriteHeader(r, f);
+  f.close();
+  if (!ok) r.ready = false;
+  return ok;
+}
+
+// Convert a v1 fixed-record hourly file into a fresh packed ring.
+inline bool _storagePackMigrate(HistPackRing &r, const char *legacyPath) {
+  HistRing legacy = { legacyPath, HIST_LEGACY_MAX_REC, HIST_V1_REC_SIZE, {0, 0}, false };
+  if (!storageValidateRingFile(legacyPath, HIST_LEGACY_MAX_REC, &legacy.hdr, HIST_V1_REC_SIZE)) return false;
+  legacy.ready = true;
+  if (!_storagePackRebuild(r, legacy)) return false;
+  LittleFS.remove(legacyPath);
+  dbgPrintf("[HIST] migrated v1 -> v%u: %u records in %u blocks\n",
+            HIST_FMT_VERSION, r.count, r.hdr.blocks);
+  return true;
+}
+
+// Re-encode an older packed file (parked at `oldPath`) in the current format.
+inline bool _storagePackUpgrade(HistPackRing &r, const char *oldPath) {
+  HistPackRing *src = new HistPackRing();   // ~1.4 KB, too much for the stack
+  if (!src) return false;
+  src->path = oldPath;
+  bool ok = _storagePackLoad(*src) && _storagePackRebuild(r, *src);
+  if (ok) dbgPrintf("[HIST] %s upgraded v%u -> v%u: %u records\n",
+                    r.path, src->hdr.version, HIST_FMT_VERSION, r.count);
+  delete src;
+  if (ok) LittleFS.remove(oldPath);
+  return ok;
+}
+
+inline bool _storagePackInit(HistPackRing &r) {
+  r.ready = false;
+  // A v1 file is parked under HIST_LEGACY_FILE and converted; a leftover
+  // legacy file means an earlier migration was interrupted, so redo it.
+  // v1 predates multi-tank support, so only tank 0 can have one.
+  bool tank0 = &r == &_ringHourly0;
+  if (tank0 && !LittleFS.exists(HIST_LEGACY_FILE) &&
+      storageValidateRingFile(r.path, HIST_LEGACY_MAX_REC, nullptr, HIST_V1_REC_SIZE)) {
+    LittleFS.rename(r.path, HIST_LEGACY_FILE);
+  }
+  if (tank0 && LittleFS.exists(HIST_LEGACY_FILE)) {
+    if (_storagePackMigrate(r, HIST_LEGACY_FILE)) return true;
+    dbgPrintln(F("[HIST] v1 migration failed, starting empty"));
+    LittleFS.remove(HIST_LEGACY_FILE);
+  }
+  // Older packed versions are parked as "<path>.old" and re-encoded the
+  // same way.
+  String oldPath = String(r.path) + ".old";
+  if (LittleFS.exists(oldPath.c_str())) {
+    if (_storagePackUpgrade(r, oldPath.c_str())) return true;
+    dbgPrintf("[HIST] %s upgrade failed, starting empty\n", r.path);
+    LittleFS.remove(oldPath.c_str());
+  }
+  // Recreate history if file format/size changed (e.g. firmware upgrade).
+  if (LittleFS.exists(r.path)) {
+    if (_storagePackLoad(r)) {
+      if (r.hdr.version == HIST_FMT_VERSION) return true;
+      r.ready = false;
+      LittleFS.rename(r.path, oldPath.c_str());
+      if (_storagePackUpgrade(r, oldPath.c_str())) return true;
+      LittleFS.remove(oldPath.c_str());
+    }
+    LittleFS.remove(r.path);
+  }
+  return _storagePackCreate(r);
+}
+
+inline void _storagePackWrite(HistPackRing &r, const HistRecord &rec) {
+  if (!r.ready && !_storagePackInit(r)) return;
+  File f = LittleFS.open(r.path, "r+");
+  if (!f) {
+    if (!_storagePackInit(r)) return;
+    f = LittleFS.open(r.path, "r+");
+    if (!f) return;
+  }
+  bool ok = _storagePackAppend(r, f, rec, true);
+  f.close();
+  dataGenerationBump();
+  if (!ok) r.ready = false;   // reload from flash on next access
+}
+
+// Restore the hourly ring from an upload (packed v2/v3 or legacy v1 file).
+inline bool storageReplaceRingFile(const char *tmpPath, HistPackRing &r) {
+  bool packed = storageValidatePackFile(tmpPath);
+  if (!packed &&
+      !storageValidateRingFile(tmpPath, HIST_LEGACY_MAX_REC, nullptr, HIST_V1_REC_SIZE)) return false;
+  r.ready = false;
+  bool tank0 = &r == &_ringHourly0;
+  if (tank0) LittleFS.remove(HIST_LEGACY_FILE);
+  LittleFS.remove((String(r.path) + ".old").c_str());
+  bool ok;
+  if (packed) {
+    ok = _storageMoveFile(tmpPath, r.path);
+    ok = _storagePackInit(r) && ok;
+  } else {
+    // _storagePackInit() only looks for a v1 file on tank 0, so convert it
+    // here for any tank. Tank 0 parks it first, so that an interrupted
+    // conversion is redone at boot.
+    const char *src = tank0 ? HIST_LEGACY_FILE : tmpPath;
+    ok = (!tank0 || _storageMoveFile(tmpPath, src)) && _storagePackMigrate(r, src);
+    if (!ok) {
+      LittleFS.remove(src);
+      _storagePackInit(r);
+    }
+  }
+  dataGenerationBump();
+  return ok;
+}
+
+// Records the hourly ring can hold at the current average record size.
+inline uint32_t _storagePackCapacity(const HistPackRing &r) {
+  uint32_t total = (uint32_t)HIST_BLOCKS * HIST_BLOCK_PAYLOAD;
+  uint32_t bytes = r.hdr.blocks ? (uint32_t)(r.hdr.blocks - 1) * HIST_BLOCK_PAYLOAD + r.open.h.used : 0;
+  if (!r.count || !bytes) return total / 4;   // ~4 B per record before any data
+  return (uint32_t)((uint64_t)r.count * total / bytes);
+}
+
+inline uint32_t storageCapacity(uint8_t tank = 0) { return _storagePackCapacity(storageHourlyRing(tank)); }
+
+inline uint32_t _storageRingCapacity(const HistRing &r) { return r.maxRec; }
+inline uint32_t _storageRingCapacity(const HistPackRing &r) { return _storagePackCapacity(r); }
+
+inline void _storageAggInit(uint8_t tank);
+
+// Open (creating if needed) the rings of tanks [0, tanks). Rings of other
+// tanks are created lazily on first write, so unused channels cost no flash.
+inline void storageInit(uint8_t tanks = 1) {
+  if (tanks > TANK_MAX) tanks = TANK_MAX;
+  for (uint8_t t = 0; t < tanks; t++) {
+    _storagePackInit(storageHourlyRing(t));
+    _storageInitRing(_ringRecent[t]);
+    _storageAggInit(t);
+  }
+}
+
+inline void _storageAppendRing(HistRing &r, const void *rec) {
+  if (!r.ready && !_storageInitRing(r)) return;
+  File f = LittleFS.open(r.path, "r+");
+  if (!f) {
+    // File vanished behind our back: rebuild it and the cached header.
+    if (!_storageInitRing(r)) return;
+    f = LittleFS.open(r.path, "r+");
     if (!f) return;
-    f.read((uint8_t*)&hdr, sizeof(hdr));
   }
 
-  HistRecord rec = { s.timestamp, s.level_pct, s.volume_liters, s.temp_c };
-  uint32_t pos = sizeof(hdr) + hdr.head * sizeof(HistRecord);
+  HistHeader hdr = r.hdr;
+  uint32_t hdrPos = _storageRingHdrPos(r.version);
+  uint32_t pos = hdrPos + sizeof(hdr) + (uint32_t)hdr.head * r.recSize;
   f.seek(pos);
-  f.write((uint8_t*)&rec, sizeof(rec));
+  bool ok = f.write((const uint8_t*)rec, r.recSize) == r.recSize;
 
-  hdr.head = (hdr.head + 1) % maxRec;
-  if (hdr.count < maxRec) hdr.count++;
+  hdr.head = (hdr.head + 1) % r.maxRec;
+  if (hdr.count < r.maxRec) hdr.count++;
 
-  f.seek(0);
-  f.write((uint8_t*)&hdr, sizeof(hdr));
+  f.seek(hdrPos);
+  ok = ok && f.write((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr);
   f.close();
+  dataGenerationBump();
+  if (ok) r.hdr = hdr;
+  else    r.ready = false;   // reload from flash on next access
+}
+
+inline void _storageWriteRing(HistRing &r, const SensorData &s) {
+  HistRecord rec = histRecordOf(s);
+  _storageAppendRing(r, &rec);
 }
 
 inline void storageWrite(const SensorData &s) {
-  _storageWriteRing(HIST_FILE, MAX_REC, s);
+  // Unsynced clock: such a record would break the time ordering the index relies on.
+  if (s.timestamp < HIST_TS_VALID_MIN) return;
+  HistRecord rec = histRecordOf(s);
+  _storagePackWrite(storageHourlyRing(s.tank), rec);
 }
 
 inline void storageWriteRecent(const SensorData &s) {
-  _storageWriteRing(HIST_RECENT_FILE, MAX_RECENT_REC, s);
+  _storageWriteRing(storageRecentRing(s.tank), s);
+}
+
+// Served from the cached header, no flash access.
+inline uint16_t _storageCountRing(const HistRing &r) {
+  return r.ready ? r.hdr.count : 0;
+}
+
+inline uint16_t _storageCountRing(const HistPackRing &r) {
+  return r.ready ? r.count : 0;
 }
 
+inline bool _storageEnsureRing(HistRing &r) { return r.ready || _storageInitRing(r); }
+inline bool _storageEnsureRing(HistPackRing &r) { return r.ready || _storagePackInit(r); }
+
 // Read last `n` records (newest first) into out[]. Returns actual count.
-inline int _storageReadRing(const char *path, uint16_t maxRec, HistRecord *out, int n) {
-  File f = LittleFS.open(path, "r");
-  if (!f) return 0;
+template <typename Ring>
+inline int _storageReadRing(Ring &r, HistRecord *out, int n) {
+  if (n <= 0 || !_storageEnsureRing(r)) return 0;
+  uint16_t total = _storageCountRing(r);
+  uint16_t cnt = (uint16_t)min((int)total, n);
+  HistCursor &cur = storageCursor();
+  if (!storageCursorOpen(cur, r, true, total - cnt, cnt)) return 0;
+  int got = 0;
+  while (got < cnt && storageCursorNext(cur, out[got])) got++;
+  storageCursorClose(cur);
+  return got;
+}
 
-  HistHeader hdr;
-  if (f.size() != (size_t)(sizeof(HistHeader) + (size_t)maxRec * sizeof(HistRecord)) ||
-      f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) ||
-      hdr.head >= maxRec || hdr.count > maxRec) {
-    f.close();
-    LittleFS.remove(path);
-    _storageInitRing(path, maxRec);
-    return 0;
-  }
-  if (hdr.count == 0) { f.close(); return 0; }
-
-  int cnt = min((int)hdr.count, n);
-  for (int i = 0; i < cnt; i++) {
-    yield(); // avoid WDT on slow LittleFS seeks
-    // Newest is (head-1), going backwards
-    int idx = ((int)hdr.head - 1 - i + maxRec) % maxRec;
-    f.seek(sizeof(hdr) + idx * sizeof(HistRecord));
-    f.read((uint8_t*)&out[i], sizeof(HistRecord));
+inline int storageRead(HistRecord *out, int n, uint8_t tank = 0) {
+  return _storageReadRing(storageHourlyRing(tank), out, n);
+}
+
+inline int storageReadRecent(HistRecord *out, int n, uint8_t tank = 0) {
+  return _storageReadRing(storageRecentRing(tank), out, n);
+}
+
+inline uint16_t storageCount(uint8_t tank = 0) { return _storageCountRing(storageHourlyRing(tank)); }
+
+// ------------------------------------------------------------------
+// Time lookups on the hourly ring. Records are appended in time order, so
+// the RAM block index (first timestamp per block, one entry per ~80
+// records) narrows a lookup to one block by binary search; only that
+// block is then read and decoded.
+// ------------------------------------------------------------------
+
+// Logical index of the first hourly record with ts >= `ts`
+// (storageCount() if there is none).
+inline uint16_t storageFindFirstAtOrAfter(uint32_t ts, uint8_t tank = 0) {
+  HistPackRing &r = storageHourlyRing(tank);
+  if (!_storageEnsureRing(r) || !r.count) return 0;
+  uint16_t oldest = _storagePackOldest(r);
+  // First block starting at or after `ts`; the answer lies in the block before it.
+  uint16_t lo = 0, hi = r.hdr.blocks;
+  while (lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    if (r.blkTs0[(oldest + mid) % HIST_BLOCKS] < ts) lo = mid + 1;
+    else                                              hi = mid;
+  }
+  if (lo == 0) return 0;
+  uint16_t base = 0;
+  for (uint16_t lb = 0; lb + 1 < lo; lb++) base += r.blkCount[(oldest + lb) % HIST_BLOCKS];
+  uint8_t cnt = r.blkCount[(oldest + lo - 1) % HIST_BLOCKS];
+
+  HistCursor &cur = storageCursor();
+  uint16_t idx = base;
+  if (storageCursorOpen(cur, r, false, base, cnt)) {
+    HistRecord rec;
+    while (storageCursorNext(cur, rec) && rec.ts < ts) idx++;
+    storageCursorClose(cur);
+  }
+  return idx;
+}
+
+// Logical range [first, first + n) of hourly records with from <= ts < to.
+inline void storageFindRange(uint32_t from, uint32_t to, uint16_t &first, uint16_t &n,
+                             uint8_t tank = 0) {
+  first = storageFindFirstAtOrAfter(from, tank);
+  uint16_t end = (to > from) ? storageFindFirstAtOrAfter(to, tank) : first;
+  n = (end > first) ? end - first : 0;
+}
+
+// Forward cursor over hourly records with from <= ts < to.
+inline bool storageCursorOpenRange(HistCursor &c, uint32_t from, uint32_t to, uint8_t tank = 0) {
+  uint16_t first, n;
+  storageFindRange(from, to, first, n, tank);
+  return n && storageCursorOpen(c, storageHourlyRing(tank), false, first, n);
+}
+inline uint16_t storageCountRecent(uint8_t tank = 0) { return _storageCountRing(storageRecentRing(tank)); }
+
+// ------------------------------------------------------------------
+// Rollup tiers
+//
+// Every measurement is folded into running min/max/avg/last aggregates for
+// the current local hour, day and month. When a period closes its aggregate
+// is appended to the tier's own fixed-record ring. Open periods live in RAM
+// and are checkpointed to HIST_AGG_STATE_FILE whenever an hour closes, so a
+// reboot loses at most the current hour of accumulation.
+// ------------------------------------------------------------------
+#define HIST_AGG_HOUR_FILE   "/hist_h.bin"
+#define HIST_AGG_DAY_FILE    "/hist_d.bin"
+#define HIST_AGG_MONTH_FILE  "/hist_m.bin"
+#define HIST_AGG_STATE_FILE  "/hist_agg.bin"
+#define HIST_AGG_HOUR_REC    744   // 31 days
+#define HIST_AGG_DAY_REC     400   // ~13 months
+#define HIST_AGG_MONTH_REC   120   // 10 years
+#define HIST_AGG_STATE_MAGIC 0xA9
+#define HIST_AGG_NO_TEMP     INT16_MIN
+
+enum HistTier : uint8_t { TIER_HOUR = 0, TIER_DAY, TIER_MONTH, TIER_COUNT };
+
+struct HistAggRecord {
+  uint32_t ts;        // period start (local time boundary)
+  uint16_t n;         // measurements folded in (saturates at 65535)
+  int16_t  lvMin;     // 0.1 %
+  int16_t  lvMax;
+  int16_t  lvAvg;
+  int16_t  lvLast;
+  int16_t  tempAvg;   // 0.1 °C, HIST_AGG_NO_TEMP if no reading
+  float    volAvg;    // L
+  float    volLast;   // L
+};
+static_assert(sizeof(HistAggRecord) == 24, "HistAggRecord layout is part of the file format");
+
+// Running aggregate of the open period.
+struct HistAggAcc {
+  uint32_t start;     // period start, 0 = nothing accumulated
+  uint32_t n;
+  uint32_t nTemp;
+  float    lvMin, lvMax, lvLast, volLast;
+  double   lvSum, volSum, tempSum;
+};
+
+struct HistAggState {
+  uint8_t    magic;
+  uint8_t    tiers;
+  uint16_t   reserved;
+  HistAggAcc acc[TIER_COUNT];
+};
+
+static HistRing _ringAgg[TANK_MAX][TIER_COUNT] = {
+  {
+    { HIST_AGG_HOUR_FILE,  HIST_AGG_HOUR_REC,  sizeof(HistAggRecord), {0, 0}, false },
+    { HIST_AGG_DAY_FILE,   HIST_AGG_DAY_REC,   sizeof(HistAggRecord), {0, 0}, false },
+    { HIST_AGG_MONTH_FILE, HIST_AGG_MONTH_REC, sizeof(HistAggRecord), {0, 0}, false },
+  }, {
+    { "/hist_h_t1.bin",    HIST_AGG_HOUR_REC,  sizeof(HistAggRecord), {0, 0}, false },
+    { "/hist_d_t1.bin",    HIST_AGG_DAY_REC,   sizeof(HistAggRecord), {0, 0}, false },
+    { "/hist_m_t1.bin",    HIST_AGG_MONTH_REC, sizeof(HistAggRecord), {0, 0}, false },
+  }, {
+    { "/hist_h_t2.bin",    HIST_AGG_HOUR_REC,  sizeof(HistAggRecord), {0, 0}, false },
+    { "/hist_d_t2.bin",    HIST_AGG_DAY_REC,   sizeof(HistAggRecord), {0, 0}, false },
+    { "/hist_m_t2.bin",    HIST_AGG_MONTH_REC, sizeof(HistAggRecord), {0, 0}, false },
+  },
+};
+static const char *const _histAggStatePath[TANK_MAX] = {
+  HIST_AGG_STATE_FILE, "/hist_agg_t1.bin", "/hist_agg_t2.bin"
+};
+static HistAggAcc _histAcc[TANK_MAX][TIER_COUNT];
+
+// Nominal period length, used to pick a tier for a requested resolution.
+inline uint32_t storageTierPeriod(uint8_t tier) {
+  return tier == TIER_HOUR ? 3600UL : tier == TIER_DAY ? 86400UL : 30UL * 86400UL;
+}
+
+inline const char *storageTierName(uint8_t tier) {
+  return tier == TIER_HOUR ? "hour" : tier == TIER_DAY ? "day" : "month";
+}
+
+// Start of the local hour/day/month containing `ts` (DST-aware via mktime).
+inline uint32_t _histPeriodStart(uint32_t ts, uint8_t tier) {
+  time_t t = (time_t)ts;
+  struct tm tm;
+  if (!localtime_r(&t, &tm)) return 0;
+  if (tier == TIER_HOUR) return ts - (uint32_t)(tm.tm_min * 60 + tm.tm_sec);
+  tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+  if (tier == TIER_MONTH) tm.tm_mday = 1;
+  tm.tm_isdst = -1;
+  return (uint32_t)mktime(&tm);
+}
+
+inline void _histAccReset(HistAggAcc &a, uint32_t start) {
+  memset(&a, 0, sizeof(a));
+  a.start = start;
+}
+
+inline void _histAccAdd(HistAggAcc &a, const SensorData &s) {
+  if (a.n == 0 || s.level_pct < a.lvMin) a.lvMin = s.level_pct;
+  if (a.n == 0 || s.level_pct > a.lvMax) a.lvMax = s.level_pct;
+  a.n++;
+  a.lvSum  += s.level_pct;
+  a.volSum += s.volume_liters;
+  a.lvLast  = s.level_pct;
+  a.volLast = s.volume_liters;
+  if (!isnan(s.temp_c)) { a.tempSum += s.temp_c; a.nTemp++; }
+}
+
+inline HistAggRecord _histAccRecord(const HistAggAcc &a) {
+  HistAggRecord r;
+  r.ts      = a.start;
+  r.n       = a.n > 0xFFFF ? 0xFFFF : (uint16_t)a.n;
+  r.lvMin   = (int16_t)_histQ(a.lvMin);
+  r.lvMax   = (int16_t)_histQ(a.lvMax);
+  r.lvAvg   = a.n ? (int16_t)_histQ((float)(a.lvSum / a.n)) : 0;
+  r.lvLast  = (int16_t)_histQ(a.lvLast);
+  r.tempAvg = a.nTemp ? (int16_t)_histQ((float)(a.tempSum / a.nTemp)) : HIST_AGG_NO_TEMP;
+  r.volAvg  = a.n ? (float)(a.volSum / a.n) : 0;
+  r.volLast = a.volLast;
+  return r;
+}
+
+inline void _storageAggSaveState(uint8_t tank) {
+  HistAggState st;
+  memset(&st, 0, sizeof(st));
+  st.magic = HIST_AGG_STATE_MAGIC;
+  st.tiers = TIER_COUNT;
+  memcpy(st.acc, _histAcc[tank], sizeof(st.acc));
+  File f = LittleFS.open(_histAggStatePath[tank], "w");
+  if (!f) return;
+  f.write((uint8_t*)&st, sizeof(st));
+  f.close();
+}
+
+inline void _storageAggInit(uint8_t tank) {
+  for (uint8_t t = 0; t < TIER_COUNT; t++) {
+    _storageInitRing(_ringAgg[tank][t]);
+    _histAccReset(_histAcc[tank][t], 0);
+  }
+  File f = LittleFS.open(_histAggStatePath[tank], "r");
+  if (!f) return;
+  HistAggState st;
+  if (f.size() == sizeof(st) &&
+      f.read((uint8_t*)&st, sizeof(st)) == sizeof(st) &&
+      st.magic == HIST_AGG_STATE_MAGIC && st.tiers == TIER_COUNT) {
+    memcpy(_histAcc[tank], st.acc, sizeof(_histAcc[tank]));
   }
   f.close();
-  return cnt;
 }
 
-inline int storageRead(HistRecord *out, int n) {
-  return _storageReadRing(HIST_FILE, MAX_REC, out, n);
+// Fold one measurement into every tier, closing periods it has moved past.
+inline void storageRollupAdd(const SensorData &s) {
+  if (!s.valid || s.timestamp < HIST_TS_VALID_MIN) return;
+  uint8_t tank = _storageTank(s.tank);
+  bool checkpoint = false;
+  for (uint8_t t = 0; t < TIER_COUNT; t++) {
+    HistAggAcc &a = _histAcc[tank][t];
+    uint32_t start = _histPeriodStart(s.timestamp, t);
+    if (a.start != start) {
+      if (a.n && start > a.start) {
+        HistAggRecord rec = _histAccRecord(a);
+        _storageAppendRing(_ringAgg[tank][t], &rec);
+      } else if (a.n) {
+        dbgPrintf("[HIST] clock moved back, dropping open %s aggregate\n", storageTierName(t));
+      }
+      if (t == TIER_HOUR) checkpoint = true;
+      _histAccReset(a, start);
+    }
+    _histAccAdd(a, s);
+  }
+  if (checkpoint) _storageAggSaveState(tank);
 }
 
-inline int storageReadRecent(HistRecord *out, int n) {
-  return _storageReadRing(HIST_RECENT_FILE, MAX_RECENT_REC, out, n);
+inline uint16_t storageAggCount(uint8_t tier, uint8_t tank = 0) {
+  return tier < TIER_COUNT ? _storageCountRing(_ringAgg[_storageTank(tank)][tier]) : 0;
 }
 
-inline uint16_t _storageCountRing(const char *path, uint16_t maxRec) {
-  File f = LittleFS.open(path, "r");
-  if (!f) return 0;
-  HistHeader hdr;
-  if (f.size() != (size_t)(sizeof(HistHeader) + (size_t)maxRec * sizeof(HistRecord)) ||
-      f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) ||
-      hdr.head >= maxRec || hdr.count > maxRec) {
-    f.close();
-    LittleFS.remove(path);
-    _storageInitRing(path, maxRec);
-    return 0;
+// Reads records [first, first + n) of ring `r`, logical 0 = oldest, from the
+// already open `f`. The caller has clamped n to the count.
+inline int _storageAggReadFile(File &f, const HistRing &r, uint16_t first,
+                               HistAggRecord *out, int n) {
+  uint16_t oldest = (uint16_t)(((int)r.hdr.head - (int)r.hdr.count + r.maxRec) % r.maxRec);
+  int got = 0;
+  // At most two spans: up to the physical end of file, then from its start.
+  while (got < n) {
+    uint16_t phys = (uint16_t)(((uint32_t)oldest + first + got) % r.maxRec);
+    int run = r.maxRec - phys;
+    if (run > n - got) run = n - got;
+    size_t bytes = (size_t)run * sizeof(HistAggRecord);
+    if (!f.seek(sizeof(HistHeader) + (uint32_t)phys * sizeof(HistAggRecord)) ||
+        f.read((uint8_t*)(out + got), bytes) != bytes) break;
+    got += run;
+  }
+  return got;
+}
+
+// Read closed aggregates [first, first + n) of `tier`, logical 0 = oldest,
+// in chronological order. Returns the number of records read.
+inline int storageAggRead(uint8_t tier, uint16_t first, HistAggRecord *out, int n,
+                          uint8_t tank = 0) {
+  if (tier >= TIER_COUNT || n <= 0) return 0;
+  HistRing &r = _ringAgg[_storageTank(tank)][tier];
+  if (!_storageEnsureRing(r) || first >= r.hdr.count) return 0;
+  if (n > r.hdr.count - first) n = r.hdr.count - first;
+  File f = LittleFS.open(r.path, "r");
+  if (!f) { r.ready = false; return 0; }
+  int got = _storageAggReadFile(f, r, first, out, n);
+  f.close();
+  return got;
+}
+
+// Logical index of the first closed aggregate with ts >= `ts` (count if none).
+// One open for the whole search; each probe is a seek and one record read.
+inline uint16_t storageAggLowerBound(uint8_t tier, uint32_t ts, uint8_t tank = 0) {
+  if (tier >= TIER_COUNT) return 0;
+  HistRing &r = _ringAgg[_storageTank(tank)][tier];
+  if (!_storageEnsureRing(r) || !r.hdr.count) return 0;
+  uint16_t lo = 0, hi = r.hdr.count;
+  File f = LittleFS.open(r.path, "r");
+  if (!f) { r.ready = false; return hi; }
+  while (lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    HistAggRecord rec;
+    if (_storageAggReadFile(f, r, mid, &rec, 1) != 1) { lo = r.hdr.count; break; }
+    if (rec.ts < ts) lo = mid + 1;
+    else             hi = mid;
   }
   f.close();
-  return hdr.count;
+  return lo;
 }
 
-inline uint16_t storageCount() { return _storageCountRing(HIST_FILE, MAX_REC); }
-inline uint16_t storageCountRecent() { return _storageCountRing(HIST_RECENT_FILE, MAX_RECENT_REC); }
+// Snapshot of the still-open period of `tier`; false if nothing accumulated.
+inline bool storageAggOpen(uint8_t tier, HistAggRecord &out, uint8_t tank = 0) {
+  tank = _storageTank(tank);
+  if (tier >= TIER_COUNT || !_histAcc[tank][tier].n) return false;
+  out = _histAccRecord(_histAcc[tank][tier]);
+  return true;
+}
 
-inline void storageClear() {
-  LittleFS.remove(HIST_FILE);
-  LittleFS.remove(HIST_RECENT_FILE);
-  storageInit();
+// Drop the history of every tank; rings of tanks [0, tanks) are recreated.
+inline void storageClear(uint8_t tanks = 1) {
+  LittleFS.remove(HIST_LEGACY_FILE);
+  for (uint8_t k = 0; k < TANK_MAX; k++) {
+    LittleFS.remove(_ringHourlyPath[k]);
+    LittleFS.remove((String(_ringHourlyPath[k]) + ".old").c_str());
+    LittleFS.remove(_ringRecent[k].path);
+    LittleFS.remove((String(_ringRecent[k].path) + ".old").c_str());
+    for (uint8_t t = 0; t < TIER_COUNT; t++) LittleFS.remove(_ringAgg[k][t].path);
+    LittleFS.remove(_histAggStatePath[k]);
+    if (_ringHourly[k]) _ringHourly[k]->ready = false;
+    _ringRecent[k].ready = false;
+    for (uint8_t t = 0; t < TIER_COUNT; t++) {
+      _ringAgg[k][t].ready = false;
+      _histAccReset(_histAcc[k][t], 0);
+    }
+  }
+  storageInit(tanks);
+  dataGenerationBump();
 }
@@ -0,0 +1,266 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include "debug_log.h"
+
+// ------------------------------------------------------------------
+// Telegram Bot API transport: one HTTPS request at a time over a kept-
+// alive BearSSL connection, advanced by tgHttpPoll() on every loop() pass.
+// The TLS session is cached, so when the server has dropped the idle
+// connection the reconnect is an abbreviated handshake (no key exchange,
+// a fraction of the full one on the ESP8266). connect() itself still
+// blocks for that handshake; sending the request and collecting the
+// response only touch bytes that are already there, so a slow server
+// never holds up loop().
+// TG_API_HOST / TG_API_PORT can be set with build flags to point the
+// client at a local HTTPS stand-in.
+// ------------------------------------------------------------------
+#ifndef TG_API_HOST
+#define TG_API_HOST      "api.telegram.org"
+#endif
+#ifndef TG_API_PORT
+#define TG_API_PORT      443
+#endif
+#define TG_RX_MAX        2048     // largest response kept, bytes (allocated per request)
+#define TG_IO_TMO_MS     5000UL   // request sent → response complete
+#define TG_IDLE_CLOSE_MS 30000UL  // close a connection unused for this long (frees BearSSL buffers)
+
+enum TgHttpState : uint8_t { TGH_IDLE, TGH_HEAD, TGH_BODY, TGH_DONE, TGH_FAIL };
+
+// Chunked body decoder steps (TgHttp::chunk when no chunk data is pending)
+#define TG_CHUNK_SIZE    -1L      // expecting a chunk-size line
+#define TG_CHUNK_CRLF    -2L      // expecting the CRLF that ends chunk data
+#define TG_CHUNK_TRAILER -3L      // after the last chunk, up to the blank line
+
+struct TgHttp {
+  TgHttpState   state;
+  uint8_t       tag;        // caller's request kind, reported back with the result
+  bool          reused;     // sent over an already open connection
+  bool          retried;    // resent once after a stale keep-alive connection
+  bool          close;      // server asked to close after this response
+  bool          chunked;    // Transfer-Encoding: chunked
+  int           status;     // HTTP status code
+  long          bodyLen;    // Content-Length, -1 = chunked or body ends at close
+  long          chunk;      // chunked: data bytes left in the current chunk, or a TG_CHUNK_* step
+  uint16_t      body;       // chunked: decoded body bytes at the start of rx
+  char         *rx;         // response, headers stripped once parsed; NUL-terminated
+  uint16_t      rxLen;
+  unsigned long tStart;     // millis() when the request was sent
+  unsigned long tUsed;      // millis() of the last request on the connection
+
+  uint32_t      requests;
+  uint32_t      fails;
+  uint32_t      connects;
+  uint32_t      lastHsMs;   // duration of the last connect (handshake)
+  uint32_t      maxHsMs;
+};
+
+static WiFiClientSecure _tgClient;
+static BearSSL::Session _tgSession;
+static TgHttp           _tgHttp = {};
+static String           _tgHttpReq;   // kept until done, for the one resend
+
+inline const TgHttp &tgHttpStats() { return _tgHttp; }
+inline bool tgHttpBusy() { return _tgHttp.state != TGH_IDLE; }
+
+inline void tgHttpSetup() {
+  _tgClient.setInsecure();             // skip cert check — saves memory on ESP8266
+  _tgClient.setBufferSizes(1024, 512); // reduce BearSSL RAM usage on ESP8266
+  _tgClient.setSession(&_tgSession);   // resume instead of a full handshake
+  _tgClient.setTimeout(TG_IO_TMO_MS);
+}
+
+static bool _tgHttpSend() {
+  _tgHttp.reused = _tgClient.connected();
+  if (!_tgHttp.reused) {
+    unsigned long t0 = millis();
+    bool ok = _tgClient.connect(TG_API_HOST, TG_API_PORT);
+    _tgHttp.lastHsMs = millis() - t0;
+    if (_tgHttp.lastHsMs > _tgHttp.maxHsMs) _tgHttp.maxHsMs = _tgHttp.lastHsMs;
+    _tgHttp.connects++;
+    if (!ok) {
+      dbgPrintf("[TG] connect failed (%lu ms)\n", (unsigned long)_tgHttp.lastHsMs);
+      return false;
+    }
+  }
+  size_t n = _tgClient.write((const uint8_t *)_tgHttpReq.c_str(), _tgHttpReq.length());
+  _tgHttp.tStart = _tgHttp.tUsed = millis();
+  return n == _tgHttpReq.length();
+}
+
+static void _tgHttpFail(const __FlashStringHelper *why) {
+  dbgPrintf("[TG] request failed: %s\n", String(why).c_str());
+  _tgClient.stop();
+  _tgHttp.state = TGH_FAIL;
+  _tgHttp.fails++;
+}
+
+// Start a request; `body` (JSON) makes it a POST. False if the transport
+// is busy; a failed connect is reported through tgHttpPoll() like any
+// other failure.
+inline bool tgHttpStart(uint8_t tag, const String &path, const String &body = String()) {
+  if (tgHttpBusy()) return false;
+  _tgHttp.rx = (char *)malloc(TG_RX_MAX + 1);
+  _tgHttp.tag     = tag;
+  _tgHttp.retried = false;
+  _tgHttp.close   = false;
+  _tgHttp.chunked = false;
+  _tgHttp.status  = 0;
+  _tgHttp.bodyLen = -1;
+  _tgHttp.rxLen   = 0;
+  _tgHttp.requests++;
+  if (!_tgHttp.rx) {
+    _tgHttp.state = TGH_FAIL;
+    _tgHttp.fails++;
+    return true;
+  }
+  _tgHttp.rx[0] = '\0';
+
+  _tgHttpReq = String();
+  _tgHttpReq.reserve(path.length() + body.length() + 128);
+  _tgHttpReq += body.length() ? F("POST ") : F("GET ");
+  _tgHttpReq += path;
+  _tgHttpReq += F(" HTTP/1.1\r\nHost: " TG_API_HOST "\r\nConnection: keep-alive\r\n");
+  if (body.length()) {
+    _tgHttpReq += F("Content-Type: application/json\r\nContent-Length: ");
+    _tgHttpReq += body.length();
+    _tgHttpReq += F("\r\n");
+  }
+  _tgHttpReq += F("\r\n");
+  _tgHttpReq += body;
+
+  _tgHttp.state = TGH_HEAD;
+  if (!_tgHttpSend()) _tgHttpFail(F("send"));
+  return true;
+}
+
+// Parse the status line and headers once the blank line is in rx; moves
+// the start of the body to rx[0]. False while headers are incomplete.
+// A keep-alive response that gives no way to find the end of its body
+// fails right away instead of running into the timeout.
+static bool _tgHttpHeaders() {
+  TgHttp &h = _tgHttp;
+  char *end = strstr(h.rx, "\r\n\r\n");
+  if (!end) return false;
+  *end = '\0';
+  for (char *p = h.rx; *p; p++) *p = tolower(*p);
+  const char *sp = strchr(h.rx, ' ');
+  h.status  = sp ? atoi(sp + 1) : 0;
+  h.close   = strstr(h.rx, "\r\nconnection: close") != nullptr;
+  h.chunked = strstr(h.rx, "\r\ntransfer-encoding: chunked") != nullptr;
+  const char *cl = strstr(h.rx, "\r\ncontent-length:");
+  if (h.chunked) {
+    h.chunk = TG_CHUNK_SIZE;
+    h.body  = 0;
+  } else if (cl) {
+    h.bodyLen = atol(cl + 17);
+  } else if (h.status == 204 || h.status == 304) {
+    h.bodyLen = 0;
+  } else if (!h.close) {
+    _tgHttpFail(F("no body length"));
+    return true;
+  }
+
+  uint16_t hdr = (end + 4) - h.rx;
+  h.rxLen -= hdr;
+  memmove(h.rx, end + 4, h.rxLen);
+  h.rx[h.rxLen] = '\0';
+  h.state = TGH_BODY;
+  return true;
+}
+
+// Decode the chunked body in place as it arrives: rx holds the decoded
+// bytes [0, body), then the input not decoded yet up to rxLen. Sets
+// TGH_DONE after the last chunk; false on malformed framing.
+static bool _tgHttpDechunk() {
+  TgHttp &h = _tgHttp;
+  uint16_t in = h.body;
+  while (in < h.rxLen && h.state == TGH_BODY) {
+    if (h.chunk > 0) {
+      uint16_t n = min((long)(h.rxLen - in), h.chunk);
+      memmove(h.rx + h.body, h.rx + in, n);
+      h.body  += n;
+      in      += n;
+      h.chunk -= n;
+      if (!h.chunk) h.chunk = TG_CHUNK_CRLF;
+      continue;
+    }
+    char *line = h.rx + in;
+    char *eol  = strstr(line, "\r\n");
+    if (!eol) break;                       // line not complete yet
+    in = eol + 2 - h.rx;
+    if (h.chunk == TG_CHUNK_CRLF) {
+      if (eol != line) return false;       // more data than the chunk size said
+      h.chunk = TG_CHUNK_SIZE;
+    } else if (h.chunk == TG_CHUNK_SIZE) {
+      char *e;
+      long n = strtol(line, &e, 16);       // chunk extensions after ';' are ignored
+      if (e == line || n < 0) return false;
+      h.chunk = n ? n : TG_CHUNK_TRAILER;
+    } else if (eol == line) {
+      h.state = TGH_DONE;                  // blank line after the last chunk
+    }
+  }
+  if (h.state == TGH_DONE) in = h.rxLen;   // nothing may follow on this connection
+  memmove(h.rx + h.body, h.rx + in, h.rxLen - in);
+  h.rxLen = h.body + (h.rxLen - in);
+  h.rx[h.rxLen] = '\0';
+  return true;
+}
+
+// Advance the request in flight. Returns true once it has finished
+// (TGH_DONE or TGH_FAIL); read the result from tgHttpStats() and call
+// tgHttpFinish(). Also closes a connection left idle too long.
+inline bool tgHttpPoll() {
+  TgHttp &h = _tgHttp;
+  if (h.state == TGH_IDLE) {
+    if (millis() - h.tUsed > TG_IDLE_CLOSE_MS && _tgClient.connected()) _tgClient.stop();
+    return false;
+  }
+  if (h.state == TGH_DONE || h.state == TGH_FAIL) return true;
+
+  int avail = _tgClient.available();
+  while (avail > 0 && h.rxLen < TG_RX_MAX) {
+    int n = _tgClient.read((uint8_t *)h.rx + h.rxLen, min(avail, (int)(TG_RX_MAX - h.rxLen)));
+    if (n <= 0) break;
+    h.rxLen += n;
+    h.rx[h.rxLen] = '\0';
+    avail = _tgClient.available();
+  }
+  if (h.state == TGH_HEAD) _tgHttpHeaders();
+  if (h.state == TGH_BODY && h.chunked && !_tgHttpDechunk()) _tgHttpFail(F("bad chunk"));
+  if (h.state == TGH_FAIL) return true;
+
+  if (h.state == TGH_BODY && h.bodyLen >= 0 && h.rxLen >= h.bodyLen) {
+    h.rx[h.bodyLen] = '\0';
+    h.rxLen = h.bodyLen;
+    h.state = TGH_DONE;
+  } else if (h.state == TGH_DONE) {
+    // last chunk decoded
+  } else if (h.rxLen >= TG_RX_MAX || h.bodyLen > TG_RX_MAX ||
+             (h.chunked && h.body + h.chunk > TG_RX_MAX)) {
+    _tgHttpFail(F("response too large"));
+  } else if (!avail && !_tgClient.connected()) {
+    if (h.state == TGH_BODY && h.bodyLen < 0 && !h.chunked) {
+      h.state = TGH_DONE;                        // body delimited by close
+    } else if (h.state == TGH_HEAD && !h.rxLen && h.reused && !h.retried) {
+      h.retried = true;                          // server dropped the idle connection
+      if (!_tgHttpSend()) _tgHttpFail(F("resend"));
+    } else {
+      _tgHttpFail(F("connection closed"));
+    }
+  } else if (millis() - h.tStart > TG_IO_TMO_MS) {
+    _tgHttpFail(F("timeout"));
+  }
+  if (h.state == TGH_DONE && h.close) _tgClient.stop();
+  return h.state == TGH_DONE || h.state == TGH_FAIL;
+}
+
+// Release the response buffer; the transport is idle again.
+inline void tgHttpFinish() {
+  free(_tgHttp.rx);
+  _tgHttp.rx    = nullptr;
+  _tgHttp.rxLen = 0;
+  _tgHttp.state = TGH_IDLE;
+  _tgHttpReq    = String();
+}
@@ -1,15 +1,26 @@
 #pragma once
 #include <Arduino.h>
-#include <WiFiClientSecure.h>
-#include <UniversalTelegramBot.h>
+#include <ArduinoJson.h>
 #include "config.h"
 #include "sensor.h"
+#include "telegram_client.h"
+#include "telegram_queue.h"
 
-static WiFiClientSecure   _tgClient;
-static UniversalTelegramBot *_tgBot = nullptr;
+// Bot logic on top of telegram_client.h: tgLoop() only asks for a poll
+// and tgSend() only queues (telegram_queue.h); tgPoll(), called on every
+// loop() pass, starts the next request when the transport is free
+// (queued messages first) and handles the response when it is complete.
+#define TG_MIN_HEAP   14000   // BearSSL + Telegram can be unstable below this
+#define TG_LATE_S     120     // a message sent later than this says when it was queued
+
+enum TgReq : uint8_t { TGR_UPDATES, TGR_SEND };
+
+static String              _tgToken;
 static unsigned long       _tgLastMsgId = 0;
 static bool                _tgEnabled   = false;
 static bool                _tgBacklogSynced = false;
+static bool                _tgPollWanted = false;
+static bool                _tgHeapWait   = false;
 static void              (*_tgMeasureCallback)() = nullptr;
 
 // Alert state (avoid sending repeated alerts)
@@ -19,29 +30,19 @@ static bool _alertHighSent = false;
 // ------------------------------------------------------------------
 inline void tgSetup(const Config &c) {
   if (!c.tg_en || strlen(c.tg_token) < 10) return;
-  _tgClient.setInsecure();   // skip cert check — saves memory on ESP8266
-  _tgClient.setBufferSizes(1024, 512); // reduce BearSSL RAM usage on ESP8266
-  _tgBot = new UniversalTelegramBot(c.tg_token, _tgClient);
-  _tgBot->longPoll = 0;          // avoid long blocking calls in loop()
-  _tgBot->waitForResponse = 1500;
-  _tgBot->maxMessageLength = 1200;
+  tgHttpSetup();
+  _tgToken = String(F("/bot")) + c.tg_token + '/';
   _tgLastMsgId = 0;
   _tgBacklogSynced = false;
   _tgEnabled = true;
   dbgPrintln(F("[TG] Telegram enabled"));
+  if (!tgQueueDepth()) tgQueueRestore();
 }
 
-inline void tgSend(const Config &c, const String &msg) {
-  if (!_tgEnabled || !_tgBot || strlen(c.tg_chat) == 0) return;
-  if (WiFi.status() != WL_CONNECTED) return;
-  // BearSSL + Telegram can be unstable on very low heap. Skip instead of risking reset.
-  if (ESP.getFreeHeap() < 14000) {
-    dbgPrintf("[TG] send skipped: low heap=%u\n", ESP.getFreeHeap());
-    return;
-  }
-  yield();
-  _tgBot->sendMessage(c.tg_chat, msg, "Markdown");
-  yield();
+// Queue a message for the configured chat; sent by tgPoll().
+inline void tgSend(const Config &c, const String &msg, TgMsgKind kind = TGM_TEXT) {
+  if (!_tgEnabled || strlen(c.tg_chat) == 0) return;
+  tgQueuePush(msg.c_str(), kind);
 }
 
 inline void tgSetMeasureCallback(void (*cb)()) {
@@ -56,13 +57,23 @@ static String _statusMsg(const Config &c, const SensorData &s) {
   m.reserve(256);
   m += F("📊 Уровень: *"); m += String(s.level_pct, 1); m += F("%*\n");
   m += F("📏 Расстояние: "); m += String(s.distance_cm, 1); m += F(" см\n");
-  if (c.barrel_diam_cm > 0) {
+  if (s.total_liters > 0) {
     m += F("🪣 Объём: "); m += String(s.volume_liters, 1); m += F(" л\n");
     m += F("⬜ Свободно: "); m += String(s.free_liters, 1); m += F(" л\n");
   }
   if (!isnan(s.temp_c)) {
     m += F("🌡 Температура: "); m += String(s.temp_c, 1); m += F(" °C\n");
   }
+  if (!isnan(s.water_c)) {
+    m += F("💧 Вода: "); m += String(s.water_c, 1); m += F(" °C\n");
+  }
+  if (!isnan(s.case_c)) {
+    m += F("📦 Корпус: "); m += String(s.case_c, 1); m += F(" °C\n");
+  }
+  if (measQualityPoor(s.quality)) {
+    m += F("⚠️ Слабое эхо: "); m += s.quality.valid; m += '/'; m += s.quality.attempted;
+    m += F(", разброс "); m += String(s.quality.sd_cm, 1); m += F(" см\n");
+  }
   m += F("🕒 Замер: ");
   time_t ts = (time_t)s.timestamp;
   struct tm *ti = localtime(&ts);
@@ -77,18 +88,65 @@ static String _statusMsg(const Config &c, const SensorData &s) {
 }
 
 // ------------------------------------------------------------------
-// Poll for new messages and respond
+// Commands
+// ------------------------------------------------------------------
+static void _tgCommand(const Config &c, const SensorData &s, String txt) {
+  txt.toLowerCase();
+
+  if (txt == "/level" || txt == "/уровень") {
+    String r = F("📊 Уровень: *"); r.reserve(96); r += String(s.level_pct, 1); r += F("%*");
+    if (s.total_liters > 0) { r += F("\n🪣 "); r += String(s.volume_liters, 1); r += F(" л"); }
+    tgSend(c, r, TGM_LEVEL);
+
+  } else if (txt == "/measure" || txt == "/замер" || txt == "/update" || txt == "/обновить") {
+    if (_tgMeasureCallback) _tgMeasureCallback();
+    tgSend(c, _statusMsg(c, s), TGM_STATUS);
+
+  } else if (txt == "/status" || txt == "/статус") {
+    tgSend(c, _statusMsg(c, s), TGM_STATUS);
+
+  } else if (txt == "/start" || txt == "/help" || txt == "/помощь") {
+    String h = F("*WaterSense Bot*\n\n");
+    h.reserve(256);
+    h += F("/level — текущий уровень\n");
+    h += F("/status — полный статус\n");
+    h += F("/measure — новый замер сейчас\n");
+    h += F("/help — эта справка\n\n");
+    h += F("🌐 Веб-интерфейс: http://");
+    h += WiFi.localIP().toString();
+    tgSend(c, h);
+
+  } else {
+    tgSend(c, F("Неизвестная команда. /help — список команд."));
+  }
+}
+
+// ------------------------------------------------------------------
+// Poll for new messages (getUpdates, one update per request, like the
+// long-standing HANDLE_MESSAGES=1 setup)
 // ------------------------------------------------------------------
 inline void tgLoop(const Config &c, const SensorData &s) {
-  if (!_tgEnabled || !_tgBot || !c.tg_cmd_en) return;
+  if (!_tgEnabled || !c.tg_cmd_en) return;
+  _tgPollWanted = true;
+}
+
+static void _tgOnUpdates(const Config &c, const SensorData &s, const char *body, uint16_t len) {
+  StaticJsonDocument<160> filter;
+  filter["result"][0]["update_id"] = true;
+  filter["result"][0]["message"]["chat"]["id"] = true;
+  filter["result"][0]["message"]["text"] = true;
+  DynamicJsonDocument doc(768);
+  if (deserializeJson(doc, body, len, DeserializationOption::Filter(filter))) {
+    dbgPrintln(F("[TG] bad getUpdates response"));
+    return;
+  }
+  JsonArray res = doc["result"];
 
   // On first poll after boot, skip any old backlog so the device does not try
   // to process stale commands accumulated while it was offline.
   if (!_tgBacklogSynced) {
-    int n0 = _tgBot->getUpdates(-1); // fetch at most the latest update (HANDLE_MESSAGES=1)
-    if (n0 > 0) {
-      telegramMessage &m0 = _tgBot->messages[n0 - 1];
-      _tgLastMsgId = m0.update_id;
+    if (res.size() > 0) {
+      _tgLastMsgId = res[res.size() - 1]["update_id"];
       dbgPrintf("[TG] Backlog synced to update_id=%lu\n", _tgLastMsgId);
     } else {
       dbgPrintln(F("[TG] Backlog sync: no pending updates"));
@@ -97,51 +155,85 @@ inline void tgLoop(const Config &c, const SensorData &s) {
     return;
   }
 
-  int n = _tgBot->getUpdates(_tgLastMsgId + 1);
-  for (int i = 0; i < n; i++) {
-    telegramMessage &msg = _tgBot->messages[i];
-    _tgLastMsgId = msg.update_id;
-
+  for (JsonObject u : res) {
+    _tgLastMsgId = u["update_id"];
     // Accept only from configured chat
-    if (strlen(c.tg_chat) && msg.chat_id != String(c.tg_chat)) continue;
-
-    String txt = msg.text;
-    txt.toLowerCase();
-
-    if (txt == "/level" || txt == "/уровень") {
-      String r = F("📊 Уровень: *"); r.reserve(96); r += String(s.level_pct, 1); r += F("%*");
-      if (c.barrel_diam_cm > 0) { r += F("\n🪣 "); r += String(s.volume_liters, 1); r += F(" л"); }
-      tgSend(c, r);
-
-    } else if (txt == "/measure" || txt == "/замер" || txt == "/update" || txt == "/обновить") {
-      if (_tgMeasureCallback) _tgMeasureCallback();
-      tgSend(c, _statusMsg(c, s));
-
-    } else if (txt == "/status" || txt == "/статус") {
-      tgSend(c, _statusMsg(c, s));
-
-    } else if (txt == "/start" || txt == "/help" || txt == "/помощь") {
-      String h = F("*WaterSense Bot*\n\n");
-      h.reserve(256);
-      h += F("/level — текущий уровень\n");
-      h += F("/status — полный статус\n");
-      h += F("/measure — новый замер сейчас\n");
-      h += F("/help — эта справка\n\n");
-      h += F("🌐 Веб-интерфейс: http://");
-      h += WiFi.localIP().toString();
-      tgSend(c, h);
+    long long chat = u["message"]["chat"]["id"];
+    if (strlen(c.tg_chat) && chat != strtoll(c.tg_chat, nullptr, 10)) continue;
+    _tgCommand(c, s, u["message"]["text"] | "");
+  }
+  // More may be waiting: ask again right away instead of after the period
+  if (res.size() > 0) _tgPollWanted = true;
+}
 
-    } else {
-      tgSend(c, F("Неизвестная команда. /help — список команд."));
+// Drive the transport; call on every loop() pass.
+inline void tgPoll(const Config &c, const SensorData &s) {
+  if (!_tgEnabled) return;
+  if (tgHttpPoll()) {
+    const TgHttp &h = tgHttpStats();
+    bool ok = h.state == TGH_DONE && h.status == 200;
+    if (h.state == TGH_DONE && !ok) dbgPrintf("[TG] HTTP %d\n", h.status);
+    if (h.tag == TGR_SEND) {
+      // Rate limit, server errors and transport failures are retried; any
+      // other rejection (bad chat id, bad Markdown) would fail again
+      bool retry = h.state == TGH_FAIL || h.status == 429 || h.status >= 500;
+      tgQueueDone(ok, !ok && !retry);
+    } else if (ok) {
+      _tgOnUpdates(c, s, h.rx, h.rxLen);
+    }
+    tgHttpFinish();
+  }
+  if (tgHttpBusy() || WiFi.status() != WL_CONNECTED) return;
+
+  int8_t slot = tgQueueNext();
+  if (slot >= 0) {
+    // Wait for memory instead of risking a reset; the message stays queued
+    uint32_t heap = ESP.getFreeHeap();
+    if (heap < TG_MIN_HEAP) {
+      if (!_tgHeapWait) dbgPrintf("[TG] send deferred: low heap=%u\n", heap);
+      _tgHeapWait = true;
+      return;
+    }
+    _tgHeapWait = false;
+    const TgMsg &m = tgQueueMsg(slot);
+    String text;
+    time_t now = time(nullptr);
+    if (m.ts && now > (time_t)m.ts + TG_LATE_S) {
+      time_t ts = (time_t)m.ts;
+      struct tm *ti = localtime(&ts);
+      char buf[20] = "";
+      if (ti) strftime(buf, sizeof(buf), "%d.%m %H:%M", ti);
+      text.reserve(m.len + 48);
+      text = m.text;
+      text += F("\n🕒 С задержкой, от ");
+      text += buf;
     }
+    StaticJsonDocument<64> doc;
+    doc["chat_id"]    = c.tg_chat;
+    doc["text"]       = text.length() ? text.c_str() : m.text;
+    doc["parse_mode"] = "Markdown";
+    String body;
+    body.reserve(m.len + 112);
+    serializeJson(doc, body);
+    tgQueueSending(slot);
+    tgHttpStart(TGR_SEND, _tgToken + F("sendMessage"), body);
+    return;
   }
+  if (!_tgPollWanted) return;
+
+  _tgPollWanted = false;
+  String path = _tgToken + F("getUpdates?limit=1&timeout=0&offset=");
+  if (_tgBacklogSynced) path += String(_tgLastMsgId + 1);
+  else                  path += F("-1");
+  tgHttpStart(TGR_UPDATES, path);
 }
 
 // ------------------------------------------------------------------
 // Check thresholds and send alert if needed
 // ------------------------------------------------------------------
 inline void tgCheckAlerts(const Config &c, const SensorData &s) {
-  if (!_tgEnabled || !s.valid) return;
+  // A poor reading (few echoes, wide spread) neither raises nor clears an alert
+  if (!_tgEnabled || !s.valid || measQualityPoor(s.quality)) return;
   if (!c.tg_alert_low_en) _alertLowSent = false;
   if (!c.tg_alert_high_en) _alertHighSent = false;
 
@@ -149,7 +241,7 @@ inline void tgCheckAlerts(const Config &c, const SensorData &s) {
     String m = F("⚠️ *Мало воды!*\nУровень: *");
     m += String(s.level_pct, 1); m += F("%* (порог ");
     m += String(c.tg_alert_low, 0); m += F("%)");
-    tgSend(c, m);
+    tgSend(c, m, TGM_ALERT);
     _alertLowSent  = true;
     _alertHighSent = false;
   } else if (s.level_pct >= c.tg_alert_low + 5.0f) {
@@ -160,7 +252,7 @@ inline void tgCheckAlerts(const Config &c, const SensorData &s) {
     String m = F("🔵 *Много воды!*\nУровень: *");
     m += String(s.level_pct, 1); m += F("%* (порог ");
     m += String(c.tg_alert_high, 0); m += F("%)");
-    tgSend(c, m);
+    tgSend(c, m, TGM_ALERT);
     _alertHighSent = true;
     _alertLowSent  = false;
   } else if (s.level_pct <= c.tg_alert_high - 5.0f) {
@@ -0,0 +1,224 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "debug_log.h"
+
+// ------------------------------------------------------------------
+// Outbound Telegram queue: a fixed pool of message slots, no heap use.
+// A message stays queued until the Bot API accepted it; failed sends are
+// retried with exponential backoff (the whole queue waits, the link is
+// shared). Kinds:
+//   TGM_STATUS, TGM_LEVEL — a newer reply of the same kind replaces the
+//                            queued one (only the latest status matters)
+//   TGM_ALERT             — sent first, never given up after failed sends,
+//                            and kept in TG_QUEUE_FILE across reboots
+//   TGM_TEXT              — everything else
+// When the pool is full the oldest non-alert message is dropped; an alert
+// may push out the oldest alert. Everything else is given up after
+// TG_MAX_TRIES failed sends.
+// ------------------------------------------------------------------
+#define TG_QUEUE_SLOTS   5
+#define TG_MSG_MAX       480        // bytes of text per slot, longer messages are cut
+#define TG_MAX_TRIES     8
+#define TG_RETRY_MIN_MS  2000UL     // first retry delay, doubled per failure
+#define TG_RETRY_MAX_MS  300000UL
+#define TG_QUEUE_FILE    "/tg_queue.bin"
+#define TG_QUEUE_MAGIC   0x71
+#define TG_QUEUE_VERSION 1
+
+enum TgMsgKind : uint8_t { TGM_TEXT, TGM_STATUS, TGM_LEVEL, TGM_ALERT };
+
+struct TgMsg {
+  bool     used;
+  uint8_t  kind;
+  uint8_t  tries;      // failed sends so far
+  uint16_t len;
+  uint32_t seq;        // queue order
+  uint32_t ts;         // UNIX time when queued, 0 if the clock was not set
+  char     text[TG_MSG_MAX + 1];
+};
+
+struct TgQueueStats {
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t dropped;    // pushed out of a full pool, rejected, or out of tries
+  uint32_t coalesced;  // replaced by a newer reply of the same kind
+  uint32_t retries;
+  uint32_t restored;   // alerts loaded from flash at boot
+};
+
+static TgMsg         _tgQ[TG_QUEUE_SLOTS];
+static TgQueueStats  _tgQStats = {};
+static uint32_t      _tgQSeq    = 0;
+static int8_t        _tgQBusy   = -1;   // slot being sent
+static uint8_t       _tgQFails  = 0;    // consecutive failed sends
+static unsigned long _tgQWaitFrom = 0, _tgQWaitMs = 0;
+
+inline const TgQueueStats &tgQueueStats() { return _tgQStats; }
+
+inline uint8_t tgQueueDepth() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) n += _tgQ[i].used;
+  return n;
+}
+
+// ms until the next send is allowed (0 = now)
+inline uint32_t tgQueueRetryIn() {
+  unsigned long el = millis() - _tgQWaitFrom;
+  return el < _tgQWaitMs ? _tgQWaitMs - el : 0;
+}
+
+// Rewrite TG_QUEUE_FILE with the queued alerts (removed when there are none).
+static void _tgQueueSave() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) n += _tgQ[i].used && _tgQ[i].kind == TGM_ALERT;
+  if (!n) {
+    LittleFS.remove(TG_QUEUE_FILE);
+    return;
+  }
+  File f = LittleFS.open(TG_QUEUE_FILE, "w");
+  if (!f) return;
+  uint8_t hdr[3] = { TG_QUEUE_MAGIC, TG_QUEUE_VERSION, n };
+  f.write(hdr, sizeof(hdr));
+  for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) {
+    const TgMsg &m = _tgQ[i];
+    if (!m.used || m.kind != TGM_ALERT) continue;
+    f.write((const uint8_t *)&m.ts, sizeof(m.ts));
+    f.write((const uint8_t *)&m.len, sizeof(m.len));
+    f.write((const uint8_t *)m.text, m.len);
+  }
+  f.close();
+}
+
+// Pick the slot for a new message of `kind`, or -1 to drop it.
+static int8_t _tgQueueSlot(uint8_t kind) {
+  int8_t oldest = -1, oldestAlert = -1;
+  for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) {
+    const TgMsg &m = _tgQ[i];
+    if (!m.used) return i;
+    if (i == _tgQBusy) continue;
+    int8_t &o = m.kind == TGM_ALERT ? oldestAlert : oldest;
+    if (o < 0 || (int32_t)(m.seq - _tgQ[o].seq) < 0) o = i;
+  }
+  if (oldest < 0 && kind == TGM_ALERT) oldest = oldestAlert;
+  if (oldest < 0) return -1;
+  dbgPrintf("[TG] queue full, dropped message #%lu\n", (unsigned long)_tgQ[oldest].seq);
+  _tgQStats.dropped++;
+  return oldest;
+}
+
+// Queue a message; false if it had to be dropped.
+inline bool tgQueuePush(const char *text, uint8_t kind) {
+  int8_t slot = -1;
+  if (kind == TGM_STATUS || kind == TGM_LEVEL) {
+    for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) {
+      if (_tgQ[i].used && _tgQ[i].kind == kind && i != _tgQBusy) {
+        slot = i;
+        _tgQStats.coalesced++;
+        break;
+      }
+    }
+  }
+  if (slot < 0) slot = _tgQueueSlot(kind);
+  if (slot < 0) {
+    dbgPrintln(F("[TG] queue full of alerts, message dropped"));
+    _tgQStats.dropped++;
+    return false;
+  }
+
+  TgMsg &m = _tgQ[slot];
+  bool wasAlert = m.used && m.kind == TGM_ALERT;
+  size_t len = strlen(text);
+  if (len > TG_MSG_MAX) {
+    len = TG_MSG_MAX;
+    while (len && (text[len] & 0xC0) == 0x80) len--;   // don't split a UTF-8 sequence
+  }
+  memcpy(m.text, text, len);
+  m.text[len] = '\0';
+  m.len   = len;
+  m.used  = true;
+  m.kind  = kind;
+  m.tries = 0;
+  m.seq   = ++_tgQSeq;
+  time_t now = time(nullptr);
+  m.ts    = now > 1600000000 ? (uint32_t)now : 0;
+  _tgQStats.queued++;
+  if (kind == TGM_ALERT || wasAlert) _tgQueueSave();
+  return true;
+}
+
+// Slot to send next (alerts first, then oldest), or -1 when the queue is
+// empty, a send is in flight, or the retry delay has not passed yet.
+inline int8_t tgQueueNext() {
+  if (_tgQBusy >= 0 || tgQueueRetryIn()) return -1;
+  int8_t pick = -1;
+  for (uint8_t i = 0; i < TG_QUEUE_SLOTS; i++) {
+    const TgMsg &m = _tgQ[i];
+    if (!m.used) continue;
+    if (pick < 0) { pick = i; continue; }
+    const TgMsg &p = _tgQ[pick];
+    bool alert = m.kind == TGM_ALERT, pAlert = p.kind == TGM_ALERT;
+    if (alert != pAlert ? alert : (int32_t)(m.seq - p.seq) < 0) pick = i;
+  }
+  return pick;
+}
+
+inline const TgMsg &tgQueueMsg(int8_t slot) { return _tgQ[slot]; }
+
+// The message in `slot` is being sent.
+inline void tgQueueSending(int8_t slot) { _tgQBusy = slot; }
+
+// Result of the send started with tgQueueSending(): `ok` removes the
+// message; otherwise `permanent` (request rejected) drops it, and any
+// other failure schedules a retry.
+inline void tgQueueDone(bool ok, bool permanent) {
+  if (_tgQBusy < 0) return;
+  TgMsg &m = _tgQ[_tgQBusy];
+  _tgQBusy = -1;
+  bool alert = m.kind == TGM_ALERT;
+  if (ok) {
+    _tgQStats.sent++;
+    _tgQFails  = 0;
+    _tgQWaitMs = 0;
+    m.used = false;
+  } else if (permanent || (!alert && m.tries + 1 >= TG_MAX_TRIES)) {
+    dbgPrintf("[TG] message #%lu given up after %u tries\n", (unsigned long)m.seq, m.tries + 1);
+    _tgQStats.dropped++;
+    m.used = false;
+  } else {
+    if (m.tries < 255) m.tries++;
+    _tgQStats.retries++;
+  }
+  if (!ok) {
+    if (_tgQFails < 31) _tgQFails++;
+    _tgQWaitFrom = millis();
+    _tgQWaitMs   = _tgQFails > 8 ? TG_RETRY_MAX_MS : min(TG_RETRY_MIN_MS << (_tgQFails - 1), TG_RETRY_MAX_MS);
+  }
+  if (alert && !m.used) _tgQueueSave();
+}
+
+// Load the alerts that were still queued before the reboot.
+inline void tgQueueRestore() {
+  File f = LittleFS.open(TG_QUEUE_FILE, "r");
+  if (!f) return;
+  uint8_t hdr[3];
+  if (f.read(hdr, sizeof(hdr)) != sizeof(hdr) || hdr[0] != TG_QUEUE_MAGIC || hdr[1] != TG_QUEUE_VERSION) {
+    f.close();
+    LittleFS.remove(TG_QUEUE_FILE);
+    return;
+  }
+  for (uint8_t k = 0; k < hdr[2] && k < TG_QUEUE_SLOTS; k++) {
+    TgMsg &m = _tgQ[k];
+    if (f.read((uint8_t *)&m.ts, sizeof(m.ts)) != sizeof(m.ts) ||
+        f.read((uint8_t *)&m.len, sizeof(m.len)) != sizeof(m.len) || m.len > TG_MSG_MAX ||
+        f.read((uint8_t *)m.text, m.len) != m.len) break;
+    m.text[m.len] = '\0';
+    m.used  = true;
+    m.kind  = TGM_ALERT;
+    m.tries = 0;
+    m.seq   = ++_tgQSeq;
+    _tgQStats.restored++;
+  }
+  f.close();
+  if (_tgQStats.restored) dbgPrintf("[TG] %lu alert(s) restored from flash\n", (unsigned long)_tgQStats.restored);
+}
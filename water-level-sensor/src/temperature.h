@@ -0,0 +1,131 @@
+#pragma once
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include "config.h"
+
+// ------------------------------------------------------------------
+// DS18B20 probes on one OneWire bus, addressed by ROM code.
+// The bus is enumerated once in initTempSensor(); each role (air, water,
+// enclosure) then keeps its 8-byte ROM, so a read is a MATCH ROM +
+// scratchpad read with no search. Conversion is asynchronous:
+// tempRequest() starts it on all probes with one broadcast, tempReady()
+// only compares timestamps (no bus traffic while echoes are being timed)
+// and tempCollect() reads one probe per call, so no loop() pass spends
+// more than one scratchpad read (~7 ms) on the bus.
+// ------------------------------------------------------------------
+#define TEMP_CONV_MS  190UL   // 10-bit conversion ≈ 188 ms
+
+enum TempRole : uint8_t { TEMP_AIR = 0, TEMP_WATER = 1, TEMP_CASE = 2 };
+
+static OneWire*           _ds18_ow = nullptr;
+static DallasTemperature* _ds18_dt = nullptr;
+
+struct TempProbes {
+  DeviceAddress rom[TEMP_PROBES];   // per role
+  bool          have[TEMP_PROBES];  // role has a probe
+  float         c[TEMP_PROBES];     // last reading, °C (NAN if none)
+  uint8_t       found;              // devices seen on the bus at init
+  bool          pending;            // conversion requested, not yet collected
+  uint8_t       next;               // role to read next in tempCollect()
+  unsigned long tReq;               // millis() of tempRequest()
+};
+static TempProbes _temp = { {}, {}, { NAN, NAN, NAN }, 0, false, 0, 0 };
+
+static const char *const _tempRoleName[TEMP_PROBES] = { "air", "water", "case" };
+inline const char *tempRoleName(uint8_t role) { return _tempRoleName[role < TEMP_PROBES ? role : 0]; }
+
+inline void tempRomToHex(const uint8_t *rom, char *out) {
+  for (uint8_t i = 0; i < 8; i++) sprintf(out + 2 * i, "%02X", rom[i]);
+  out[16] = '\0';
+}
+
+// Parse 16 hex digits; false for anything else (including "").
+inline bool tempRomFromHex(const char *s, uint8_t *rom) {
+  if (strlen(s) != 16) return false;
+  for (uint8_t i = 0; i < 8; i++) {
+    char b[3] = { s[2 * i], s[2 * i + 1], '\0' };
+    char *e;
+    rom[i] = (uint8_t)strtoul(b, &e, 16);
+    if (*e) return false;
+  }
+  return true;
+}
+
+inline bool tempProbePresent(uint8_t role) { return role < TEMP_PROBES && _temp.have[role]; }
+inline float tempC(uint8_t role) { return role < TEMP_PROBES ? _temp.c[role] : NAN; }
+
+// Enumerate the bus once (call after config is loaded). Roles with a ROM in
+// the config get that probe; the remaining roles take the unclaimed probes
+// in bus order, so a single probe is the air probe as before.
+inline void initTempSensor(const Config &c) {
+  if (!c.ds18_en) return;
+  _ds18_ow = new OneWire(c.ds18_pin);
+  _ds18_dt = new DallasTemperature(_ds18_ow);
+  _ds18_dt->begin();
+  _ds18_dt->setWaitForConversion(false);   // async — see tempReady()
+  _temp.found = _ds18_dt->getDeviceCount();
+
+  DeviceAddress bus[TEMP_PROBES + 2];
+  uint8_t nbus = 0;
+  for (uint8_t i = 0; i < _temp.found && nbus < TEMP_PROBES + 2; i++) {
+    if (_ds18_dt->getAddress(bus[nbus], i)) nbus++;
+  }
+  bool claimed[TEMP_PROBES + 2] = {};
+  for (uint8_t r = 0; r < TEMP_PROBES; r++) {
+    _temp.have[r] = tempRomFromHex(c.ds18_rom[r], _temp.rom[r]);
+    for (uint8_t i = 0; _temp.have[r] && i < nbus; i++) {
+      if (!memcmp(bus[i], _temp.rom[r], 8)) claimed[i] = true;
+    }
+  }
+  uint8_t i = 0;
+  for (uint8_t r = 0; r < TEMP_PROBES; r++) {
+    if (_temp.have[r]) continue;
+    while (i < nbus && claimed[i]) i++;
+    if (i >= nbus) break;
+    memcpy(_temp.rom[r], bus[i], 8);
+    claimed[i++] = _temp.have[r] = true;
+  }
+
+  dbgPrintf("[DS18B20] init on GPIO%u  devices: %u\n", c.ds18_pin, _temp.found);
+  for (uint8_t r = 0; r < TEMP_PROBES; r++) {
+    if (!_temp.have[r]) continue;
+    char hex[17];
+    tempRomToHex(_temp.rom[r], hex);
+    _ds18_dt->setResolution(_temp.rom[r], 10);   // 10-bit ≈ 187 ms conversion
+    dbgPrintf("[DS18B20] %-5s %s\n", tempRoleName(r), hex);
+  }
+}
+
+// Start a conversion on every probe (one broadcast). No-op while one is
+// already pending.
+inline void tempRequest() {
+  if (!_ds18_dt || _temp.pending) return;
+  _ds18_dt->requestTemperatures();
+  _temp.pending = true;
+  _temp.next    = 0;
+  _temp.tReq    = millis();
+}
+
+// True when no conversion is running or its time has elapsed.
+inline bool tempReady() {
+  return !_temp.pending || millis() - _temp.tReq >= TEMP_CONV_MS;
+}
+
+// Read the next assigned probe. Returns true when all probes have been
+// read (or nothing was pending); call again on later loop() passes until
+// then. 85 °C is the power-on scratchpad value, i.e. no conversion ran.
+inline bool tempCollect() {
+  if (!_temp.pending) return true;
+  auto skip = [] { while (_temp.next < TEMP_PROBES && !_temp.have[_temp.next]) _temp.next++; };
+  skip();
+  if (_temp.next < TEMP_PROBES) {
+    uint8_t r = _temp.next++;
+    float t = _ds18_dt->getTempC(_temp.rom[r]);
+    _temp.c[r] = (t == DEVICE_DISCONNECTED_C || t == 85.0f) ? NAN : t;
+    skip();
+    if (_temp.next < TEMP_PROBES) return false;
+  }
+  _temp.pending = false;
+  return true;
+}
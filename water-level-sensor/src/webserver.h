@@ -6,8 +6,11 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "json_stream.h"
 #include "sensor.h"
 #include "storage.h"
+#include "scheduler.h"
+#include "profiler.h"
 #include "mqtt_handler.h"
 #include "telegram_handler.h"
 
@@ -35,6 +38,35 @@ static void sendJson(ESP8266WebServer &srv, const String &json, int code = 200)
   srv.send(code, F("application/json"), json);
 }
 
+// ------------------------------------------------------------------
+// ETag helper: tags are boot id + data generation + a per-view `variant`
+// (query args, tank). Answers 304 when the client's If-None-Match
+// matches and returns true (request done); otherwise the tag is kept for
+// sendETagHeader(), which the 200 path calls just before its response.
+// Error replies (503 low memory) go out untagged.
+// ------------------------------------------------------------------
+static uint32_t _webBootId = 0;
+static char     _webETag[40];   // tag of the request being served, "" = none
+
+static bool handleETag(ESP8266WebServer &srv, char kind, uint32_t variant = 0) {
+  snprintf(_webETag, sizeof(_webETag), "\"%c%lx-%lx-%lx\"", kind, (unsigned long)_webBootId,
+           (unsigned long)dataGeneration(), (unsigned long)variant);
+  if (srv.hasHeader(F("If-None-Match")) && srv.header(F("If-None-Match")) == _webETag) {
+    srv.sendHeader(F("ETag"), _webETag);
+    srv.send(304);
+    _webETag[0] = '\0';
+    return true;
+  }
+  return false;
+}
+
+static void sendETagHeader(ESP8266WebServer &srv) {
+  if (!_webETag[0]) return;
+  srv.sendHeader(F("ETag"), _webETag);
+  srv.sendHeader(F("Cache-Control"), F("no-cache"));
+  _webETag[0] = '\0';
+}
+
 // ------------------------------------------------------------------
 // /api/wifi-scan
 // ------------------------------------------------------------------
@@ -83,24 +115,32 @@ struct TrendStats {
   uint32_t eta_empty_ts = 0;
 };
 
-static TrendStats _trendCache;
-static uint32_t   _trendCacheForTs = 0;
+// History records for computeTrendStats(), sendRecentEvents() and
+// queryHistory(). Each fills and finishes with it inside one call from
+// loop(), so they share it instead of holding ~9.7 KB of BSS between them.
+#define WEB_TREND_HOURS 168
+static HistRecord _webHistBuf[WEB_TREND_HOURS + MAX_RECENT_REC];
+
+static TrendStats _trendCache[TANK_MAX];
+static uint32_t   _trendCacheForTs[TANK_MAX] = {};
 
 static TrendStats computeTrendStats(const SensorData &s) {
-  if (_trendCacheForTs == s.timestamp && s.timestamp != 0) return _trendCache;
+  const uint8_t tank = s.tank < TANK_MAX ? s.tank : 0;
+  TrendStats &cache = _trendCache[tank];
+  if (_trendCacheForTs[tank] == s.timestamp && s.timestamp != 0) return cache;
 
   TrendStats st;
-  _trendCacheForTs = s.timestamp;
+  _trendCacheForTs[tank] = s.timestamp;
 
   if (s.timestamp == 0 || s.total_liters <= 0 || s.volume_liters < 0) {
-    _trendCache = st;
+    cache = st;
     return st;
   }
 
-  static HistRecord hbuf[168];
-  static HistRecord rbuf[MAX_RECENT_REC];
-  int hcnt = storageRead(hbuf, 168);
-  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC);
+  HistRecord *hbuf = _webHistBuf;
+  HistRecord *rbuf = _webHistBuf + WEB_TREND_HOURS;
+  int hcnt = storageRead(hbuf, WEB_TREND_HOURS, tank);
+  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC, tank);
 
   const uint32_t now = s.timestamp;
   const uint32_t since24 = (now > 24UL * 3600UL) ? (now - 24UL * 3600UL) : 0;
@@ -108,13 +148,16 @@ static TrendStats computeTrendStats(const SensorData &s) {
   const uint32_t recentSince = (now > 3600UL) ? (now - 3600UL) : 0;
 
   bool havePrev = false;
-  HistRecord prev = {0,0,0,NAN};
+  HistRecord prev = {0, 0, 0, NAN, NAN, NAN};
   bool have24Point = false, have7Point = false;
   uint32_t first24 = 0, last24 = 0, first7 = 0, last7 = 0;
   float used24 = 0.0f, used7 = 0.0f;
 
+  // Poor readings (few echoes, wide spread) are bridged over rather than
+  // used as delta anchors, so one bad ping burst cannot fake a draw.
   auto feed = [&](const HistRecord &rec) {
     if (rec.ts == 0 || rec.ts > now) return;
+    if (histRecordPoor(rec)) return;
     if (rec.ts < since7d) return;
     if (!(rec.volume >= 0.0f)) return;
 
@@ -177,13 +220,13 @@ static TrendStats computeTrendStats(const SensorData &s) {
     st.eta_empty_ts = now + (uint32_t)((s.volume_liters / useRate) * 86400.0f);
   }
 
-  _trendCache = st;
+  cache = st;
   return st;
 }
 
-static String buildRecentEvents() {
-  static HistRecord rbuf[MAX_RECENT_REC];
-  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC);
+static void sendRecentEvents(ESP8266WebServer &srv, uint8_t tank) {
+  HistRecord *rbuf = _webHistBuf;
+  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC, tank);
 
   struct EventRec {
     uint32_t ts;
@@ -195,10 +238,10 @@ static String buildRecentEvents() {
   int evCount = 0;
 
   bool havePrev = false;
-  HistRecord prev = {0,0,0,NAN};
+  HistRecord prev = {0, 0, 0, NAN, NAN, NAN};
   for (int i = rcnt - 1; i >= 0; i--) { // chronological
     const HistRecord &rec = rbuf[i];
-    if (rec.ts == 0 || !(rec.volume >= 0.0f)) continue;
+    if (rec.ts == 0 || !(rec.volume >= 0.0f) || histRecordPoor(rec)) continue;
     if (!havePrev) { prev = rec; havePrev = true; continue; }
     if (rec.ts <= prev.ts) { prev = rec; continue; }
 
@@ -238,207 +281,456 @@ static String buildRecentEvents() {
     prev = rec;
   }
 
-  DynamicJsonDocument doc(2048);
-  JsonArray arr = doc.createNestedArray("events");
+  JsonStream js(srv);
+  sendETagHeader(srv);
+  js.begin();
+  js.beginObject();
+  js.beginArray(F("events"));
   for (int i = evCount - 1; i >= 0; i--) { // newest first
-    JsonObject o = arr.createNestedObject();
-    o["ts"] = evs[i].ts;
-    o["type"] = evs[i].type;
-    o["delta_l"] = roundf(evs[i].delta_l * 10.0f) / 10.0f;
-    o["rate_lph"] = roundf(evs[i].rate_lph * 10.0f) / 10.0f;
+    js.beginObject();
+    js.kv(F("ts"), evs[i].ts);
+    js.kv(F("type"), (const char *)evs[i].type);
+    js.kvNumber(F("delta_l"), evs[i].delta_l);
+    js.kvNumber(F("rate_lph"), evs[i].rate_lph);
+    js.endObject();
   }
-  doc["window_min"] = 60;
-  String out; serializeJson(doc, out);
-  return out;
+  js.endArray();
+  js.kv(F("window_min"), 60);
+  js.endObject();
+  js.end();
 }
 
-static String buildStatus(const Config &c, const SensorData &s) {
-  DynamicJsonDocument doc(1536);
-  auto r1 = [](float v) { return roundf(v * 10.0f) / 10.0f; };
+// Everything here changes only with a new reading (or history write,
+// config change), so the response is ETag'd by the data generation; the
+// link state, heap and queue counters that move between readings are
+// in /api/info.
+static void sendStatus(ESP8266WebServer &srv, const Config &c, const SensorData &s) {
   TrendStats tr = computeTrendStats(s);
-  doc["level"]    = r1(s.level_pct);
-  doc["distance"] = r1(s.distance_cm);
-  doc["volume"]   = r1(s.volume_liters);
-  doc["free"]     = r1(s.free_liters);
-  doc["total"]    = r1(s.total_liters);
-  if (!isnan(s.temp_c)) doc["temp"] = r1(s.temp_c);
-  else                  doc["temp"] = nullptr;
-  doc["valid"]    = s.valid;
-  doc["ts"]       = s.timestamp;
-  doc["ip"]       = WiFi.localIP().toString();
-  doc["rssi"]     = WiFi.RSSI();
-  doc["heap"]     = ESP.getFreeHeap();
-  doc["diameter"] = c.barrel_diam_cm;
-  doc["records"]  = storageCount();
-  doc["records_recent"] = storageCountRecent();
-  doc["records_max"] = MAX_REC;
-  doc["wifi"]     = (WiFi.status() == WL_CONNECTED);
-  doc["mqtt"]     = mqttConnected();
-  doc["tg"]       = tgEnabled();
-  doc["version"]  = FW_VERSION;
-  if (!isnan(tr.used24_l)) doc["used24"] = tr.used24_l; else doc["used24"] = nullptr;
-  if (!isnan(tr.used7d_l)) doc["used7d"] = tr.used7d_l; else doc["used7d"] = nullptr;
-  if (!isnan(tr.rate24_lpd)) doc["rate24"] = tr.rate24_lpd; else doc["rate24"] = nullptr;
-  if (!isnan(tr.rate7d_lpd)) doc["rate7d"] = tr.rate7d_lpd; else doc["rate7d"] = nullptr;
-  if (!isnan(tr.days_left)) doc["daysleft"] = tr.days_left; else doc["daysleft"] = nullptr;
-  if (tr.eta_empty_ts) doc["eta_empty_ts"] = tr.eta_empty_ts; else doc["eta_empty_ts"] = nullptr;
-  doc["span24"] = tr.span24_s;
-  doc["span7d"] = tr.span7d_s;
-  String out; serializeJson(doc, out);
-  return out;
+  JsonStream js(srv);
+  sendETagHeader(srv);
+  js.begin();
+  js.beginObject();
+  js.kvNumber(F("level"),    s.level_pct);
+  js.kvNumber(F("distance"), s.distance_cm);
+  js.kvNumber(F("volume"),   s.volume_liters);
+  js.kvNumber(F("free"),     s.free_liters);
+  js.kvNumber(F("total"),    s.total_liters);
+  js.kvNumber(F("temp"),     s.temp_c);   // null when unavailable
+  js.kvNumber(F("water"),    s.water_c);
+  js.kvNumber(F("case"),     s.case_c);
+  js.kv(F("valid"),    s.valid);
+  js.kv(F("ts"),       s.timestamp);
+  js.kv(F("tank"),     s.tank);
+  js.kv(F("tank_name"), (const char *)c.tanks[s.tank].name);
+  js.kv(F("tanks"),    c.tank_count);
+  js.kv(F("interval"), measureIntervalSec());
+  js.kvNumber(F("dist_median"), s.dist_median_cm, 2);
+  js.kvNumber(F("dist_trim"),   s.dist_trim_cm, 2);
+  js.kvNumber(F("dist_mad"),    s.dist_mad_cm, 2);
+  js.kv(F("outliers"), s.dist_outliers);
+  js.kvNumber(F("echo_us"), s.quality.echo_us, 1);
+  js.beginObject(F("quality"));
+  js.kv(F("attempted"), s.quality.attempted);
+  js.kv(F("valid"),     s.quality.valid);
+  js.kv(F("timeouts"),  s.quality.timeouts);
+  js.kvNumber(F("min"), s.quality.min_cm, 2);
+  js.kvNumber(F("max"), s.quality.max_cm, 2);
+  js.kvNumber(F("sd"),  s.quality.sd_cm, 2);
+  js.kv(F("poor"),      measQualityPoor(s.quality));
+  js.endObject();
+  js.kvNumber(F("kf_level"),     s.kf_level_pct, 2);
+  js.kvNumber(F("kf_level_var"), s.kf_level_var, 4);
+  js.kvNumber(F("kf_rate_lph"),  s.kf_rate_lph, 2);
+  js.kvNumber(F("kf_rate_var"),  s.kf_rate_var, 3);
+  js.kvNumber(F("sound_cm_us"), s.sound_cm_us, 6);
+  js.beginArray(F("burst"));
+  for (uint8_t i = 0; i < s.burst_n; i++) js.number(s.burst[i], 2);
+  js.endArray();
+  js.kvNumber(F("diameter"), c.tanks[s.tank].barrel_diam_cm, 2);
+  js.kv(F("shape"),    c.tanks[s.tank].shape);
+  js.beginArray(F("probes"));
+  const float probeC[TEMP_PROBES] = { s.temp_c, s.water_c, s.case_c };   // as of this reading
+  for (uint8_t r = 0; r < TEMP_PROBES; r++) {
+    if (!tempProbePresent(r)) continue;
+    char hex[17];
+    tempRomToHex(_temp.rom[r], hex);
+    js.beginObject();
+    js.kv(F("role"), tempRoleName(r));
+    js.kv(F("rom"),  (const char *)hex);
+    js.kvNumber(F("c"), probeC[r]);
+    js.endObject();
+  }
+  js.endArray();
+  js.kv(F("records"),  storageCount(s.tank));
+  js.kv(F("records_recent"), storageCountRecent(s.tank));
+  js.kv(F("records_max"), storageCapacity(s.tank));
+  js.kv(F("version"),  FW_VERSION);
+  js.kvNumber(F("used24"),   tr.used24_l, 3);
+  js.kvNumber(F("used7d"),   tr.used7d_l, 3);
+  js.kvNumber(F("rate24"),   tr.rate24_lpd, 3);
+  js.kvNumber(F("rate7d"),   tr.rate7d_lpd, 3);
+  js.kvNumber(F("daysleft"), tr.days_left, 3);
+  if (tr.eta_empty_ts) js.kv(F("eta_empty_ts"), tr.eta_empty_ts); else js.kvNull(F("eta_empty_ts"));
+  js.kv(F("span24"), tr.span24_s);
+  js.kv(F("span7d"), tr.span7d_s);
+  js.endObject();
+  js.end();
 }
 
 // ------------------------------------------------------------------
-// /api/history?h=N  (N hours, default 24, supports up to MAX_REC with downsampling)
+// /api/history?h=N  (N hours, default 24, supports up to HIST_MAX_HOURS with downsampling)
 // ------------------------------------------------------------------
-static String buildHistory(int hours) {
-  const int HISTORY_UI_MAX_HOURS = MAX_REC;
+// Coarsest rollup tier whose period still resolves `step` seconds and whose
+// closed records reach back to `since`; -1 means use hourly snapshots.
+static int pickHistoryTier(uint32_t step, uint32_t since, uint8_t tank) {
+  for (int t = TIER_COUNT - 1; t >= 0; t--) {
+    uint32_t period = storageTierPeriod(t);
+    if (period > step) continue;
+    HistAggRecord first;
+    if (storageAggRead(t, 0, &first, 1, tank) == 1 && first.ts <= since + period) return t;
+  }
+  return -1;
+}
+
+// One chart point, values in 0.1 units as stored.
+struct HistPoint {
+  uint32_t ts;
+  int16_t  level;
+  int16_t  lmin;     // HIST_AGG_NO_TEMP when the point is a snapshot
+  int16_t  lmax;
+  int16_t  temp;     // HIST_AGG_NO_TEMP if unavailable
+  int16_t  water;    // HIST_AGG_NO_TEMP if unavailable (always for rollups)
+  int16_t  cas;      // enclosure, likewise
+  int32_t  vol;
+};
+
+// Heap seen by /api/history requests, reported in /api/info.
+static uint32_t _histHeapMin  = 0;   // lowest free heap during the last request
+static uint32_t _histHeapPeak = 0;   // most heap a single request has taken since boot
+
+// Chart points for one /api/history request, shared by the JSON and the
+// packed encodings. pts is malloc'ed; release with free().
+struct HistQuery {
+  int        hours;
+  int        tier;          // -1 = hourly snapshots
+  bool       downsample;
+  bool       aux;           // some point has a water or enclosure temperature
+  uint32_t   recentSince;   // points from here on get minute labels
+  HistPoint *pts;
+  int        np;
+};
+
+static bool queryHistory(int hours, uint8_t tank, HistQuery &q) {
+  const int HISTORY_UI_MAX_HOURS = HIST_MAX_HOURS;
   if (hours < 1)   hours = 24;
   if (hours > HISTORY_UI_MAX_HOURS) hours = HISTORY_UI_MAX_HOURS;
 
-  static HistRecord rbuf[MAX_RECENT_REC];      // recent minute snapshots
-  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC);
+  HistRecord *rbuf = _webHistBuf;              // recent minute snapshots
+  int rcnt = storageReadRecent(rbuf, MAX_RECENT_REC, tank);
 
   // Filter by time window
   uint32_t now = time(nullptr);
   uint32_t since = now - (uint32_t)hours * 3600UL;
   uint32_t recentSince = (now > 3600UL) ? (now - 3600UL) : 0;
 
-  // Downsample older hourly points for long ranges to keep RAM/JSON response small.
-  int olderEligible = 0;
-  {
-    File hf = LittleFS.open(HIST_FILE, "r");
-    HistHeader hdr;
-    if (hf &&
-        hf.size() == (size_t)(sizeof(HistHeader) + (size_t)MAX_REC * sizeof(HistRecord)) &&
-        hf.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
-        hdr.head < MAX_REC && hdr.count <= MAX_REC) {
-      HistRecord rec;
-      int start = ((int)hdr.head - (int)hdr.count + MAX_REC) % MAX_REC; // oldest
-      for (uint16_t i = 0; i < hdr.count; i++) {
-        int idx = (start + i) % MAX_REC;
-        hf.seek(sizeof(HistHeader) + idx * sizeof(HistRecord));
-        if (hf.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) break;
-        if (rec.ts == 0 || rec.ts < since) continue;
-        if (rec.ts >= recentSince) continue;
-        olderEligible++;
-        yield();
-      }
-    }
-    if (hf) hf.close();
+  // Downsample older points for long ranges to keep RAM/JSON response small.
+  int olderTarget = hours; // keep all for short ranges
+  if (hours > 168) {
+    olderTarget = (hours > 720) ? 80 : 110; // + recent(<=60) => ~140..170 points total
+  }
+  int tier = pickHistoryTier((uint32_t)hours * 3600UL / olderTarget, since, tank);
+
+  // Exact size of the older part [since, recentSince) from ring metadata:
+  // a rollup tier (closed periods + the open one) or hourly snapshots.
+  uint16_t olderFirst = 0, olderEligible = 0;
+  HistAggRecord aggOpen;
+  bool aggOpenUsed = false;
+  if (tier >= 0) {
+    olderFirst = storageAggLowerBound(tier, since, tank);
+    uint16_t end = storageAggLowerBound(tier, recentSince, tank);
+    olderEligible = (end > olderFirst) ? end - olderFirst : 0;
+    aggOpenUsed = storageAggOpen(tier, aggOpen, tank) &&
+                  aggOpen.ts >= since && aggOpen.ts < recentSince;
+  } else {
+    storageFindRange(since, recentSince, olderFirst, olderEligible, tank);
   }
+  int olderTotal = olderEligible + (aggOpenUsed ? 1 : 0);
+
   int recentEligible = 0;
   for (int i = rcnt - 1; i >= 0; i--) {
     if (rbuf[i].ts == 0 || rbuf[i].ts < since) continue;
     recentEligible++;
   }
-  int olderTarget = olderEligible; // keep all for short ranges
-  if (hours > 168) {
-    olderTarget = (hours > 720) ? 80 : 110; // + recent(<=60) => ~140..170 points total
-    if (olderTarget < 1) olderTarget = 1;
+  int olderStride = (olderTotal > olderTarget) ? ((olderTotal + olderTarget - 1) / olderTarget) : 1;
+  // Every stride-th point plus the last one before the recent window.
+  int olderKept = 0;
+  if (olderTotal > 0) {
+    olderKept = (olderTotal - 1) / olderStride + 1;
+    if ((olderTotal - 1) % olderStride) olderKept++;
   }
-  int olderStride = (olderEligible > olderTarget) ? ((olderEligible + olderTarget - 1) / olderTarget) : 1;
-  int outCount = recentEligible;
-  if (olderEligible > 0) {
-    outCount += (olderStride <= 1) ? olderEligible : ((olderEligible + olderStride - 1) / olderStride);
-    // Ensure the most recent hourly point before recent window is not lost.
-    if (olderStride > 1) outCount += 1;
-  }
-  if (outCount < 1) outCount = 1;
+  int outCount = olderKept + recentEligible;
 
-  DynamicJsonDocument doc(outCount * 96 + 256);
-  JsonArray labels = doc.createNestedArray("labels");
-  JsonArray values = doc.createNestedArray("values");
-  JsonArray vols   = doc.createNestedArray("volumes");
-  JsonArray temps  = doc.createNestedArray("temps");
-  doc["hours"] = hours;
-  doc["downsample"] = (olderStride > 1);
+  HistPoint *pts = outCount ? (HistPoint*)malloc(sizeof(HistPoint) * outCount) : nullptr;
+  if (outCount && !pts) {
+    dbgPrintf("[WEB] /api/history: no heap for %d points\n", outCount);
+    return false;
+  }
+  int np = 0;
+  bool aux = false;
 
+  int olderSeen = 0;
+  auto keepOlder = [&]() {
+    bool keep = olderStride <= 1 ||
+                (olderSeen % olderStride) == 0 || olderSeen == olderTotal - 1;
+    olderSeen++;
+    return keep && np < outCount;
+  };
   auto addRec = [&](const HistRecord &rec) {
-    if (rec.ts < since || rec.ts == 0) return;
-    time_t ts = (time_t)rec.ts;
-    struct tm *ti = localtime(&ts);
-    if (!ti) return;
-    char lbl[10];
-    if (hours <= 24) {
-      strftime(lbl, sizeof(lbl), "%H:%M", ti);
-    } else if (rec.ts >= recentSince) {
-      strftime(lbl, sizeof(lbl), "%H:%M", ti); // finer labels inside recent minute window
-    } else {
-      strftime(lbl, sizeof(lbl), "%d.%m", ti);
-    }
-    labels.add(lbl);
-    values.add(roundf(rec.level * 10.0f) / 10.0f);
-    vols.add(roundf(rec.volume * 10.0f) / 10.0f);
-    if (isnan(rec.temp_c)) temps.add(nullptr);
-    else                   temps.add(roundf(rec.temp_c * 10.0f) / 10.0f);
+    HistPoint &p = pts[np++];
+    p.ts    = rec.ts;
+    p.level = (int16_t)_histQ(rec.level);
+    p.lmin  = p.lmax = HIST_AGG_NO_TEMP;
+    p.temp  = isnan(rec.temp_c) ? HIST_AGG_NO_TEMP : (int16_t)_histQ(rec.temp_c);
+    p.water = isnan(rec.water_c) ? HIST_AGG_NO_TEMP : (int16_t)_histQ(rec.water_c);
+    p.cas   = isnan(rec.case_c)  ? HIST_AGG_NO_TEMP : (int16_t)_histQ(rec.case_c);
+    p.vol   = _histQ(rec.volume);
+    aux = aux || p.water != HIST_AGG_NO_TEMP || p.cas != HIST_AGG_NO_TEMP;
+  };
+  auto addAgg = [&](const HistAggRecord &rec) {
+    HistPoint &p = pts[np++];
+    p.ts    = rec.ts;
+    p.level = rec.lvAvg;
+    p.lmin  = rec.lvMin;
+    p.lmax  = rec.lvMax;
+    p.temp  = rec.tempAvg;
+    p.water = p.cas = HIST_AGG_NO_TEMP;
+    p.vol   = _histQ(rec.volAvg);
   };
 
-  // Hourly part (older than the recent minute window), chronological
-  int olderSeen = 0;
-  {
-    File hf = LittleFS.open(HIST_FILE, "r");
-    HistHeader hdr;
-    if (hf &&
-        hf.size() == (size_t)(sizeof(HistHeader) + (size_t)MAX_REC * sizeof(HistRecord)) &&
-        hf.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
-        hdr.head < MAX_REC && hdr.count <= MAX_REC) {
+  // Single pass over the older part, chronological
+  if (tier >= 0) {
+    HistAggRecord abuf[16];
+    uint16_t idx = olderFirst, end = olderFirst + olderEligible;
+    while (idx < end) {
+      int want = end - idx;
+      int got = storageAggRead(tier, idx, abuf, want < 16 ? want : 16, tank);
+      if (got <= 0) break;
+      for (int i = 0; i < got; i++) {
+        if (keepOlder()) addAgg(abuf[i]);
+      }
+      idx += got;
+      yield();
+    }
+    if (aggOpenUsed && keepOlder()) addAgg(aggOpen);
+  } else {
+    HistCursor &cur = storageCursor();
+    if (olderEligible > 0 && storageCursorOpen(cur, storageHourlyRing(tank), false, olderFirst, olderEligible)) {
       HistRecord rec;
-      int start = ((int)hdr.head - (int)hdr.count + MAX_REC) % MAX_REC; // oldest
-      for (uint16_t i = 0; i < hdr.count; i++) {
-        int idx = (start + i) % MAX_REC;
-        hf.seek(sizeof(HistHeader) + idx * sizeof(HistRecord));
-        if (hf.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) break;
-        yield(); // keep /api/history responsive on ESP8266
-        if (rec.ts >= recentSince) continue; // replaced by minute-resolution data
-        if (rec.ts < since || rec.ts == 0) continue;
-        bool keep = true;
-        if (olderStride > 1) {
-          keep = (olderSeen % olderStride) == 0 || olderSeen == olderEligible - 1;
-        }
-        if (keep) addRec(rec);
-        olderSeen++;
+      while (storageCursorNext(cur, rec)) {
+        if (keepOlder()) addRec(rec);
       }
+      storageCursorClose(cur);
     }
-    if (hf) hf.close();
   }
 
   // Recent part (last 60 minutes), chronological
-  for (int i = rcnt - 1; i >= 0; i--) {
-    yield();
+  for (int i = rcnt - 1; i >= 0 && np < outCount; i--) {
+    if (rbuf[i].ts == 0 || rbuf[i].ts < since) continue;
     addRec(rbuf[i]);
   }
 
-  String out; serializeJson(doc, out);
-  return out;
+  q.hours = hours;
+  q.tier = tier;
+  q.downsample = olderStride > 1;
+  q.aux = aux;
+  q.recentSince = recentSince;
+  q.pts = pts;
+  q.np = np;
+  return true;
+}
+
+static void _histHeapTrack(uint32_t heapStart, uint32_t heapMin) {
+  _histHeapMin = heapMin;
+  if (heapStart > heapMin && heapStart - heapMin > _histHeapPeak) {
+    _histHeapPeak = heapStart - heapMin;
+  }
+}
+
+static void sendHistory(ESP8266WebServer &srv, int hours, uint8_t tank) {
+  uint32_t heapStart = ESP.getFreeHeap();
+  HistQuery q;
+  if (!queryHistory(hours, tank, q)) {
+    sendJson(srv, F("{\"error\":\"low memory\"}"), 503);
+    return;
+  }
+  const HistPoint *pts = q.pts;
+  const int np = q.np;
+
+  // Emit columns from the compact point buffer straight into the response.
+  JsonStream js(srv);
+  sendETagHeader(srv);
+  js.begin();
+  js.sampleHeap();
+  js.beginObject();
+  js.beginArray(F("labels"));
+  for (int i = 0; i < np; i++) {
+    time_t ts = (time_t)pts[i].ts;
+    struct tm *ti = localtime(&ts);
+    char lbl[10] = "";
+    if (ti) {
+      if (q.hours <= 24 || pts[i].ts >= q.recentSince) {
+        strftime(lbl, sizeof(lbl), "%H:%M", ti); // finer labels inside recent minute window
+      } else {
+        strftime(lbl, sizeof(lbl), "%d.%m", ti);
+      }
+    }
+    js.value((const char *)lbl);
+  }
+  js.endArray();
+  auto column = [&](const __FlashStringHelper *name, int which) {
+    js.beginArray(name);
+    for (int i = 0; i < np; i++) {
+      const HistPoint &p = pts[i];
+      int32_t v = which == 0 ? p.level : which == 1 ? p.vol : which == 2 ? p.temp
+                : which == 3 ? p.lmin : which == 4 ? p.lmax : which == 5 ? p.water : p.cas;
+      if (which >= 2 && v == HIST_AGG_NO_TEMP) js.null();
+      else                                     js.tenths(v);
+    }
+    js.endArray();
+    yield();
+  };
+  column(F("values"), 0);
+  column(F("volumes"), 1);
+  column(F("temps"), 2);
+  if (q.tier >= 0) {
+    column(F("mins"), 3);
+    column(F("maxs"), 4);
+  }
+  if (q.aux) {
+    column(F("water"), 5);
+    column(F("case"), 6);
+  }
+  js.kv(F("hours"), q.hours);
+  js.kv(F("downsample"), q.downsample);
+  js.kv(F("tier"), q.tier >= 0 ? storageTierName(q.tier) : "raw");
+  js.endObject();
+  js.end();
+  free(q.pts);
+  _histHeapTrack(heapStart, js.heapMin());
+}
+
+// ------------------------------------------------------------------
+// /api/history.pack?h=N — same points as /api/history, packed binary
+//
+// Little-endian, version HIST_PACK_WIRE_VER:
+//   header (20 bytes)
+//     char[3] "WLH", u8 version
+//     u16 count, u8 flags (bit0 min/max present, bit1 downsampled, bit2 water/case present),
+//     u8 tier (0 raw, 1 hour, 2 day, 3 month)
+//     u32 base ts (first point, unix seconds)
+//     u16 hours, u16 recentIdx (first point labelled HH:MM when hours > 24)
+//     u16 volStep (volume unit in 0.1 L), u16 reserved
+//   columns, count entries each
+//     u16 dt     minutes since the previous point (first = 0)
+//     i16 level  0.1 %
+//     i16 volume volStep × 0.1 L
+//     i16 temp   0.1 °C, -32768 = none
+//     i16 min, i16 max  0.1 %, only with flags bit0 (-32768 = none)
+//     i16 water, i16 case  0.1 °C, only with flags bit2 (-32768 = none)
+// ------------------------------------------------------------------
+#define HIST_PACK_WIRE_VER 1
+#define HIST_PACK_WIRE_HDR 20
+
+static void sendHistoryPack(ESP8266WebServer &srv, int hours, uint8_t tank) {
+  uint32_t heapStart = ESP.getFreeHeap();
+  HistQuery q;
+  if (!queryHistory(hours, tank, q)) {
+    srv.send(503, F("text/plain"), F("low memory"));
+    return;
+  }
+  const HistPoint *pts = q.pts;
+  const int np = q.np;
+  bool minMax = q.tier >= 0;
+
+  int recentIdx = np;
+  int32_t volMax = 0;
+  for (int i = 0; i < np; i++) {
+    if (recentIdx == np && pts[i].ts >= q.recentSince) recentIdx = i;
+    int32_t v = pts[i].vol < 0 ? -pts[i].vol : pts[i].vol;
+    if (v > volMax) volMax = v;
+  }
+  uint16_t volStep = (uint16_t)(volMax / 32767 + 1);
+
+  uint8_t buf[256];
+  size_t len = 0;
+  auto flush = [&]() {
+    if (len) srv.sendContent((const char *)buf, len);
+    len = 0;
+  };
+  auto put16 = [&](uint16_t v) {
+    if (len + 2 > sizeof(buf)) flush();
+    buf[len++] = (uint8_t)(v & 0xFF);
+    buf[len++] = (uint8_t)(v >> 8);
+  };
+  auto put32 = [&](uint32_t v) { put16((uint16_t)(v & 0xFFFF)); put16((uint16_t)(v >> 16)); };
+
+  srv.setContentLength(HIST_PACK_WIRE_HDR + (size_t)np * (8 + (minMax ? 4 : 0) + (q.aux ? 4 : 0)));
+  sendETagHeader(srv);
+  srv.send(200, F("application/octet-stream"), "");
+  buf[len++] = 'W'; buf[len++] = 'L'; buf[len++] = 'H';
+  buf[len++] = HIST_PACK_WIRE_VER;
+  put16((uint16_t)np);
+  buf[len++] = (uint8_t)((minMax ? 1 : 0) | (q.downsample ? 2 : 0) | (q.aux ? 4 : 0));
+  buf[len++] = (uint8_t)(q.tier + 1);
+  put32(np ? pts[0].ts : 0);
+  put16((uint16_t)q.hours);
+  put16((uint16_t)recentIdx);
+  put16(volStep);
+  put16(0);
+
+  // Minutes are taken relative to the base minute so rounding never drifts.
+  uint32_t prevMin = np ? pts[0].ts / 60 : 0;
+  for (int i = 0; i < np; i++) {
+    uint32_t m = pts[i].ts / 60;
+    uint32_t dt = m > prevMin ? m - prevMin : 0;
+    put16(dt > 0xFFFF ? 0xFFFF : (uint16_t)dt);
+    prevMin = m;
+  }
+  for (int i = 0; i < np; i++) put16((uint16_t)pts[i].level);
+  for (int i = 0; i < np; i++) {
+    int32_t v = pts[i].vol / volStep;
+    put16((uint16_t)(int16_t)v);
+  }
+  for (int i = 0; i < np; i++) put16((uint16_t)pts[i].temp);
+  if (minMax) {
+    for (int i = 0; i < np; i++) put16((uint16_t)pts[i].lmin);
+    for (int i = 0; i < np; i++) put16((uint16_t)pts[i].lmax);
+  }
+  if (q.aux) {
+    for (int i = 0; i < np; i++) put16((uint16_t)pts[i].water);
+    for (int i = 0; i < np; i++) put16((uint16_t)pts[i].cas);
+  }
+  flush();
+  uint32_t heapMin = ESP.getFreeHeap();
+  free(q.pts);
+  _histHeapTrack(heapStart, heapMin);
 }
 
 // ------------------------------------------------------------------
 // /api/export  — CSV download
 // ------------------------------------------------------------------
-static void handleExport(ESP8266WebServer &srv) {
+static void handleExport(ESP8266WebServer &srv, uint8_t tank) {
   srv.sendHeader(F("Content-Disposition"), F("attachment; filename=history.csv"));
+  sendETagHeader(srv);
   srv.setContentLength(CONTENT_LENGTH_UNKNOWN);
   srv.send(200, F("text/csv"), "");
 
-  srv.sendContent(F("datetime,level_pct,volume_liters,temp_c\r\n"));
-  File f = LittleFS.open(HIST_FILE, "r");
-  if (!f) return;
-
-  HistHeader hdr;
-  if (f.size() != (size_t)(sizeof(HistHeader) + MAX_REC * sizeof(HistRecord)) ||
-      f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) ||
-      hdr.head >= MAX_REC || hdr.count > MAX_REC) {
-    f.close();
-    return;
-  }
+  srv.sendContent(F("datetime,level_pct,volume_liters,temp_c,water_c,case_c,pings,echoes,spread_cm\r\n"));
+  HistCursor &cur = storageCursor();
+  if (!storageCursorOpen(cur, storageHourlyRing(tank), false)) return;
 
   HistRecord rec;
-  int start = ((int)hdr.head - (int)hdr.count + MAX_REC) % MAX_REC; // oldest
-  for (uint16_t i = 0; i < hdr.count; i++) {
-    int idx = (start + i) % MAX_REC;
-    f.seek(sizeof(HistHeader) + idx * sizeof(HistRecord));
-    if (f.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) break;
+  while (storageCursorNext(cur, rec)) {
     if (rec.ts == 0) continue;
     time_t ts = (time_t)rec.ts;
     struct tm *ti = localtime(&ts);
@@ -451,10 +743,21 @@ static void handleExport(ESP8266WebServer &srv) {
     srv.sendContent(String(rec.volume, 1));
     srv.sendContent(",");
     if (!isnan(rec.temp_c)) srv.sendContent(String(rec.temp_c, 1));
+    srv.sendContent(",");
+    if (!isnan(rec.water_c)) srv.sendContent(String(rec.water_c, 1));
+    srv.sendContent(",");
+    if (!isnan(rec.case_c)) srv.sendContent(String(rec.case_c, 1));
+    srv.sendContent(",");
+    if (rec.pings) {   // empty for records written before quality was kept
+      snprintf(row, sizeof(row), "%u,%u,%.1f", rec.pings & 0x0F, rec.pings >> 4, rec.sd_mm / 10.0f);
+      srv.sendContent(row);
+    } else {
+      srv.sendContent(",,");
+    }
     srv.sendContent(F("\r\n"));
     yield();
   }
-  f.close();
+  storageCursorClose(cur);
 }
 
 // ------------------------------------------------------------------
@@ -542,6 +845,105 @@ static void handleConfigRawRestore(ESP8266WebServer &srv) {
   sendJson(srv, F("{\"ok\":true,\"reboot\":false}"));
 }
 
+// ------------------------------------------------------------------
+// /api/stream — Server-Sent Events
+// A few long-lived connections are detached from the web server and kept
+// here. Events are pushed only when something changes:
+//   status  — compact reading after every measurement
+//   history — stored history changed (new point, clear, restore)
+// A slow client whose TCP window is full is dropped instead of blocking loop().
+// ------------------------------------------------------------------
+#define SSE_MAX_CLIENTS 3
+#define SSE_PING_MS     15000UL
+
+static WiFiClient    _sseClients[SSE_MAX_CLIENTS];
+static bool          _sseActive[SSE_MAX_CLIENTS] = {false};
+static unsigned long _ssePingAt = 0;
+
+static void handleStream(ESP8266WebServer &srv) {
+  int slot = -1;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (_sseActive[i] && !_sseClients[i].connected()) {
+      _sseClients[i].stop();
+      _sseActive[i] = false;
+    }
+    if (!_sseActive[i] && slot < 0) slot = i;
+  }
+  if (slot < 0) {
+    srv.send(503, F("text/plain"), F("Too many streams"));
+    return;
+  }
+  WiFiClient c = srv.client();
+  c.setNoDelay(true);
+  c.print(F("HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: keep-alive\r\n"
+            "Access-Control-Allow-Origin: *\r\n\r\n"
+            "retry: 5000\n\n"));
+  _sseClients[slot] = c;
+  _sseActive[slot] = true;
+  dbgPrintf("[WEB] SSE client %d connected\n", slot);
+}
+
+static void _sseBroadcast(const char *msg, size_t len) {
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (!_sseActive[i]) continue;
+    WiFiClient &c = _sseClients[i];
+    bool ok = c.connected() && c.availableForWrite() >= len &&
+              c.write((const uint8_t*)msg, len) == len;
+    if (!ok) {
+      c.stop();
+      _sseActive[i] = false;
+      dbgPrintf("[WEB] SSE client %d dropped\n", i);
+    }
+  }
+}
+
+inline bool sseHasClients() {
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) if (_sseActive[i]) return true;
+  return false;
+}
+
+inline void ssePushStatus(const SensorData &s) {
+  if (!sseHasClients()) return;
+  auto fmt = [](char *dst, size_t len, float v, const char *f) {
+    if (isnan(v)) strlcpy(dst, "null", len);
+    else          snprintf(dst, len, f, v);
+  };
+  char temp[12], water[12], cas[12], kfl[12], rate[16];
+  fmt(temp, sizeof(temp), s.temp_c, "%.1f");
+  fmt(water, sizeof(water), s.water_c, "%.1f");
+  fmt(cas,  sizeof(cas),  s.case_c, "%.1f");
+  fmt(kfl,  sizeof(kfl),  s.kf_level_pct, "%.2f");
+  fmt(rate, sizeof(rate), s.kf_rate_lph, "%.2f");
+  char msg[352];
+  int n = snprintf(msg, sizeof(msg),
+    "event: status\ndata: {\"level\":%.1f,\"distance\":%.1f,\"volume\":%.1f,"
+    "\"free\":%.1f,\"total\":%.1f,\"temp\":%s,\"water\":%s,\"case\":%s,"
+    "\"kf_level\":%s,\"kf_rate_lph\":%s,\"valid\":%s,\"pings\":%u,\"echoes\":%u,"
+    "\"ts\":%lu,\"tank\":%u}\n\n",
+    s.level_pct, s.distance_cm, s.volume_liters, s.free_liters, s.total_liters,
+    temp, water, cas, kfl, rate, s.valid ? "true" : "false", s.quality.attempted,
+    s.quality.valid, (unsigned long)s.timestamp, s.tank);
+  if (n > 0 && n < (int)sizeof(msg)) _sseBroadcast(msg, n);
+}
+
+inline void ssePushHistory() {
+  if (!sseHasClients()) return;
+  char msg[48];
+  int n = snprintf(msg, sizeof(msg), "event: history\ndata: {\"gen\":%lu}\n\n",
+                   (unsigned long)dataGeneration());
+  if (n > 0 && n < (int)sizeof(msg)) _sseBroadcast(msg, n);
+}
+
+// Keep-alive comments; also notices clients that went away silently.
+inline void sseLoop() {
+  if (millis() - _ssePingAt < SSE_PING_MS) return;
+  _ssePingAt = millis();
+  if (sseHasClients()) _sseBroadcast(": ping\n\n", 8);
+}
+
 // ------------------------------------------------------------------
 // /api/history*.bin  — raw ring backup/restore (exact binary files)
 // Use multipart upload (curl -F file=@...)
@@ -550,7 +952,7 @@ struct HistUploadState {
   File file;
   bool ok = false;
   size_t written = 0;
-  size_t maxBytes = 0;
+  size_t maxBytes = 0;   // largest accepted file; the format is checked on finalize
   bool overflow = false;
 };
 
@@ -559,11 +961,8 @@ static HistUploadState gHistUploadRecent;
 
 static void handleHistoryBinDownload(ESP8266WebServer &srv,
                                      const char *path,
-                                     uint16_t maxRec,
                                      const char *downloadName) {
-  if (!storageValidateRingFile(path, maxRec)) {
-    _storageInitRing(path, maxRec);
-  }
+  if (!LittleFS.exists(path)) storageInit();
   File f = LittleFS.open(path, "r");
   if (!f) { srv.send(500, F("text/plain"), F("Open failed")); return; }
   size_t sz = f.size();
@@ -578,7 +977,7 @@ static void handleHistoryBinDownload(ESP8266WebServer &srv,
 static void handleHistoryBinUploadChunk(ESP8266WebServer &srv,
                                         HistUploadState &st,
                                         const char *tmpPath,
-                                        size_t expectedBytes) {
+                                        size_t maxBytes) {
   HTTPUpload &upload = srv.upload();
   switch (upload.status) {
     case UPLOAD_FILE_START:
@@ -588,7 +987,7 @@ static void handleHistoryBinUploadChunk(ESP8266WebServer &srv,
       st.file = LittleFS.open(tmpPath, "w");
       st.ok = (bool)st.file;
       st.written = 0;
-      st.maxBytes = expectedBytes;
+      st.maxBytes = maxBytes;
       st.overflow = false;
       break;
     case UPLOAD_FILE_WRITE:
@@ -606,11 +1005,6 @@ static void handleHistoryBinUploadChunk(ESP8266WebServer &srv,
       break;
     case UPLOAD_FILE_END:
       if (st.file) st.file.close();
-      if (st.written != st.maxBytes) {
-        st.ok = false;
-        dbgPrintf("[WEB] POST history upload wrong size: %u != %u\n",
-                  (unsigned)st.written, (unsigned)st.maxBytes);
-      }
       dbgPrintf("[WEB] POST history upload end: %u bytes (ok=%u)\n", (unsigned)st.written, st.ok ? 1 : 0);
       break;
     case UPLOAD_FILE_ABORTED:
@@ -627,11 +1021,11 @@ static void handleHistoryBinUploadChunk(ESP8266WebServer &srv,
   }
 }
 
+template <typename Ring>
 static void handleHistoryBinUploadFinalize(ESP8266WebServer &srv,
                                            HistUploadState &st,
                                            const char *tmpPath,
-                                           const char *dstPath,
-                                           uint16_t maxRec,
+                                           Ring &ring,
                                            const char *kind) {
   if (st.file) st.file.close();
   if (!st.ok || !LittleFS.exists(tmpPath)) {
@@ -645,7 +1039,7 @@ static void handleHistoryBinUploadFinalize(ESP8266WebServer &srv,
     sendJson(srv, ovf ? F("{\"ok\":false,\"err\":\"file_too_large\"}") : F("{\"ok\":false,\"err\":\"upload\"}"), 400);
     return;
   }
-  if (!storageReplaceRingFile(tmpPath, dstPath, maxRec)) {
+  if (!storageReplaceRingFile(tmpPath, ring)) {
     LittleFS.remove(tmpPath);
     st.ok = false;
     st.written = 0;
@@ -655,20 +1049,20 @@ static void handleHistoryBinUploadFinalize(ESP8266WebServer &srv,
     sendJson(srv, F("{\"ok\":false,\"err\":\"invalid_history_file\"}"), 400);
     return;
   }
-  HistHeader hdr = {0,0};
-  storageValidateRingFile(dstPath, maxRec, &hdr);
-  _trendCacheForTs = 0;
+  uint16_t count = _storageCountRing(ring);
+  _trendCacheForTs[0] = 0;
+  ssePushHistory();
   StaticJsonDocument<128> doc;
   doc["ok"] = true;
   doc["kind"] = kind;
-  doc["count"] = hdr.count;
-  doc["max"] = maxRec;
+  doc["count"] = count;
+  doc["max"] = _storageRingCapacity(ring);
   String out; serializeJson(doc, out);
   st.ok = false;
   st.written = 0;
   st.maxBytes = 0;
   st.overflow = false;
-  dbgPrintf("[WEB] POST %s restore -> ok (count=%u)\n", kind, hdr.count);
+  dbgPrintf("[WEB] POST %s restore -> ok (count=%u)\n", kind, count);
   sendJson(srv, out);
 }
 
@@ -689,72 +1083,275 @@ static String buildDebugLogs() {
   return out;
 }
 
+// ------------------------------------------------------------------
+// /api/tasks  — scheduler table with lateness and run-time stats
+// ------------------------------------------------------------------
+static void sendTasks(ESP8266WebServer &srv) {
+  unsigned long now = millis();
+  JsonStream js(srv);
+  js.begin();
+  js.beginObject();
+  js.kv(F("uptime"), now / 1000);
+  js.beginArray(F("tasks"));
+  for (uint8_t i = 0; i < schedCount(); i++) {
+    const SchedTask &t = schedTask(i);
+    js.beginObject();
+    js.kv(F("name"),      t.name);
+    js.kv(F("prio"),      t.prio);
+    js.kv(F("period_ms"), t.periodMs);
+    js.kv(F("budget_us"), t.budgetUs);
+    if (t.armed) js.kv(F("next_ms"), (long)(t.due - now));
+    else         js.kvNull(F("next_ms"));
+    js.kv(F("runs"),      t.runs);
+    js.kv(F("overruns"),  t.overruns);
+    js.kv(F("last_us"),   t.lastUs);
+    js.kv(F("max_us"),    t.maxUs);
+    js.kv(F("avg_us"),    t.runs ? (uint32_t)(t.sumUs / t.runs) : 0);
+    js.kv(F("late_max_ms"), t.lateMaxMs);
+    js.kv(F("late_avg_ms"), t.runs ? t.lateSumMs / t.runs : 0);
+    js.endObject();
+  }
+  js.endArray();
+  js.endObject();
+  js.end();
+}
+
+// ------------------------------------------------------------------
+// /api/profile  — latency histograms of loop() call sites, tasks, routes
+// ------------------------------------------------------------------
+static void sendProfile(ESP8266WebServer &srv) {
+  JsonStream js(srv);
+  js.begin();
+  js.beginObject();
+  js.kv(F("uptime"), millis() / 1000);
+  js.beginArray(F("probes"));
+  for (uint8_t i = 0; i < profCount(); i++) {
+    const ProfProbe &p = profProbe(i);
+    js.beginObject();
+    js.kv(F("name"),   p.name);
+    js.kv(F("group"),  profGroupName(p.group));
+    js.kv(F("count"),  p.count);
+    js.kv(F("max_us"), p.maxUs);
+    js.kv(F("p50_us"), profPercentile(p, 0.5f));
+    js.kv(F("p99_us"), profPercentile(p, 0.99f));
+    js.beginArray(F("hist"));   // log2 buckets, see profiler.h
+    for (uint8_t b = 0; b < PROF_BUCKETS; b++) js.value(p.hist[b]);
+    js.endArray();
+    js.endObject();
+  }
+  js.endArray();
+  js.endObject();
+  js.end();
+}
+
+// ------------------------------------------------------------------
+// /api/info  — system info, link state and queue counters. These change
+// between readings, so unlike /api/status this is never ETag'd.
+// ------------------------------------------------------------------
+static void sendInfo(ESP8266WebServer &srv, const Config &c) {
+  JsonStream js(srv);
+  js.begin();
+  js.beginObject();
+  js.kv(F("version"),  FW_VERSION);
+  js.kv(F("chip_id"),  String(ESP.getChipId(), HEX));
+  js.kv(F("flash"),    ESP.getFlashChipSize());
+  js.kv(F("sketch"),   ESP.getSketchSize());
+  js.kv(F("free_sketch"), ESP.getFreeSketchSpace());
+  js.kv(F("heap"),     ESP.getFreeHeap());
+  js.kv(F("uptime"),   millis() / 1000);
+  js.kv(F("hist_heap_min"),  _histHeapMin);   // 0 until the first /api/history request
+  js.kv(F("hist_heap_peak"), _histHeapPeak);
+  js.kv(F("ip"),       WiFi.localIP().toString());
+  js.kv(F("rssi"),     WiFi.RSSI());
+  js.kv(F("wifi"),     (WiFi.status() == WL_CONNECTED));
+  js.kv(F("mqtt"),     mqttConnected());
+  if (c.mqtt_en) {
+    const MqttBufStats &mb = mqttBufStats();
+    js.beginObject(F("mqtt_buf"));
+    js.kv(F("depth"),  mqttBufCount());
+    js.kv(F("max"),    mqttBufCapacity());
+    js.kv(F("stored"), mb.stored);
+    js.kv(F("sent"),   mb.sent);
+    js.kv(F("lost"),   mb.lost);
+    js.endObject();
+    const MqttPubStats &mp = mqttPubStats();
+    js.beginObject(F("mqtt_pub"));
+    js.kv(F("sent"),       mp.sent);
+    js.kv(F("suppressed"), mp.suppressed);
+    js.endObject();
+  }
+  js.kv(F("tg"),       tgEnabled());
+  if (tgEnabled()) {
+    const TgHttp &th = tgHttpStats();
+    js.beginObject(F("tg_link"));
+    js.kv(F("requests"), th.requests);
+    js.kv(F("fails"),    th.fails);
+    js.kv(F("connects"), th.connects);
+    js.kv(F("hs_ms"),    th.lastHsMs);
+    js.kv(F("hs_max_ms"), th.maxHsMs);
+    js.endObject();
+    const TgQueueStats &tq = tgQueueStats();
+    js.beginObject(F("tg_queue"));
+    js.kv(F("depth"),     tgQueueDepth());
+    js.kv(F("slots"),     TG_QUEUE_SLOTS);
+    js.kv(F("sent"),      tq.sent);
+    js.kv(F("dropped"),   tq.dropped);
+    js.kv(F("coalesced"), tq.coalesced);
+    js.kv(F("retries"),   tq.retries);
+    js.kv(F("restored"),  tq.restored);
+    js.kv(F("retry_in_ms"), tgQueueRetryIn());
+    js.endObject();
+  }
+  js.endObject();
+  js.end();
+}
+
+static int8_t _webProbe(const char *uri, HTTPMethod m) {
+  uint8_t g = m == HTTP_GET ? PROF_G_GET : m == HTTP_POST ? PROF_G_POST :
+              m == HTTP_DELETE ? PROF_G_DELETE : PROF_G_OTHER;
+  return profRegister(uri, g);
+}
+
+// srv.on() with the handler timed by its own profiler probe.
+template <typename F>
+static void _webOn(ESP8266WebServer &srv, const char *uri, HTTPMethod m, F fn) {
+  int8_t id = _webProbe(uri, m);
+  srv.on(uri, m, [id, fn]{ PROF_SCOPE(id); _webETag[0] = '\0'; fn(); });
+}
+
+// With a file upload handler: that one runs once per received chunk, so it
+// is timed by a probe of its own in the "upload" group and the route's
+// probe only sees the final request handler.
+template <typename F, typename U>
+static void _webOn(ESP8266WebServer &srv, const char *uri, HTTPMethod m, F fn, U upload) {
+  int8_t id = _webProbe(uri, m);
+  int8_t up = profRegister(uri, PROF_G_UPLOAD);
+  srv.on(uri, m, [id, fn]{ PROF_SCOPE(id); _webETag[0] = '\0'; fn(); },
+                 [up, upload]{ PROF_SCOPE(up); upload(); });
+}
+
+// ?tank=N selects the channel (0-based, default 0)
+static uint8_t _webTankArg(ESP8266WebServer &srv, const Config &cfg) {
+  int t = srv.hasArg("tank") ? srv.arg("tank").toInt() : 0;
+  return (t > 0 && t < cfg.tank_count) ? t : 0;
+}
+
 // ------------------------------------------------------------------
 // Setup all routes
+
 // ------------------------------------------------------------------
 inline void webSetup(ESP8266WebServer &srv,
                      ESP8266HTTPUpdateServer &updater,
                      Config &cfg,
-                     SensorData &sens,
                      std::function<void()> measureCallback,
                      std::function<void()> queueMeasureCallback)
 {
+  // If-None-Match is needed for ETag revalidation; the server drops
+  // request headers that are not collected explicitly.
+  static const char *etagHeaders[] = { "If-None-Match" };
+  srv.collectHeaders(etagHeaders, 1);
+  _webBootId = ESP.random();
+
   // Static files
-  srv.on("/",          HTTP_GET,  [&]{ serveFile(srv, "/index.html", "text/html"); });
-  srv.on("/index.html",HTTP_GET,  [&]{ serveFile(srv, "/index.html", "text/html"); });
-  srv.on("/set.html",  HTTP_GET,  [&]{ serveFile(srv, "/set.html",   "text/html"); });
-  srv.on("/s.css",     HTTP_GET,  [&]{ serveFile(srv, "/s.css",      "text/css");  });
-  srv.on("/c.js",      HTTP_GET,  [&]{ serveFile(srv, "/c.js",       "application/javascript"); });
+  _webOn(srv, "/",          HTTP_GET,  [&]{ serveFile(srv, "/index.html", "text/html"); });
+  _webOn(srv, "/index.html",HTTP_GET,  [&]{ serveFile(srv, "/index.html", "text/html"); });
+  _webOn(srv, "/set.html",  HTTP_GET,  [&]{ serveFile(srv, "/set.html",   "text/html"); });
+  _webOn(srv, "/s.css",     HTTP_GET,  [&]{ serveFile(srv, "/s.css",      "text/css");  });
+  _webOn(srv, "/c.js",      HTTP_GET,  [&]{ serveFile(srv, "/c.js",       "application/javascript"); });
 
   // API - status
-  srv.on("/api/status", HTTP_GET, [&]{
+  _webOn(srv, "/api/status", HTTP_GET, [&]{
     srv.sendHeader(F("Access-Control-Allow-Origin"), "*");
-    sendJson(srv, buildStatus(cfg, sens));
+    uint8_t t = _webTankArg(srv, cfg);
+    if (handleETag(srv, 's', t)) return;
+    sendStatus(srv, cfg, tankData(t));
   });
 
   // API - history
-  srv.on("/api/history", HTTP_GET, [&]{
+  _webOn(srv, "/api/history", HTTP_GET, [&]{
+    int h = srv.hasArg("h") ? srv.arg("h").toInt() : 24;
+    uint8_t t = _webTankArg(srv, cfg);
+    if (handleETag(srv, 'h', (uint32_t)h | (uint32_t)t << 24)) return;
+    sendHistory(srv, h, t);
+  });
+
+  // API - history, packed binary for the dashboard chart
+  _webOn(srv, "/api/history.pack", HTTP_GET, [&]{
     int h = srv.hasArg("h") ? srv.arg("h").toInt() : 24;
-    sendJson(srv, buildHistory(h));
+    uint8_t t = _webTankArg(srv, cfg);
+    if (handleETag(srv, 'p', (uint32_t)h | (uint32_t)t << 24)) return;
+    sendHistoryPack(srv, h, t);
   });
 
+  // API - push channel (SSE) for status/history changes
+  _webOn(srv, "/api/stream", HTTP_GET, [&]{ handleStream(srv); });
+
   // API - derived recent events (fill/drain/leak detection from minute history)
-  srv.on("/api/events", HTTP_GET, [&]{
-    sendJson(srv, buildRecentEvents());
+  _webOn(srv, "/api/events", HTTP_GET, [&]{
+    uint8_t t = _webTankArg(srv, cfg);
+    if (handleETag(srv, 'e', t)) return;
+    sendRecentEvents(srv, t);
   });
 
   // API - debug logs
-  srv.on("/api/logs", HTTP_GET, [&]{
+  _webOn(srv, "/api/logs", HTTP_GET, [&]{
     sendJson(srv, buildDebugLogs());
   });
 
+  // API - scheduler stats; ?reset=1 clears them after sending
+  _webOn(srv, "/api/tasks", HTTP_GET, [&]{
+    sendTasks(srv);
+    if (srv.arg("reset") == "1") schedResetStats();
+  });
+
+  // API - latency profile; ?reset=1 clears it after sending
+  _webOn(srv, "/api/profile", HTTP_GET, [&]{
+    sendProfile(srv);
+    if (srv.arg("reset") == "1") profReset();
+  });
+
   // API - measure now
-  srv.on("/api/measure", HTTP_POST, [&]{
+  _webOn(srv, "/api/measure", HTTP_POST, [&srv, &cfg, queueMeasureCallback]{
     dbgPrintln(F("[WEB] POST /api/measure"));
     queueMeasureCallback();
     srv.sendHeader(F("Connection"), F("close"));
-    sendJson(srv, buildStatus(cfg, sens));
+    sendStatus(srv, cfg, tankData(_webTankArg(srv, cfg)));
   });
 
   // API - get config (mask passwords)
-  srv.on("/api/config", HTTP_GET, [&]{
+  _webOn(srv, "/api/config", HTTP_GET, [&]{
     dbgPrintln(F("[WEB] GET /api/config"));
-    DynamicJsonDocument doc(2048);
+    DynamicJsonDocument doc(3072);
     doc["ws"] = cfg.wifi_ssid;
     doc["wp"] = strlen(cfg.wifi_password) ? "••••••••" : "";
-    doc["tp"] = cfg.trig_pin;
-    doc["ep"] = cfg.echo_pin;
-    doc["ed"] = cfg.empty_dist_cm;
-    doc["fd"] = cfg.full_dist_cm;
-    doc["bd"] = cfg.barrel_diam_cm;
+    doc["nt"] = cfg.tank_count;
+    doc["n0"] = cfg.tanks[0].name;
+    tankToJson(cfg.tanks[0], doc.as<JsonObject>());
+    JsonArray tk = doc.createNestedArray("tk");
+    for (uint8_t i = 1; i < TANK_MAX; i++) {
+      JsonObject o = tk.createNestedObject();
+      o["n"] = cfg.tanks[i].name;
+      tankToJson(cfg.tanks[i], o);
+    }
     doc["as"] = cfg.avg_samples;
+    doc["fm"] = cfg.filter_mode;
+    doc["fk"] = cfg.filter_mad_k;
     doc["ms"] = cfg.measure_sec;
+    doc["mi"] = cfg.measure_min_sec;
     doc["me"] = cfg.mqtt_en;
     doc["mh"] = cfg.mqtt_host;
     doc["mp"] = cfg.mqtt_port;
     doc["mu"] = cfg.mqtt_user;
     doc["mq"] = strlen(cfg.mqtt_pass) ? "••••••••" : "";
     doc["mt"] = cfg.mqtt_topic;
+    doc["mb"] = cfg.mqtt_buf;
+    doc["mr"] = cfg.mqtt_drain;
+    doc["mhb"] = cfg.mqtt_hb;
+    doc["mdl"] = cfg.mqtt_db_level;
+    doc["mdd"] = cfg.mqtt_db_dist;
+    doc["mdv"] = cfg.mqtt_db_vol;
+    doc["mdt"] = cfg.mqtt_db_temp;
+    doc["mdr"] = cfg.mqtt_db_rate;
     doc["te"] = cfg.tg_en;
     doc["tx"] = cfg.tg_cmd_en;
     doc["tal"] = cfg.tg_alert_low_en;
@@ -767,6 +1364,9 @@ inline void webSetup(ESP8266WebServer &srv,
     doc["td"] = cfg.tg_daily;
     doc["dp"] = cfg.ds18_pin;
     doc["de"] = cfg.ds18_en;
+    doc["da"] = cfg.ds18_rom[TEMP_AIR];
+    doc["dw"] = cfg.ds18_rom[TEMP_WATER];
+    doc["dc"] = cfg.ds18_rom[TEMP_CASE];
     doc["dn"] = cfg.device_name;
     doc["op"] = "";  // never expose OTA password
     String out; serializeJson(doc, out);
@@ -774,12 +1374,12 @@ inline void webSetup(ESP8266WebServer &srv,
   });
 
   // API - scan WiFi networks
-  srv.on("/api/wifi-scan", HTTP_GET, [&]{
+  _webOn(srv, "/api/wifi-scan", HTTP_GET, [&]{
     sendJson(srv, buildWifiScan());
   });
 
   // API - save config
-  srv.on("/api/config", HTTP_POST, [&]{
+  _webOn(srv, "/api/config", HTTP_POST, [&]{
     dbgPrintln(F("[WEB] POST /api/config"));
     if (!srv.hasArg("plain")) {
       dbgPrintln(F("[WEB] POST /api/config -> 400 (no body)"));
@@ -793,6 +1393,20 @@ inline void webSetup(ESP8266WebServer &srv,
       return;
     }
 
+    // Refuse an ECHO pin without an interrupt before anything is applied;
+    // sanitizeConfig() would silently put the default back.
+    int badEcho = -1;
+    if (!doc["ep"].isNull() && !echoPinValid(doc["ep"])) badEcho = 0;
+    for (uint8_t i = 1; badEcho < 0 && i < TANK_MAX && i <= doc["tk"].size(); i++) {
+      JsonObjectConst o = doc["tk"][i - 1];
+      if (!o["ep"].isNull() && !echoPinValid(o["ep"])) badEcho = i;
+    }
+    if (badEcho >= 0) {
+      dbgPrintf("[WEB] POST /api/config -> 400 (tank%d echo pin)\n", badEcho + 1);
+      sendJson(srv, String(F("{\"ok\":false,\"err\":\"echo_pin\",\"tank\":")) + (badEcho + 1) + '}', 400);
+      return;
+    }
+
     auto copyStr = [&](const char *key, char *dst, size_t len) {
       if (doc.containsKey(key) && doc[key].as<String>() != "••••••••")
         strlcpy(dst, doc[key] | "", len);
@@ -803,19 +1417,46 @@ inline void webSetup(ESP8266WebServer &srv,
 
     copyStr("ws", cfg.wifi_ssid,    sizeof(cfg.wifi_ssid));
     copyStr("wp", cfg.wifi_password, sizeof(cfg.wifi_password));
-    if (hasValue("tp")) cfg.trig_pin      = doc["tp"];
-    if (hasValue("ep")) cfg.echo_pin      = doc["ep"];
-    if (hasValue("ed")) cfg.empty_dist_cm = doc["ed"];
-    if (hasValue("fd")) cfg.full_dist_cm  = doc["fd"];
-    if (hasValue("bd")) cfg.barrel_diam_cm = doc["bd"];
+    // Tank calibration: tank 0 at top level, tanks 1.. as "tk":[{n,tp,ep,ed,fd,bd,…},…]
+    auto setTank = [&](TankCal &t, JsonObjectConst o) {
+      auto has = [&](const char *key) { return o.containsKey(key) && !o[key].isNull(); };
+      if (has("tp")) t.trig_pin       = o["tp"];
+      if (has("ep")) t.echo_pin       = o["ep"];
+      if (has("ed")) t.empty_dist_cm  = o["ed"];
+      if (has("fd")) t.full_dist_cm   = o["fd"];
+      if (has("bd")) t.barrel_diam_cm = o["bd"];
+      if (has("sh")) t.shape          = o["sh"];
+      if (has("bw")) t.width_cm       = o["bw"];
+      if (has("bl")) t.length_cm      = o["bl"];
+      if (has("bc")) t.cone_cm        = o["bc"];
+    };
+    if (hasValue("nt")) cfg.tank_count = doc["nt"];
+    copyStr("n0", cfg.tanks[0].name, sizeof(cfg.tanks[0].name));
+    setTank(cfg.tanks[0], doc.as<JsonObjectConst>());
+    for (uint8_t i = 1; i < TANK_MAX && i <= doc["tk"].size(); i++) {
+      JsonObjectConst o = doc["tk"][i - 1];
+      if (o.containsKey("n")) strlcpy(cfg.tanks[i].name, o["n"] | "", sizeof(cfg.tanks[i].name));
+      setTank(cfg.tanks[i], o);
+    }
     if (hasValue("as")) cfg.avg_samples   = doc["as"];
+    if (hasValue("fm")) cfg.filter_mode   = doc["fm"];
+    if (hasValue("fk")) cfg.filter_mad_k  = doc["fk"];
     if (hasValue("ms")) cfg.measure_sec   = doc["ms"];
+    if (hasValue("mi")) cfg.measure_min_sec = doc["mi"];
     if (doc.containsKey("me")) cfg.mqtt_en        = doc["me"];
     copyStr("mh", cfg.mqtt_host,  sizeof(cfg.mqtt_host));
     if (hasValue("mp")) cfg.mqtt_port = doc["mp"];
     copyStr("mu", cfg.mqtt_user, sizeof(cfg.mqtt_user));
     copyStr("mq", cfg.mqtt_pass, sizeof(cfg.mqtt_pass));
     copyStr("mt", cfg.mqtt_topic, sizeof(cfg.mqtt_topic));
+    if (hasValue("mb")) cfg.mqtt_buf   = doc["mb"];
+    if (hasValue("mr")) cfg.mqtt_drain = doc["mr"];
+    if (hasValue("mhb")) cfg.mqtt_hb      = doc["mhb"];
+    if (hasValue("mdl")) cfg.mqtt_db_level = doc["mdl"];
+    if (hasValue("mdd")) cfg.mqtt_db_dist  = doc["mdd"];
+    if (hasValue("mdv")) cfg.mqtt_db_vol   = doc["mdv"];
+    if (hasValue("mdt")) cfg.mqtt_db_temp  = doc["mdt"];
+    if (hasValue("mdr")) cfg.mqtt_db_rate  = doc["mdr"];
     if (doc.containsKey("te")) cfg.tg_en = doc["te"];
     if (doc.containsKey("tx")) cfg.tg_cmd_en = doc["tx"];
     if (doc.containsKey("ta")) { // legacy UI compatibility
@@ -833,6 +1474,9 @@ inline void webSetup(ESP8266WebServer &srv,
     if (doc.containsKey("td")) cfg.tg_daily  = doc["td"];
     if (hasValue("dp")) cfg.ds18_pin  = doc["dp"];
     if (doc.containsKey("de")) cfg.ds18_en   = doc["de"];
+    copyStr("da", cfg.ds18_rom[TEMP_AIR],   sizeof(cfg.ds18_rom[0]));
+    copyStr("dw", cfg.ds18_rom[TEMP_WATER], sizeof(cfg.ds18_rom[0]));
+    copyStr("dc", cfg.ds18_rom[TEMP_CASE],  sizeof(cfg.ds18_rom[0]));
     copyStr("dn", cfg.device_name, sizeof(cfg.device_name));
     copyStr("op", cfg.ota_pass,    sizeof(cfg.ota_pass));
 
@@ -846,70 +1490,100 @@ inline void webSetup(ESP8266WebServer &srv,
   });
 
   // API - export CSV
-  srv.on("/api/export", HTTP_GET, [&]{ handleExport(srv); });
+  _webOn(srv, "/api/export", HTTP_GET, [&]{
+    uint8_t t = _webTankArg(srv, cfg);
+    if (handleETag(srv, 'x', t)) return;
+    handleExport(srv, t);
+  });
 
   // API - exact config backup/restore (includes secrets)
-  srv.on("/api/config.raw", HTTP_GET, [&]{ handleConfigRawDownload(srv); });
-  srv.on("/api/config.raw", HTTP_POST, [&]{ handleConfigRawRestore(srv); });
+  _webOn(srv, "/api/config.raw", HTTP_GET, [&]{ handleConfigRawDownload(srv); });
+  _webOn(srv, "/api/config.raw", HTTP_POST, [&]{ handleConfigRawRestore(srv); });
 
-  // API - exact binary backup/restore for history rings
-  srv.on("/api/history.bin", HTTP_GET, [&]{
-    handleHistoryBinDownload(srv, HIST_FILE, MAX_REC, "history-hourly.bin");
+  // API - exact binary backup/restore for history rings (tank 1 only)
+  _webOn(srv, "/api/history.bin", HTTP_GET, [&]{
+    handleHistoryBinDownload(srv, HIST_FILE, "history-hourly.bin");
   });
-  srv.on("/api/history_recent.bin", HTTP_GET, [&]{
-    handleHistoryBinDownload(srv, HIST_RECENT_FILE, MAX_RECENT_REC, "history-recent.bin");
+  _webOn(srv, "/api/history_recent.bin", HTTP_GET, [&]{
+    handleHistoryBinDownload(srv, HIST_RECENT_FILE, "history-recent.bin");
   });
-  srv.on("/api/history.bin", HTTP_POST,
+  // Hourly restore accepts a packed v2/v3 file or a v1 backup (converted on load);
+  // recent restore the tagged file or an untagged one of an older layout.
+  _webOn(srv, "/api/history.bin", HTTP_POST,
     [&]{
-      handleHistoryBinUploadFinalize(srv, gHistUploadHourly, "/hist_hourly.upload.tmp", HIST_FILE, MAX_REC, "hourly");
+      handleHistoryBinUploadFinalize(srv, gHistUploadHourly, "/hist_hourly.upload.tmp", storageHourlyRing(0), "hourly");
     },
     [&]{
       handleHistoryBinUploadChunk(srv, gHistUploadHourly, "/hist_hourly.upload.tmp",
-                                  sizeof(HistHeader) + (size_t)MAX_REC * sizeof(HistRecord));
+                                  max(storagePackFileSize(),
+                                      _storageRingFileSize(HIST_LEGACY_MAX_REC, HIST_V1_REC_SIZE)));
     }
   );
-  srv.on("/api/history_recent.bin", HTTP_POST,
+  _webOn(srv, "/api/history_recent.bin", HTTP_POST,
     [&]{
-      handleHistoryBinUploadFinalize(srv, gHistUploadRecent, "/hist_recent.upload.tmp", HIST_RECENT_FILE, MAX_RECENT_REC, "recent");
+      handleHistoryBinUploadFinalize(srv, gHistUploadRecent, "/hist_recent.upload.tmp", storageRecentRing(0), "recent");
     },
     [&]{
       handleHistoryBinUploadChunk(srv, gHistUploadRecent, "/hist_recent.upload.tmp",
-                                  sizeof(HistHeader) + (size_t)MAX_RECENT_REC * sizeof(HistRecord));
+                                  storageRecentFileSize());
     }
   );
 
+  // API - strapping table (CSV "height_cm,litres" per line) for SHAPE_TABLE
+  _webOn(srv, "/api/strap", HTTP_GET, [&]{
+    const char *path = strapPath(_webTankArg(srv, cfg));
+    if (!LittleFS.exists(path)) { srv.send(404, F("text/plain"), F("No table")); return; }
+    serveFile(srv, path, "text/csv");
+  });
+  _webOn(srv, "/api/strap", HTTP_POST, [&]{
+    uint8_t t = _webTankArg(srv, cfg);
+    dbgPrintf("[WEB] POST /api/strap tank%u\n", t + 1);
+    if (!srv.hasArg("plain") || srv.arg("plain").length() > STRAP_MAX_BYTES) {
+      sendJson(srv, F("{\"ok\":false,\"err\":\"bad_size\"}"), 400);
+      return;
+    }
+    int n = strapSave(t, srv.arg("plain"));
+    if (n < 0) {
+      sendJson(srv, F("{\"ok\":false,\"err\":\"invalid_table\"}"), 400);
+      return;
+    }
+    SensorData &s = tankData(t);
+    if (s.valid) computeLevel(cfg.tanks[t], s.distance_cm, s);   // show new volume right away
+    dataGenerationBump();
+    sendJson(srv, String(F("{\"ok\":true,\"points\":")) + n + '}');
+  });
+  _webOn(srv, "/api/strap", HTTP_DELETE, [&]{
+    uint8_t t = _webTankArg(srv, cfg);
+    dbgPrintf("[WEB] DELETE /api/strap tank%u\n", t + 1);
+    strapRemove(t);
+    SensorData &s = tankData(t);
+    if (s.valid) computeLevel(cfg.tanks[t], s.distance_cm, s);   // drop the table volume right away
+    dataGenerationBump();
+    sendJson(srv, F("{\"ok\":true}"));
+  });
+
   // API - clear history
-  srv.on("/api/history", HTTP_DELETE, [&]{
+  _webOn(srv, "/api/history", HTTP_DELETE, [&]{
     dbgPrintln(F("[WEB] DELETE /api/history"));
-    storageClear();
-    _trendCacheForTs = 0;
+    storageClear(cfg.tank_count);
+    memset(_trendCacheForTs, 0, sizeof(_trendCacheForTs));
+    ssePushHistory();
     sendJson(srv, F("{\"ok\":true}"));
   });
 
   // API - factory reset
-  srv.on("/api/reset", HTTP_POST, [&]{
+  _webOn(srv, "/api/reset", HTTP_POST, [&]{
     dbgPrintln(F("[WEB] POST /api/reset"));
     LittleFS.remove(CONFIG_FILE);
-    storageClear();
-    _trendCacheForTs = 0;
+    storageClear(cfg.tank_count);
+    memset(_trendCacheForTs, 0, sizeof(_trendCacheForTs));
     sendJson(srv, F("{\"ok\":true}"));
     delay(500);
     ESP.restart();
   });
 
   // API - system info
-  srv.on("/api/info", HTTP_GET, [&]{
-    StaticJsonDocument<256> doc;
-    doc["version"]   = FW_VERSION;
-    doc["chip_id"]   = String(ESP.getChipId(), HEX);
-    doc["flash"]     = ESP.getFlashChipSize();
-    doc["sketch"]    = ESP.getSketchSize();
-    doc["free_sketch"] = ESP.getFreeSketchSpace();
-    doc["heap"]      = ESP.getFreeHeap();
-    doc["uptime"]    = millis() / 1000;
-    String out; serializeJson(doc, out);
-    sendJson(srv, out);
-  });
+  _webOn(srv, "/api/info", HTTP_GET, [&]{ sendInfo(srv, cfg); });
 
   // OTA web update
   updater.setup(&srv, "/update", "admin", cfg.ota_pass);
@@ -0,0 +1,183 @@
+#pragma once
+// Host shim of the Arduino core: just enough of the ESP8266 API for the
+// firmware headers to compile and run on a PC. Time only moves when a
+// test advances shimMs/shimUs (or calls delay()).
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <functional>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define PI    3.14159265358979f
+#define HEX   16
+#define HIGH  1
+#define LOW   0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+#define RISING  1
+#define FALLING 2
+#define CHANGE  3
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+
+class __FlashStringHelper;
+#define F(s)      (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(s)  (reinterpret_cast<const __FlashStringHelper *>(s))
+#define PSTR(s)   (s)
+#define PGM_P     const char *
+#define strlen_P  strlen
+#define memcpy_P  memcpy
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+
+inline size_t strlcpy(char *d, const char *s, size_t n) {
+  size_t l = strlen(s);
+  if (n) {
+    size_t c = l < n - 1 ? l : n - 1;
+    memcpy(d, s, c);
+    d[c] = '\0';
+  }
+  return l;
+}
+
+inline size_t strlcat(char *d, const char *s, size_t n) {
+  size_t l = strlen(d);
+  return l + strlcpy(d + l, s, n > l ? n - l : 0);
+}
+
+class String {
+ public:
+  std::string s;
+
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &x) : s(x) {}
+  String(const __FlashStringHelper *f) : s((const char *)f) {}
+  String(char c) : s(1, c) {}
+  explicit String(int v, int base = 10)           { fmt(base == 16 ? "%x" : "%d", v); }
+  explicit String(unsigned v, int base = 10)      { fmt(base == 16 ? "%x" : "%u", v); }
+  explicit String(long v, int base = 10)          { fmt(base == 16 ? "%lx" : "%ld", v); }
+  explicit String(unsigned long v, int base = 10) { fmt(base == 16 ? "%lx" : "%lu", v); }
+  String(float v, int d)  { char b[40]; snprintf(b, sizeof(b), "%.*f", d, v); s = b; }
+  String(double v, int d) { char b[40]; snprintf(b, sizeof(b), "%.*f", d, v); s = b; }
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned length() const   { return s.size(); }
+  bool reserve(unsigned)    { return true; }
+
+  String &operator+=(const String &o)               { s += o.s; return *this; }
+  String &operator+=(const char *o)                 { s += o; return *this; }
+  String &operator+=(char c)                        { s += c; return *this; }
+  String &operator+=(const __FlashStringHelper *o)  { s += (const char *)o; return *this; }
+  String &operator+=(int v)           { return *this += String(v); }
+  String &operator+=(unsigned v)      { return *this += String(v); }
+  String &operator+=(long v)          { return *this += String(v); }
+  String &operator+=(unsigned long v) { return *this += String(v); }
+  String &concat(const char *c, unsigned n) { s.append(c, n); return *this; }
+  bool concat(const String &o)              { s += o.s; return true; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+  friend String operator+(const String &a, const char *b)   { return String(a.s + b); }
+  friend String operator+(const String &a, char b)          { return String(a.s + b); }
+  friend String operator+(const String &a, const __FlashStringHelper *b) {
+    return String(a.s + (const char *)b);
+  }
+
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const   { return s == o; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *o) const   { return s != o; }
+  char operator[](unsigned i) const { return s[i]; }
+  char charAt(unsigned i) const     { return s[i]; }
+
+  long toInt() const     { return atol(s.c_str()); }
+  float toFloat() const  { return atof(s.c_str()); }
+  void trim()        {}
+  void toLowerCase() { for (char &c : s) c = tolower((unsigned char)c); }
+  String substring(unsigned a) const             { return s.substr(a); }
+  String substring(unsigned a, unsigned b) const { return s.substr(a, b - a); }
+  int indexOf(char c) const        { auto p = s.find(c); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const char *c) const { auto p = s.find(c); return p == std::string::npos ? -1 : (int)p; }
+  bool startsWith(const char *p) const   { return s.rfind(p, 0) == 0; }
+  bool startsWith(const String &p) const { return s.rfind(p.s, 0) == 0; }
+  bool endsWith(const char *p) const {
+    size_t n = strlen(p);
+    return s.size() >= n && s.compare(s.size() - n, n, p) == 0;
+  }
+  void remove(unsigned i) { if (i < s.size()) s.erase(i); }
+  void clear()            { s.clear(); }
+
+ private:
+  template <typename T> void fmt(const char *f, T v) { char b[24]; snprintf(b, sizeof(b), f, v); s = b; }
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) write(b[i]);
+    return n;
+  }
+  size_t write(const char *s)           { return write((const uint8_t *)s, strlen(s)); }
+  size_t write(const char *s, size_t n) { return write((const uint8_t *)s, n); }
+  // Console output is dropped; tests report through their own printf.
+  template <class T> size_t print(const T &)        { return 0; }
+  template <class T> size_t print(const T &, int)   { return 0; }
+  template <class T> size_t println(const T &)      { return 0; }
+  size_t println()                                  { return 0; }
+  size_t printf(const char *, ...)                  { return 0; }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read()      { return -1; }
+  virtual int peek()      { return -1; }
+  void setTimeout(unsigned long) {}
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+// Simulated clock, advanced by the tests.
+extern unsigned long shimMs, shimUs;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned us);
+void yield();
+
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int  digitalRead(uint8_t);
+int  digitalPinToInterrupt(uint8_t);
+void attachInterrupt(int, void (*)(), int);
+void detachInterrupt(int);
+void noInterrupts();
+void interrupts();
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getChipId();
+  void restart();
+};
+extern EspClass ESP;
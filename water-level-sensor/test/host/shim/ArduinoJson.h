@@ -0,0 +1,83 @@
+#pragma once
+// Inert ArduinoJson: documents accept any assignment and read back as
+// empty. Enough for config.h and the MQTT discovery code to compile; the
+// code under test builds its payloads with snprintf.
+#include <Arduino.h>
+
+struct JsonArray;
+struct JsonObject;
+
+struct SerializedValue { const char *p; };
+inline SerializedValue serialized(const char *p)   { return { p }; }
+inline SerializedValue serialized(const String &p) { return { p.c_str() }; }
+
+struct JsonVariant {
+  template <class T> JsonVariant &operator=(const T &) { return *this; }
+  template <class T> operator T() const { return T(); }
+  template <class T> T as() const       { return T(); }
+  template <class T> bool is() const    { return false; }
+  template <class T> T operator|(const T &d) const { return d; }
+  const char *operator|(const char *d) const       { return d; }
+  template <class K> JsonVariant operator[](const K &) const { return JsonVariant(); }
+  bool isNull() const { return true; }
+  size_t size() const { return 0; }
+  template <class K> bool containsKey(const K &) const { return false; }
+  JsonArray createNestedArray();
+  JsonObject createNestedObject();
+  template <class K> JsonArray createNestedArray(const K &);
+  template <class K> JsonObject createNestedObject(const K &);
+};
+
+struct JsonArray : JsonVariant {
+  template <class T> bool add(const T &) { return true; }
+  JsonObject *begin() const { return nullptr; }
+  JsonObject *end() const   { return nullptr; }
+};
+struct JsonObject      : JsonVariant {};
+struct JsonObjectConst : JsonVariant {};
+struct JsonArrayConst  : JsonVariant {};
+
+inline JsonArray  JsonVariant::createNestedArray()  { return {}; }
+inline JsonObject JsonVariant::createNestedObject() { return {}; }
+template <class K> JsonArray  JsonVariant::createNestedArray(const K &)  { return {}; }
+template <class K> JsonObject JsonVariant::createNestedObject(const K &) { return {}; }
+
+struct JsonDocument : JsonVariant {
+  bool overflowed() const    { return false; }
+  size_t memoryUsage() const { return 0; }
+  size_t capacity() const    { return 0; }
+  void clear() {}
+  template <class T> T to() { return T(); }
+  using JsonVariant::operator=;
+};
+struct DynamicJsonDocument : JsonDocument {
+  explicit DynamicJsonDocument(size_t) {}
+  using JsonVariant::operator=;
+};
+template <size_t N> struct StaticJsonDocument : JsonDocument {
+  using JsonVariant::operator=;
+};
+
+struct DeserializationError {
+  explicit operator bool() const { return false; }
+  const char *c_str() const { return ""; }
+};
+
+namespace DeserializationOption {
+struct Filter {
+  Filter() {}
+  explicit Filter(const JsonVariant &) {}
+};
+}
+
+template <class S> size_t serializeJson(const JsonVariant &, S &) { return 0; }
+inline size_t serializeJson(const JsonVariant &, char *out, size_t n) {
+  if (n) out[0] = '\0';
+  return 0;
+}
+template <class S> size_t measureJson(const S &) { return 0; }
+template <class S> DeserializationError deserializeJson(JsonDocument &, S &&) { return {}; }
+inline DeserializationError deserializeJson(JsonDocument &, const char *, size_t) { return {}; }
+inline DeserializationError deserializeJson(JsonDocument &, const uint8_t *, size_t) { return {}; }
+inline DeserializationError deserializeJson(JsonDocument &, const char *, size_t,
+                                            DeserializationOption::Filter) { return {}; }
@@ -0,0 +1,31 @@
+#pragma once
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+
+struct IPAddress {
+  String toString() const { return String("192.168.1.50"); }
+};
+
+class WiFiClass {
+ public:
+  int status()         { return WL_CONNECTED; }
+  IPAddress localIP()  { return {}; }
+  int RSSI()           { return -55; }
+};
+extern WiFiClass WiFi;
+
+class Client : public Stream {
+ public:
+  virtual int connect(const char *, uint16_t) { return 1; }
+  virtual uint8_t connected() { return 1; }
+  virtual void stop() {}
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *, size_t n) override { return n; }
+  using Print::write;
+  int read(uint8_t *, size_t) { return 0; }
+  using Stream::read;
+  void setTimeout(unsigned long) {}
+};
+
+class WiFiClient : public Client {};
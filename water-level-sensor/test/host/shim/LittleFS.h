@@ -0,0 +1,135 @@
+#pragma once
+// In-memory LittleFS. Every file operation the firmware issues is counted
+// in shimFs().ops, so tests can assert how much flash I/O a code path does.
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+struct ShimFsOps {
+  long opens, sizes, reads, writes, seeks;
+  long bytesRead, bytesWritten;
+};
+
+struct ShimFs {
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  ShimFsOps ops = {};
+};
+
+inline ShimFs &shimFs() {
+  static ShimFs fs;
+  return fs;
+}
+
+class File : public Stream {
+ public:
+  std::shared_ptr<std::vector<uint8_t>> d;
+  size_t p = 0;
+  bool   open_ = false;
+
+  explicit operator bool() const { return open_; }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t *b, size_t n) override {
+    if (!open_) return 0;
+    shimFs().ops.writes++;
+    shimFs().ops.bytesWritten += n;
+    if (d->size() < p + n) d->resize(p + n);
+    memcpy(d->data() + p, b, n);
+    p += n;
+    return n;
+  }
+  using Print::write;
+
+  int available() override { return open_ ? (int)(d->size() - p) : 0; }
+  int read() override {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+  }
+  size_t read(uint8_t *b, size_t n) {
+    if (!open_) return 0;
+    shimFs().ops.reads++;
+    size_t k = d->size() > p ? std::min(n, d->size() - p) : 0;
+    memcpy(b, d->data() + p, k);
+    p += k;
+    shimFs().ops.bytesRead += k;
+    return k;
+  }
+  bool seek(uint32_t o, SeekMode m = SeekSet) {
+    if (!open_) return false;
+    shimFs().ops.seeks++;
+    p = m == SeekSet ? o : m == SeekCur ? p + o : d->size() + o;
+    return p <= d->size();
+  }
+  size_t position() const { return p; }
+  size_t size() const {
+    if (!open_) return 0;
+    shimFs().ops.sizes++;
+    return d->size();
+  }
+  bool truncate(uint32_t n) {
+    if (!open_) return false;
+    d->resize(n);
+    return true;
+  }
+  void close() {
+    open_ = false;
+    d.reset();
+  }
+  const char *name() const { return ""; }
+  String readString() {
+    std::string r;
+    int c;
+    while ((c = read()) >= 0) r += (char)c;
+    return String(r);
+  }
+};
+
+struct FSInfo {
+  size_t totalBytes, usedBytes, blockSize, pageSize, maxOpenFiles, maxPathLength;
+};
+
+class FS {
+ public:
+  bool begin()  { return true; }
+  bool format() { shimFs().files.clear(); return true; }
+
+  File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+  File open(const char *path, const char *mode) {
+    ShimFs &fs = shimFs();
+    fs.ops.opens++;
+    File f;
+    auto it = fs.files.find(path);
+    if (mode[0] == 'r') {
+      if (it == fs.files.end()) return f;
+      f.d = it->second;
+    } else if (mode[0] == 'w') {
+      f.d = std::make_shared<std::vector<uint8_t>>();
+      fs.files[path] = f.d;
+    } else {   // "a"
+      if (it == fs.files.end()) fs.files[path] = std::make_shared<std::vector<uint8_t>>();
+      f.d = fs.files[path];
+      f.p = f.d->size();
+    }
+    f.open_ = true;
+    return f;
+  }
+  bool exists(const char *path) { return shimFs().files.count(path) > 0; }
+  bool remove(const char *path) { return shimFs().files.erase(path) > 0; }
+  bool rename(const char *from, const char *to) {
+    auto &files = shimFs().files;
+    auto it = files.find(from);
+    if (it == files.end()) return false;
+    files[to] = it->second;
+    files.erase(it);
+    return true;
+  }
+  bool info(FSInfo &i) {
+    i = { 1u << 20, 0, 4096, 256, 5, 32 };
+    return true;
+  }
+};
+
+inline FS LittleFS;
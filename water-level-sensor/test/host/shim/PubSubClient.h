@@ -0,0 +1,50 @@
+#pragma once
+// PubSubClient talking to an in-process broker stand-in. Tests take the
+// broker down and up (shimBroker.up) and inspect what was published.
+#include <ESP8266WiFi.h>
+#include <vector>
+
+struct ShimMqttMsg {
+  std::string topic, payload;
+  bool        retained;
+};
+
+struct ShimBroker {
+  bool up = true;                     // accepts connections and publishes
+  int  connects = 0;
+  std::vector<ShimMqttMsg> msgs;      // everything accepted, in order
+  std::string willTopic, willMsg;
+};
+extern ShimBroker shimBroker;
+
+class PubSubClient {
+ public:
+  explicit PubSubClient(Client &) {}
+  void setServer(const char *, uint16_t) {}
+  bool setBufferSize(uint16_t) { return true; }
+  bool connect(const char *, const char *, const char *, const char *willTopic,
+               uint8_t, bool, const char *willMsg) {
+    _session = shimBroker.up;
+    if (_session) {
+      shimBroker.connects++;
+      shimBroker.willTopic = willTopic ? willTopic : "";
+      shimBroker.willMsg   = willMsg ? willMsg : "";
+    }
+    return _session;
+  }
+  bool connected() {
+    if (!shimBroker.up) _session = false;   // the broker dropped us
+    return _session;
+  }
+  int  state() { return _session ? 0 : -2; }
+  bool loop()  { return connected(); }
+  bool publish(const char *topic, const char *payload, bool retained = false) {
+    if (!connected()) return false;
+    shimBroker.msgs.push_back({ topic, payload, retained });
+    return true;
+  }
+  void disconnect() { _session = false; }
+
+ private:
+  bool _session = false;
+};
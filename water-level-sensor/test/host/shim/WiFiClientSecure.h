@@ -0,0 +1,61 @@
+#pragma once
+// WiFiClientSecure wired to a scripted HTTPS peer. The test queues the
+// server's bytes in shimTls.reply (delivered at most shimTls.chunk bytes
+// per available()/read() round, like TLS records), reads what the client
+// sent from shimTls.sent, and can refuse or drop connections. There is
+// no TLS on the host; the handshake only costs shimTls.handshakeMs of
+// simulated time.
+#include <ESP8266WiFi.h>
+
+namespace BearSSL { class Session {}; }
+
+struct ShimTlsPeer {
+  std::string   host;                // target of the last connect()
+  uint16_t      port = 0;
+  bool          accept = true;
+  bool          open = false;        // connection established and not closed
+  int           connects = 0;
+  unsigned long handshakeMs = 150;
+  size_t        chunk = 1460;
+  std::string   reply;               // server → client, not yet read
+  std::string   sent;                // client → server
+};
+extern ShimTlsPeer shimTls;
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  void setInsecure() {}
+  void setBufferSizes(int, int) {}
+  void setSession(BearSSL::Session *) {}
+  void setTimeout(unsigned long) {}
+
+  int connect(const char *host, uint16_t port) override {
+    shimTls.host = host;
+    shimTls.port = port;
+    shimMs += shimTls.handshakeMs;
+    shimTls.connects++;
+    shimTls.open = shimTls.accept;
+    return shimTls.open;
+  }
+  // Like the real client, bytes already received stay readable after the
+  // peer closed.
+  uint8_t connected() override { return shimTls.open || !shimTls.reply.empty(); }
+  void stop() override {
+    shimTls.open = false;
+    shimTls.reply.clear();
+  }
+  int available() override { return (int)std::min(shimTls.reply.size(), shimTls.chunk); }
+  int read(uint8_t *b, size_t n) {
+    n = std::min(n, (size_t)available());
+    memcpy(b, shimTls.reply.data(), n);
+    shimTls.reply.erase(0, n);
+    return (int)n;
+  }
+  using Stream::read;
+  size_t write(const uint8_t *b, size_t n) override {
+    if (!shimTls.open) return 0;
+    shimTls.sent.append((const char *)b, n);
+    return n;
+  }
+  using Print::write;
+};
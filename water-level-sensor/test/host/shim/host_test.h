@@ -0,0 +1,21 @@
+#pragma once
+// Minimal test helpers: CHECK() reports and counts failures without
+// stopping, so one run lists every broken expectation.
+#include <stdio.h>
+
+static int _testFailures = 0;
+
+#define CHECK(cond) do {                                                   \
+    if (!(cond)) {                                                         \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      _testFailures++;                                                     \
+    }                                                                      \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tol) CHECK(fabs((double)(a) - (double)(b)) <= (tol))
+
+// Print the verdict and return the process exit code.
+inline int testDone(const char *name) {
+  printf("%s: %s\n", name, _testFailures ? "FAILED" : "ok");
+  return _testFailures ? 1 : 0;
+}
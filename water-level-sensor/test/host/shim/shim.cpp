@@ -0,0 +1,32 @@
+// Runtime for the host shim: clock, serial, chip and network stand-ins.
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+#include <WiFiClientSecure.h>
+
+HardwareSerial Serial;
+EspClass       ESP;
+WiFiClass      WiFi;
+ShimBroker     shimBroker;
+ShimTlsPeer    shimTls;
+
+unsigned long shimMs = 0, shimUs = 0;
+
+unsigned long millis() { return shimMs; }
+unsigned long micros() { return shimUs; }
+void delay(unsigned long ms)        { shimMs += ms; shimUs += ms * 1000; }
+void delayMicroseconds(unsigned us) { shimUs += us; }
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int  digitalRead(uint8_t) { return LOW; }
+int  digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(int, void (*)(), int) {}
+void detachInterrupt(int) {}
+void noInterrupts() {}
+void interrupts() {}
+
+uint32_t EspClass::getFreeHeap() { return 30000; }
+uint32_t EspClass::getChipId()   { return 0x123456; }
+void     EspClass::restart() {}
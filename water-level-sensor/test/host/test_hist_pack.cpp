@@ -0,0 +1,288 @@
+// Packed hourly history (storage.h, format v3): lossy round trip within the
+// documented tolerances, ring wrap-around, reload from flash, and upgrades
+// from v1 fixed records (at boot and restored from the web) and v2 packed
+// rings.
+#include "host_test.h"
+#include "storage.h"
+#include <random>
+#include <vector>
+
+static const uint32_t T0 = 1700000000;
+
+// Hourly readings as the device writes them: cadence jitter, a few long
+// gaps (reboots), slow drain with refills, probes that come and go.
+static std::vector<HistRecord> synth(int n) {
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0, 0.3f);
+  std::vector<HistRecord> v;
+  float level = 80;
+  uint32_t ts = T0;
+  for (int i = 0; i < n; i++) {
+    ts += 3600 + rng() % 41 - 20;
+    if (i % 500 == 250) ts += 5 * 3600;
+    int hour = ts / 3600 % 24;
+    if (hour >= 7 && hour <= 21) level -= 0.4f;
+    if (i % 240 == 0 || level < 5) level = 95;
+    HistRecord r;
+    r.ts      = ts;
+    r.level   = level + noise(rng);
+    r.volume  = r.level * 2.04f + noise(rng) * 0.1f;
+    r.temp_c  = i % 1000 == 5 ? NAN : 12 + 8 * sinf(i * 6.283f / 24) + noise(rng);
+    r.water_c = i % 7 == 0 ? NAN : 8 + 2 * sinf(i * 0.1f);
+    r.case_c  = i % 50 < 3 ? NAN : 30 - 3 * cosf(i * 0.26f);
+    r.pings   = i % 11 ? (uint8_t)(7 << 4 | 7) : (uint8_t)(3 << 4 | 7);
+    r.sd_mm   = (uint8_t)(10 + i / 6 % 4 + (i % 97 == 0) * 40);
+    v.push_back(r);
+  }
+  return v;
+}
+
+static bool tempNear(float got, float want) {
+  return isnan(want) ? isnan(got) : fabsf(got - want) <= 0.051f;
+}
+
+// Decoded record within the codec's tolerances of the original; `passes`
+// is how many times it went through the encoder.
+static bool near(const HistRecord &got, const HistRecord &want, bool aux = true, int passes = 1) {
+  int32_t dts = (int32_t)(got.ts - want.ts);
+  return abs(dts) <= HIST_TS_TOL_S * passes &&
+         fabsf(got.level - want.level) <= 0.051f &&
+         fabsf(got.volume - want.volume) <= (HIST_VOL_TOL + 0.51f) * 0.1f * passes &&
+         tempNear(got.temp_c, want.temp_c) &&
+         (aux ? tempNear(got.water_c, want.water_c) && tempNear(got.case_c, want.case_c) &&
+                got.pings == want.pings && got.sd_mm == want.sd_mm
+              : isnan(got.water_c) && isnan(got.case_c) && !got.pings && !got.sd_mm);
+}
+
+// Forward scan of the whole ring against v[first..]; returns records seen.
+static int scanAll(const std::vector<HistRecord> &v, size_t first, bool aux = true, int passes = 1) {
+  HistCursor &c = storageCursor();
+  HistRecord r;
+  int n = 0, bad = 0;
+  if (!storageCursorOpen(c, storageHourlyRing(0), false)) return 0;
+  while (storageCursorNext(c, r)) {
+    if (first + n >= v.size() || !near(r, v[first + n], aux, passes)) bad++;
+    n++;
+  }
+  storageCursorClose(c);
+  CHECK(bad == 0);
+  return n;
+}
+
+static void writeAll(const std::vector<HistRecord> &v, int from = 0, int to = -1) {
+  if (to < 0) to = v.size();
+  for (int i = from; i < to; i++) _storagePackWrite(storageHourlyRing(0), v[i]);
+}
+
+static void reload() {
+  storageHourlyRing(0).ready = false;
+  storageInit(1);
+}
+
+static void testRoundTripAndWrap() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(20000);
+  writeAll(v);
+  const HistPackRing &r = storageHourlyRing(0);
+  uint16_t cnt = storageCount();
+  double bytesPerRec = (double)HIST_BLOCKS * HIST_BLOCK_PAYLOAD / cnt;
+  printf("  %u of %zu records kept in %u blocks, %.2f B/record (fixed: %zu)\n",
+         cnt, v.size(), r.hdr.blocks, bytesPerRec, sizeof(HistRecord));
+  // The ring wrapped: the oldest blocks were dropped whole, the newest
+  // record is the last one written.
+  CHECK(r.hdr.blocks == HIST_BLOCKS);
+  CHECK(cnt < v.size());
+  CHECK(bytesPerRec < 8.0);
+  CHECK(scanAll(v, v.size() - cnt) == cnt);
+
+  // Reverse sub-range and newest-first reads.
+  HistCursor &c = storageCursor();
+  HistRecord rec;
+  size_t k = v.size() - cnt + 1000 + 776;
+  int n = 0, bad = 0;
+  CHECK(storageCursorOpen(c, storageHourlyRing(0), true, 1000, 777));
+  while (storageCursorNext(c, rec)) bad += !near(rec, v[k - n++]);
+  storageCursorClose(c);
+  CHECK(n == 777 && bad == 0);
+
+  static HistRecord out[168];
+  CHECK(storageRead(out, 168) == 168);
+  bad = 0;
+  for (int i = 0; i < 168; i++) bad += !near(out[i], v[v.size() - 1 - i]);
+  CHECK(bad == 0);
+}
+
+// One temperature probe and steady echoes, the common install: the
+// README promises 4-5 bytes per record, about a year of hours.
+static void testDensity() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(12000);
+  for (HistRecord &r : v) {
+    r.water_c = r.case_c = NAN;
+    r.sd_mm = 12;
+  }
+  writeAll(v);
+  double bytesPerRec = (double)HIST_BLOCKS * HIST_BLOCK_PAYLOAD / storageCount();
+  printf("  one probe: %u records, %.2f B/record, %.0f days\n",
+         storageCount(), bytesPerRec, storageCount() / 24.0);
+  CHECK(bytesPerRec <= 5.0);
+  CHECK(storageCount() / 24 >= 300);
+  CHECK(scanAll(v, v.size() - storageCount()) == storageCount());
+}
+
+static void testReload() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(3000);
+  writeAll(v);
+  uint16_t cnt = storageCount(), blocks = storageHourlyRing(0).hdr.blocks;
+  reload();
+  CHECK(storageCount() == cnt && storageHourlyRing(0).hdr.blocks == blocks);
+  CHECK(scanAll(v, v.size() - cnt) == cnt);
+  // Appends continue the reloaded open block.
+  std::vector<HistRecord> more = synth(3010);
+  writeAll(more, 3000);
+  CHECK(storageCount() == cnt + 10);
+  HistRecord last;
+  CHECK(storageRead(&last, 1) == 1 && near(last, more.back()));
+}
+
+// Power lost after a new block went into the evicted oldest slot but
+// before the header moved `head` onto it: the file holds the newest
+// records in the oldest position. The reload must keep the time index
+// sorted (dropping that block) and appends must carry on.
+static void testTornEviction() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(22000);
+  writeAll(v, 0, 20000);
+  HistPackRing &r = storageHourlyRing(0);
+  CHECK(r.hdr.blocks == HIST_BLOCKS);
+
+  std::vector<uint8_t> &file = *shimFs().files[HIST_FILE];
+  std::vector<uint8_t> hdr;
+  uint16_t head = r.hdr.head;
+  size_t k = 20000;
+  while (r.hdr.head == head) {
+    hdr.assign(file.begin(), file.begin() + sizeof(HistPackHeader));
+    _storagePackWrite(r, v[k++]);
+  }
+  std::copy(hdr.begin(), hdr.end(), file.begin());   // the header write never happened
+
+  reload();
+  uint16_t cnt = storageCount();
+  CHECK(cnt > 0 && r.hdr.head == head);
+  // Whatever survived is in time order and ends with the last record
+  // the header still covers.
+  HistCursor &c = storageCursor();
+  HistRecord rec, prev = {};
+  int n = 0, unordered = 0;
+  CHECK(storageCursorOpen(c, r, false));
+  while (storageCursorNext(c, rec)) {
+    if (n++ && rec.ts < prev.ts) unordered++;
+    prev = rec;
+  }
+  storageCursorClose(c);
+  CHECK(n == cnt && unordered == 0 && near(prev, v[k - 2]));
+  // The time index finds records again.
+  const HistRecord &probe = v[k - 1 - cnt / 2];
+  uint16_t at = storageFindFirstAtOrAfter(probe.ts);
+  CHECK(storageCursorOpen(c, r, false, at, 1) && storageCursorNext(c, rec) && near(rec, probe));
+  storageCursorClose(c);
+
+  // The next block overwrites the dropped slot; after another reload the
+  // ring is whole again.
+  writeAll(v, k - 1);
+  reload();
+  CHECK(storageCount() >= cnt);
+  CHECK(scanAll(v, v.size() - storageCount()) == storageCount());
+}
+
+// A full v1 ring (16-byte records) whose write head sits mid-file.
+static void writeV1(const char *path, const std::vector<HistRecord> &v) {
+  const uint16_t head = 100;
+  File f = LittleFS.open(path, "w");
+  HistHeader h = { head, HIST_LEGACY_MAX_REC };
+  f.write((const uint8_t *)&h, sizeof(h));
+  for (int i = 0; i < HIST_LEGACY_MAX_REC; i++) {
+    const HistRecord &r = v[(i - head + HIST_LEGACY_MAX_REC) % HIST_LEGACY_MAX_REC];
+    f.write((const uint8_t *)&r, HIST_V1_REC_SIZE);
+  }
+  f.close();
+}
+
+static void testV1Migration() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(HIST_LEGACY_MAX_REC);
+  writeV1(HIST_FILE, v);
+
+  reload();
+  CHECK(storageHourlyRing(0).hdr.version == HIST_FMT_VERSION);
+  CHECK(storageCount() == HIST_LEGACY_MAX_REC);
+  CHECK(scanAll(v, 0, false) == HIST_LEGACY_MAX_REC);
+  CHECK(!LittleFS.exists(HIST_LEGACY_FILE));
+
+  // A migration cut short leaves the parked v1 file next to a partly
+  // written hist.bin; the next boot converts it again from the start.
+  writeV1(HIST_LEGACY_FILE, v);
+  reload();
+  CHECK(storageCount() == HIST_LEGACY_MAX_REC && !LittleFS.exists(HIST_LEGACY_FILE));
+  CHECK(scanAll(v, 0, false) == HIST_LEGACY_MAX_REC);
+}
+
+// A v1 backup restored from the web is converted for every tank, not just
+// tank 0 where a v1 file can also turn up at boot.
+static void testV1Restore() {
+  const char *tmp = "/hist_hourly.upload.tmp";
+  std::vector<HistRecord> v = synth(HIST_LEGACY_MAX_REC);
+  storageClear(2);
+  for (uint8_t t = 0; t < 2; t++) {
+    writeV1(tmp, v);
+    CHECK(storageReplaceRingFile(tmp, storageHourlyRing(t)));
+    CHECK(storageCount(t) == HIST_LEGACY_MAX_REC && storageHourlyRing(t).hdr.version == HIST_FMT_VERSION);
+    CHECK(!LittleFS.exists(tmp) && !LittleFS.exists(HIST_LEGACY_FILE));
+    HistRecord last;
+    CHECK(storageRead(&last, 1, t) == 1 && near(last, v.back(), false));
+  }
+  CHECK(scanAll(v, 0, false) == HIST_LEGACY_MAX_REC);
+  storageHourlyRing(1).ready = false;
+  storageInit(2);
+  CHECK(storageCount(1) == HIST_LEGACY_MAX_REC);   // reloaded from flash
+}
+
+static void testV2Upgrade() {
+  storageClear(1);
+  std::vector<HistRecord> v = synth(3000);
+  HistPackRing &r = storageHourlyRing(0);
+  r.hdr.version = 2;   // encode without the aux tag
+  writeAll(v);
+  HistPackHeader onFlash;
+  File f = LittleFS.open(HIST_FILE, "r");
+  f.read((uint8_t *)&onFlash, sizeof(onFlash));
+  f.close();
+  CHECK(onFlash.version == 2);
+  uint16_t cnt = storageCount();
+
+  reload();
+  CHECK(r.hdr.version == HIST_FMT_VERSION && storageCount() == cnt);
+  CHECK(!LittleFS.exists(HIST_FILE ".old"));
+  // Re-encoding decoded v2 records can fold timestamps and volumes once
+  // more: the error against the original reading is up to twice the
+  // single-pass tolerance.
+  CHECK(scanAll(v, v.size() - cnt, false, 2) == cnt);
+  // New records carry the aux fields again.
+  std::vector<HistRecord> more = synth(3001);
+  writeAll(more, 3000);
+  HistRecord last;
+  CHECK(storageRead(&last, 1) == 1 && near(last, more.back()));
+}
+
+int main() {
+  storageInit(1);
+  testRoundTripAndWrap();
+  testDensity();
+  testReload();
+  testTornEviction();
+  testV1Migration();
+  testV1Restore();
+  testV2Upgrade();
+  return testDone("test_hist_pack");
+}
@@ -0,0 +1,189 @@
+// MQTT store-and-forward (mqtt_buffer.h, mqtt_handler.h): the flash ring's
+// head/count arithmetic through fill, overwrite-when-full, wrap and partial
+// drains, checked against the header on flash; then a broker outage end to
+// end, with the replayed readings keeping their original timestamps.
+#include "host_test.h"
+#include "mqtt_handler.h"
+#include <string>
+#include <vector>
+
+static const uint32_t T0 = 1700000000;
+
+static SensorData reading(uint32_t ts, float level = 50) {
+  SensorData s = {};
+  s.valid         = true;
+  s.timestamp     = ts;
+  s.level_pct     = level;
+  s.distance_cm   = 60;
+  s.total_liters  = 200;
+  s.volume_liters = 100;
+  s.free_liters   = 100;
+  s.temp_c        = NAN;
+  s.water_c       = 12.34f;
+  s.case_c        = NAN;
+  s.kf_level_pct  = NAN;
+  s.kf_rate_lph   = NAN;
+  s.quality.attempted = s.quality.valid = 7;
+  return s;
+}
+
+static HistHeader flashHeader() {
+  HistHeader h = {};
+  File f = LittleFS.open(MQTT_BUF_FILE, "r");
+  f.read((uint8_t *)&h, sizeof(h));
+  f.close();
+  return h;
+}
+
+static MqttBufRecord flashRecord(uint16_t slot) {
+  MqttBufRecord r = {};
+  File f = LittleFS.open(MQTT_BUF_FILE, "r");
+  f.seek(sizeof(HistHeader) + slot * sizeof(MqttBufRecord));
+  f.read((uint8_t *)&r, sizeof(r));
+  f.close();
+  return r;
+}
+
+// Oldest buffered reading, found the way mqttBufDrain() finds it.
+static uint32_t flashOldestTs() {
+  HistHeader h = flashHeader();
+  uint16_t max = mqttBufCapacity();
+  return flashRecord((h.head + max - h.count) % max).ts;
+}
+
+static std::vector<uint32_t> drain(uint16_t n) {
+  std::vector<uint32_t> ts;
+  mqttBufDrain(n, [&](const MqttBufRecord &r) {
+    ts.push_back(r.ts);
+    return true;
+  });
+  return ts;
+}
+
+static void testRing() {
+  Config c;
+  configDefaults(c);
+  c.mqtt_buf = 5;
+  mqttBufInit(c);
+  CHECK(mqttBufCount() == 0 && mqttBufCapacity() == 5);
+
+  mqttBufPush(reading(100));   // clock not synced: not kept
+  CHECK(mqttBufCount() == 0);
+
+  // Fill, then two past full: the two oldest are overwritten and counted lost.
+  for (uint32_t i = 0; i < 7; i++) mqttBufPush(reading(T0 + i, i));
+  HistHeader h = flashHeader();
+  CHECK(mqttBufCount() == 5 && h.count == 5 && h.head == 7 % 5);
+  CHECK(mqttBufStats().stored == 7 && mqttBufStats().lost == 2);
+  CHECK(flashOldestTs() == T0 + 2);
+
+  // Partial drain: oldest first, one header write, head unchanged.
+  std::vector<uint32_t> got = drain(2);
+  CHECK(got.size() == 2 && got[0] == T0 + 2 && got[1] == T0 + 3);
+  h = flashHeader();
+  CHECK(mqttBufCount() == 3 && h.count == 3 && h.head == 2);
+  CHECK(flashOldestTs() == T0 + 4);
+
+  // The broker refuses the second replay: only the first is removed.
+  int k = 0;
+  CHECK(mqttBufDrain(5, [&](const MqttBufRecord &) { return k++ < 1; }) == 1);
+  CHECK(mqttBufCount() == 2 && flashHeader().count == 2);
+  CHECK(mqttBufStats().sent == 3);
+
+  // Survives a reboot.
+  mqttBufInit(c);
+  CHECK(mqttBufCount() == 2 && flashOldestTs() == T0 + 5);
+
+  // New readings wrap past slot 4 behind the ones still waiting, and fill
+  // the ring again: the oldest waiting one is overwritten. Temperatures
+  // come back in 0.01 °C.
+  for (uint32_t i = 7; i < 11; i++) mqttBufPush(reading(T0 + i));
+  h = flashHeader();
+  CHECK(h.count == 5 && h.head == 1 && mqttBufStats().lost == 3);
+  got.clear();
+  uint16_t n = mqttBufDrain(9, [&](const MqttBufRecord &r) {
+    got.push_back(r.ts);
+    CHECK(r.temp_c100[1] == 1234 && r.temp_c100[0] == MQTT_BUF_NO_TEMP);
+    CHECK(r.pings == (7 << 4 | 7));
+    return true;
+  });
+  CHECK(n == 5 && mqttBufCount() == 0 && flashHeader().count == 0);
+  for (uint32_t i = 0; i < got.size(); i++) CHECK(got[i] == T0 + 6 + i);
+
+  // A new size recreates the ring empty; 0 removes the file.
+  mqttBufPush(reading(T0 + 100));
+  c.mqtt_buf = 10;
+  mqttBufInit(c);
+  CHECK(mqttBufCount() == 0 && mqttBufCapacity() == 10);
+  c.mqtt_buf = 0;
+  mqttBufInit(c);
+  mqttBufPush(reading(T0 + 101));
+  CHECK(mqttBufCount() == 0 && !LittleFS.exists(MQTT_BUF_FILE));
+}
+
+static std::vector<uint32_t> replayedTs(size_t from) {
+  std::vector<uint32_t> ts;
+  for (size_t i = from; i < shimBroker.msgs.size(); i++) {
+    const ShimMqttMsg &m = shimBroker.msgs[i];
+    size_t p = m.payload.find("\"buffered\":true");
+    if (p == std::string::npos) continue;
+    CHECK(m.topic == "watersensor/json" && !m.retained);
+    size_t t = m.payload.find("\"ts\":");
+    CHECK(t != std::string::npos && t < p);
+    ts.push_back(strtoul(m.payload.c_str() + t + 5, nullptr, 10));
+  }
+  return ts;
+}
+
+// Broker down for 12 readings, back up, down again mid-replay: every
+// reading arrives once, in order, with its own time, mqtt_drain per loop.
+static void testOutage() {
+  Config c;
+  configDefaults(c);
+  strlcpy(c.mqtt_topic, "watersensor", sizeof(c.mqtt_topic));
+  c.mqtt_buf   = 720;
+  c.mqtt_drain = 5;
+  shimMs = 100000;
+  mqttSetup(c);
+
+  shimBroker.up = false;
+  for (uint32_t i = 0; i < 12; i++) {
+    mqttPublish(c, reading(T0 + i * 60, 40 + i));
+    mqttLoop(c);
+    shimMs += 60000;
+  }
+  CHECK(mqttBufCount() == 12 && shimBroker.msgs.empty());
+
+  shimBroker.up = true;
+  mqttLoop(c);
+  CHECK(shimBroker.connects == 1 && mqttBufCount() == 7);
+  CHECK(replayedTs(0).size() == c.mqtt_drain);
+
+  // Dropped again: nothing is lost or sent twice.
+  shimBroker.up = false;
+  mqttLoop(c);
+  CHECK(mqttBufCount() == 7);
+  shimMs += 15000;
+  shimBroker.up = true;
+  while (mqttBufCount()) {
+    mqttLoop(c);
+    shimMs += 1000;
+  }
+  std::vector<uint32_t> ts = replayedTs(0);
+  CHECK(ts.size() == 12);
+  for (uint32_t i = 0; i < ts.size(); i++) CHECK(ts[i] == T0 + i * 60);
+
+  // Live readings after the outage are retained and not marked buffered.
+  size_t from = shimBroker.msgs.size();
+  mqttPublish(c, reading(T0 + 3600, 60));
+  CHECK(replayedTs(from).empty() && shimBroker.msgs.size() > from);
+  for (size_t i = from; i < shimBroker.msgs.size(); i++) CHECK(shimBroker.msgs[i].retained);
+}
+
+int main() {
+  testRing();
+  testOutage();
+  printf("  buffered %u, replayed %u, lost %u\n",
+         mqttBufStats().stored, mqttBufStats().sent, mqttBufStats().lost);
+  return testDone("test_mqtt_buffer");
+}
@@ -0,0 +1,146 @@
+// Recent-minute ring (storage.h): files of the older record layouts,
+// untagged or tagged, are converted to the current one on load, also when
+// a conversion was interrupted, and restores take any of them.
+#include "host_test.h"
+#include "storage.h"
+#include <vector>
+
+static const uint32_t T0 = 1700000000;
+
+// File of layout `version`, tagged or not: records ts = T0 + i * 60 for
+// logical i in [0, count), the ring wrapped so that the newest is in slot
+// head - 1. Layout 3 gets junk in its padding.
+static void writeLegacy(const char *path, uint8_t version, uint16_t head, uint16_t count,
+                        bool tagged = false) {
+  uint8_t size = _histRecentRecSize[version - 1];
+  uint8_t pos = tagged ? sizeof(HistRingTag) : 0;
+  std::vector<uint8_t> raw(_storageRingFileSize(MAX_RECENT_REC, size, tagged ? version : 0), 0);
+  HistRingTag tag = { HIST_RECENT_MAGIC, version, size, 0 };
+  if (tagged) memcpy(raw.data(), &tag, sizeof(tag));
+  HistHeader hdr = { head, count };
+  memcpy(raw.data() + pos, &hdr, sizeof(hdr));
+  uint16_t oldest = (head + MAX_RECENT_REC - count) % MAX_RECENT_REC;
+  for (uint16_t i = 0; i < count; i++) {
+    HistRecord rec = { T0 + i * 60u, 50.0f + i, 100.0f + i, 10.5f, 8.25f, 30.0f,
+                       (uint8_t)(7 << 4 | 7), (uint8_t)i,
+                       (uint16_t)(version >= 4 ? 1000 + i : 0xA5A5) };
+    memcpy(raw.data() + pos + sizeof(hdr) + ((oldest + i) % MAX_RECENT_REC) * size, &rec, size);
+  }
+  File f = LittleFS.open(path, "w");
+  f.write(raw.data(), raw.size());
+  f.close();
+}
+
+static uint16_t readAll(HistRecord *out) { return storageReadRecent(out, MAX_RECENT_REC); }
+
+// The ring holds `count` records written by writeLegacy() at `version`.
+static void checkConverted(uint8_t version, uint16_t count) {
+  HistRing &r = storageRecentRing(0);
+  CHECK(r.ready && r.hdr.count == count);
+  CHECK(storageValidateRingFile(HIST_RECENT_FILE, MAX_RECENT_REC, nullptr,
+                                sizeof(HistRecord), HIST_RECENT_VERSION));
+  CHECK(!LittleFS.exists(HIST_RECENT_FILE ".old"));
+  HistRecord out[MAX_RECENT_REC];
+  CHECK(readAll(out) == count);
+  for (uint16_t k = 0; k < count; k++) {
+    const HistRecord &rec = out[k];
+    uint16_t i = count - 1 - k;   // newest first
+    CHECK(rec.ts == T0 + i * 60u && rec.level == 50.0f + i && rec.volume == 100.0f + i);
+    CHECK(rec.temp_c == 10.5f);
+    CHECK(version >= 2 ? rec.water_c == 8.25f && rec.case_c == 30.0f
+                       : isnan(rec.water_c) && isnan(rec.case_c));
+    CHECK(version >= 3 ? rec.pings == (7 << 4 | 7) && rec.sd_mm == i
+                       : rec.pings == 0 && rec.sd_mm == 0);
+    CHECK(rec.echo_us == (version >= 4 ? 1000 + i : 0));
+  }
+}
+
+static void testLoad() {
+  // Untagged layouts 1-3, then 3 with the tag.
+  const struct { uint8_t version; bool tagged; } old[] = { {1, false}, {2, false}, {3, false}, {3, true} };
+  for (const auto &o : old) {
+    LittleFS.format();
+    writeLegacy(HIST_RECENT_FILE, o.version, 17, MAX_RECENT_REC, o.tagged);
+    storageRecentRing(0).ready = false;
+    storageInit(1);
+    checkConverted(o.version, MAX_RECENT_REC);
+  }
+
+  // The current layout loads as is.
+  LittleFS.format();
+  writeLegacy(HIST_RECENT_FILE, HIST_RECENT_VERSION, 17, MAX_RECENT_REC, true);
+  storageRecentRing(0).ready = false;
+  storageInit(1);
+  checkConverted(HIST_RECENT_VERSION, MAX_RECENT_REC);
+
+  // A partial ring, then new snapshots go in after the converted ones.
+  LittleFS.format();
+  writeLegacy(HIST_RECENT_FILE, 2, 3, 5);
+  storageRecentRing(0).ready = false;
+  storageInit(1);
+  checkConverted(2, 5);
+  SensorData s = {};
+  s.valid = true;
+  s.timestamp = T0 + 3600;
+  s.temp_c = s.water_c = s.case_c = NAN;
+  storageWriteRecent(s);
+  HistRecord out[MAX_RECENT_REC];
+  CHECK(readAll(out) == 6 && out[0].ts == T0 + 3600 && out[1].ts == T0 + 4 * 60);
+  storageRecentRing(0).ready = false;
+  CHECK(readAll(out) == 6 && out[0].ts == T0 + 3600);   // reloaded from flash
+
+  // Power lost mid-conversion: the parked file is converted again.
+  LittleFS.format();
+  writeLegacy(HIST_RECENT_FILE ".old", 1, 0, 40);
+  File f = LittleFS.open(HIST_RECENT_FILE, "w");
+  f.write((const uint8_t *)"torn", 4);
+  f.close();
+  storageRecentRing(0).ready = false;
+  storageInit(1);
+  checkConverted(1, 40);
+}
+
+static void testRestore() {
+  HistRing &r = storageRecentRing(0);
+  const char *tmp = "/hist_recent.upload.tmp";
+
+  // An older backup is converted.
+  writeLegacy(tmp, 3, 59, 59, true);
+  CHECK(storageReplaceRingFile(tmp, r));
+  checkConverted(3, 59);
+  writeLegacy(tmp, HIST_RECENT_VERSION, 59, 59, true);
+  CHECK(storageReplaceRingFile(tmp, r));
+  checkConverted(HIST_RECENT_VERSION, 59);
+
+  // A current backup is taken as is.
+  File in = LittleFS.open(HIST_RECENT_FILE, "r");
+  std::vector<uint8_t> raw(in.size());
+  in.read(raw.data(), raw.size());
+  in.close();
+  CHECK(raw.size() == storageRecentFileSize());
+  LittleFS.format();
+  storageInit(1);
+  File out = LittleFS.open(tmp, "w");
+  out.write(raw.data(), raw.size());
+  out.close();
+  CHECK(storageReplaceRingFile(tmp, r));
+  checkConverted(HIST_RECENT_VERSION, 59);
+
+  // Anything else is refused and leaves the ring alone.
+  raw[0] ^= 0xFF;   // tag magic
+  out = LittleFS.open(tmp, "w");
+  out.write(raw.data(), raw.size());
+  out.close();
+  CHECK(!storageReplaceRingFile(tmp, r));
+  out = LittleFS.open(tmp, "w");
+  out.write(raw.data(), 100);
+  out.close();
+  CHECK(!storageReplaceRingFile(tmp, r));
+  checkConverted(HIST_RECENT_VERSION, 59);
+}
+
+int main() {
+  testLoad();
+  testRestore();
+  return testDone("test_recent_ring");
+}
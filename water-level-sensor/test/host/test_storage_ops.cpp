@@ -0,0 +1,187 @@
+// Flash operations per history call: the current storage code against the
+// path it replaced, where every count, read and write first opened the
+// ring file and read (and validated) its header, and reads fetched one
+// record per seek. The legacy functions below are that code, kept as a
+// reference and pointed at the current file layout (tag, record size).
+#include "host_test.h"
+#include "storage.h"
+
+static ShimFsOps opsSince(const ShimFsOps &a) {
+  const ShimFsOps &b = shimFs().ops;
+  return { b.opens - a.opens, b.sizes - a.sizes, b.reads - a.reads, b.writes - a.writes,
+           b.seeks - a.seeks, b.bytesRead - a.bytesRead, b.bytesWritten - a.bytesWritten };
+}
+
+static void report(const char *what, const ShimFsOps &o, int calls) {
+  printf("  %-30s open %5.1f  size %5.1f  read %6.1f  write %5.1f  seek %6.1f  bytes read %7.1f\n",
+         what, (double)o.opens / calls, (double)o.sizes / calls, (double)o.reads / calls,
+         (double)o.writes / calls, (double)o.seeks / calls, (double)o.bytesRead / calls);
+}
+
+// ── Legacy reference ─────────────────────────────────────────────────────────
+
+static bool legacyHeader(File &f, const HistRing &r, HistHeader &hdr) {
+  return f.size() == _storageRingFileSize(r.maxRec, r.recSize, r.version) &&
+         f.seek(_storageRingHdrPos(r.version)) &&
+         f.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+         hdr.head < r.maxRec && hdr.count <= r.maxRec;
+}
+
+static uint16_t legacyCount(const HistRing &r) {
+  File f = LittleFS.open(r.path, "r");
+  if (!f) return 0;
+  HistHeader hdr;
+  bool ok = legacyHeader(f, r, hdr);
+  f.close();
+  return ok ? hdr.count : 0;
+}
+
+static int legacyRead(const HistRing &r, HistRecord *out, int n) {
+  File f = LittleFS.open(r.path, "r");
+  if (!f) return 0;
+  HistHeader hdr;
+  if (!legacyHeader(f, r, hdr)) { f.close(); return 0; }
+  int cnt = min((int)hdr.count, n);
+  for (int i = 0; i < cnt; i++) {
+    int idx = ((int)hdr.head - 1 - i + r.maxRec) % r.maxRec;
+    f.seek(_storageRingHdrPos(r.version) + sizeof(hdr) + idx * r.recSize);
+    f.read((uint8_t *)&out[i], r.recSize);
+  }
+  f.close();
+  return cnt;
+}
+
+static void legacyWrite(const HistRing &r, const HistRecord &rec) {
+  File f = LittleFS.open(r.path, "r+");
+  if (!f) return;
+  HistHeader hdr;
+  uint32_t pos = _storageRingHdrPos(r.version);
+  f.seek(pos);
+  f.read((uint8_t *)&hdr, sizeof(hdr));
+  f.seek(pos + sizeof(hdr) + hdr.head * r.recSize);
+  f.write((const uint8_t *)&rec, r.recSize);
+  hdr.head = (hdr.head + 1) % r.maxRec;
+  if (hdr.count < r.maxRec) hdr.count++;
+  f.seek(pos);
+  f.write((const uint8_t *)&hdr, sizeof(hdr));
+  f.close();
+}
+
+// Aggregate lower bound: each binary-search probe was a full storageAggRead().
+static uint16_t legacyAggLowerBound(uint8_t tier, uint32_t ts) {
+  uint16_t lo = 0, hi = storageAggCount(tier);
+  while (lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    HistAggRecord rec;
+    if (storageAggRead(tier, mid, &rec, 1) != 1) return hi;
+    if (rec.ts < ts) lo = mid + 1;
+    else             hi = mid;
+  }
+  return lo;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+
+static SensorData reading(uint32_t ts) {
+  SensorData s = {};
+  s.valid         = true;
+  s.timestamp     = ts;
+  s.level_pct     = 40.0f + (ts / 60 % 20);
+  s.volume_liters = 80.0f;
+  s.temp_c = s.water_c = s.case_c = NAN;
+  return s;
+}
+
+int main() {
+  const int N = 100;
+  const uint32_t t0 = 1700000000;
+  storageInit(1);
+  HistRing &recent = storageRecentRing(0);
+
+  // Fill both rings past wrap-around.
+  for (int i = 0; i < 90; i++) storageWriteRecent(reading(t0 + i * 60));
+  for (int i = 0; i < 400; i++) storageWrite(reading(t0 + i * 3600));
+  CHECK(storageCountRecent() == MAX_RECENT_REC);
+  CHECK(legacyCount(recent) == MAX_RECENT_REC);
+
+  printf("FS operations per call (%d calls each)\n", N);
+
+  // count: what every /api/status poll did twice
+  ShimFsOps a = shimFs().ops;
+  for (int i = 0; i < N; i++) legacyCount(recent);
+  ShimFsOps legacyC = opsSince(a);
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) { storageCountRecent(); storageCount(); }
+  ShimFsOps newC = opsSince(a);
+  report("count, legacy", legacyC, N);
+  report("count, recent + hourly", newC, N);
+  CHECK(legacyC.opens == N && legacyC.sizes == N && legacyC.reads == N);
+  CHECK(newC.opens == 0 && newC.sizes == 0 && newC.reads == 0 && newC.seeks == 0);
+
+  // read the last hour of minute snapshots
+  HistRecord out[MAX_RECENT_REC], ref[MAX_RECENT_REC];
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) legacyRead(recent, ref, MAX_RECENT_REC);
+  ShimFsOps legacyR = opsSince(a);
+  a = shimFs().ops;
+  int got = 0;
+  for (int i = 0; i < N; i++) got = storageReadRecent(out, MAX_RECENT_REC);
+  ShimFsOps newR = opsSince(a);
+  report("read 60 recent, legacy", legacyR, N);
+  report("read 60 recent", newR, N);
+  CHECK(got == MAX_RECENT_REC);
+  for (int i = 0; i < got; i++) CHECK(out[i].ts == ref[i].ts && out[i].level == ref[i].level);
+  CHECK(legacyR.reads == N * (1 + MAX_RECENT_REC));
+  CHECK(newR.opens == N && newR.sizes == 0);
+  // one read per cursor block, plus one where the range wraps
+  CHECK(newR.reads <= N * ((MAX_RECENT_REC + HIST_CURSOR_BLOCK - 1) / HIST_CURSOR_BLOCK + 1));
+
+  // append a minute snapshot
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) legacyWrite(recent, histRecordOf(reading(t0 + (100 + i) * 60)));
+  ShimFsOps legacyW = opsSince(a);
+  storageInit(1);   // the legacy writes bypassed the cached header
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) storageWriteRecent(reading(t0 + (200 + i) * 60));
+  ShimFsOps newW = opsSince(a);
+  report("write recent, legacy", legacyW, N);
+  report("write recent", newW, N);
+  CHECK(legacyW.opens == N && legacyW.reads == N);
+  CHECK(newW.opens == N && newW.reads == 0 && newW.sizes == 0);
+  CHECK(legacyCount(recent) == storageCountRecent());
+
+  // the week of hourly records /api/status trend and Telegram use
+  HistRecord week[168];
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) got = storageRead(week, 168);
+  ShimFsOps newH = opsSince(a);
+  report("read 168 hourly (packed)", newH, N);
+  CHECK(got == 168 && week[0].ts == t0 + 399 * 3600 && week[167].ts == t0 + 232 * 3600);
+  CHECK(newH.opens == N && newH.sizes == 0);
+  CHECK(newH.reads <= N * 3);   // ~2 flash blocks, the newest records come from RAM
+
+  // aggregate lower bound, as /api/history does for the start of a range
+  for (int i = 0; i < 24 * 60; i++) storageRollupAdd(reading(t0 + i * 600));
+  uint16_t aggN = storageAggCount(TIER_HOUR);
+  CHECK(aggN > 200);
+  HistAggRecord firstAgg, lastAgg;
+  CHECK(storageAggRead(TIER_HOUR, 0, &firstAgg, 1) == 1);
+  CHECK(storageAggRead(TIER_HOUR, aggN - 1, &lastAgg, 1) == 1);
+  uint32_t probes[] = { 0, firstAgg.ts, firstAgg.ts + 1, lastAgg.ts - 7200, lastAgg.ts,
+                        lastAgg.ts + 1 };
+  for (uint32_t ts : probes) CHECK(storageAggLowerBound(TIER_HOUR, ts) == legacyAggLowerBound(TIER_HOUR, ts));
+  CHECK(storageAggLowerBound(TIER_HOUR, 0) == 0 && storageAggLowerBound(TIER_HOUR, ~0u) == aggN);
+  uint32_t mid = firstAgg.ts + (lastAgg.ts - firstAgg.ts) / 3;
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) legacyAggLowerBound(TIER_HOUR, mid);
+  ShimFsOps legacyB = opsSince(a);
+  a = shimFs().ops;
+  for (int i = 0; i < N; i++) storageAggLowerBound(TIER_HOUR, mid);
+  ShimFsOps newB = opsSince(a);
+  report("agg lower bound, legacy", legacyB, N);
+  report("agg lower bound", newB, N);
+  CHECK(legacyB.opens >= N * 7);   // one per probe, log2 of the ring
+  CHECK(newB.opens == N && newB.reads == legacyB.reads);
+
+  return testDone("test_storage_ops");
+}
@@ -0,0 +1,184 @@
+// Bot API transport (telegram_client.h) against a scripted HTTPS stand-in
+// at TG_API_HOST:TG_API_PORT (set by the Makefile): Content-Length,
+// chunked and close-delimited bodies delivered a few bytes per poll,
+// keep-alive reuse and the one resend, and every way a request fails.
+#include "host_test.h"
+#include "telegram_client.h"
+#include <string>
+
+static const TgHttp &h = tgHttpStats();
+
+// Poll until the request finishes, 1 ms of simulated time per pass;
+// returns the number of passes.
+static int run() {
+  int n = 0;
+  while (!tgHttpPoll() && n < 100000) {
+    shimMs++;
+    n++;
+  }
+  return n;
+}
+
+static void reply(const std::string &r, size_t chunk = 7) {
+  shimTls.reply = r;
+  shimTls.chunk = chunk;
+}
+
+static void testContentLength() {
+  CHECK(tgHttpStart(1, "/botX/getUpdates?limit=1"));
+  reply("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 11\r\n\r\n{\"ok\":true}");
+  CHECK(!tgHttpStart(2, "/x"));   // one request at a time
+  CHECK(shimTls.host == "127.0.0.1" && shimTls.port == 8443);
+  CHECK(shimTls.sent.find("GET /botX/getUpdates?limit=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n") == 0);
+  run();
+  CHECK(h.state == TGH_DONE && h.status == 200 && h.tag == 1 && !strcmp(h.rx, "{\"ok\":true}"));
+  CHECK(h.lastHsMs == 150 && h.connects == 1 && !h.reused);
+  tgHttpFinish();
+
+  // POST over the kept-alive connection; bytes past Content-Length are dropped.
+  shimTls.sent.clear();
+  CHECK(tgHttpStart(2, "/botX/sendMessage", "{\"a\":1}"));
+  reply("HTTP/1.1 400 Bad Request\r\nCONTENT-LENGTH: 2\r\n\r\n{}EXTRA");
+  CHECK(shimTls.sent.find("POST ") == 0);
+  CHECK(shimTls.sent.find("Content-Length: 7\r\n\r\n{\"a\":1}") != std::string::npos);
+  run();
+  CHECK(h.state == TGH_DONE && h.status == 400 && h.reused && h.connects == 1 && !strcmp(h.rx, "{}"));
+  tgHttpFinish();
+  shimTls.reply.clear();
+}
+
+static void testChunked() {
+  // Chunk-size lines, extensions and trailers split across 7-byte reads.
+  const char *resp =
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "b\r\n{\"ok\":true,\r\n"
+      "10;ext=1\r\n\"result\":[1,2,3]\r\n"
+      "1\r\n}\r\n"
+      "0\r\nX-Trailer: 1\r\n\r\n";
+  uint32_t connects = h.connects;
+  CHECK(tgHttpStart(1, "/c"));
+  reply(resp);
+  run();
+  CHECK(h.state == TGH_DONE && h.status == 200 && !strcmp(h.rx, "{\"ok\":true,\"result\":[1,2,3]}"));
+  CHECK(h.rxLen == strlen(h.rx));
+  tgHttpFinish();
+
+  // The whole response in one read, then a Content-Length one on the same
+  // connection: nothing of the chunked framing is left behind.
+  CHECK(tgHttpStart(1, "/c"));
+  reply(resp, 1460);
+  run();
+  CHECK(h.state == TGH_DONE && !strcmp(h.rx, "{\"ok\":true,\"result\":[1,2,3]}"));
+  tgHttpFinish();
+  CHECK(tgHttpStart(1, "/n"));
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  run();
+  CHECK(h.state == TGH_DONE && h.reused && !strcmp(h.rx, "ok"));
+  CHECK(h.connects == connects);
+  tgHttpFinish();
+
+  // Malformed framing and oversized chunks fail on the poll that sees them.
+  const char *bad[] = {
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n{}\r\n0\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n0\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nfffff\r\n{}",
+  };
+  for (const char *r : bad) {
+    uint32_t fails = h.fails;
+    unsigned long t0 = shimMs;
+    CHECK(tgHttpStart(1, "/b"));
+    reply(r, 1460);
+    run();
+    CHECK(h.state == TGH_FAIL && h.fails == fails + 1 && shimMs - t0 < 200);
+    tgHttpFinish();
+  }
+}
+
+// A keep-alive response with neither Content-Length nor chunked framing
+// has no end; it fails at once instead of waiting out TG_IO_TMO_MS.
+static void testNoLength() {
+  uint32_t fails = h.fails;
+  CHECK(tgHttpStart(1, "/l"));
+  reply("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{\"ok\":true}", 1460);
+  unsigned long t0 = shimMs;
+  CHECK(run() == 0);
+  CHECK(h.state == TGH_FAIL && h.fails == fails + 1 && shimMs - t0 < TG_IO_TMO_MS);
+  CHECK(!shimTls.open);
+  tgHttpFinish();
+
+  // No body at all is fine.
+  CHECK(tgHttpStart(1, "/e"));
+  reply("HTTP/1.1 204 No Content\r\n\r\n", 1460);
+  run();
+  CHECK(h.state == TGH_DONE && h.status == 204 && h.rxLen == 0);
+  tgHttpFinish();
+}
+
+// The server dropped the idle connection: the request is sent once more
+// on a fresh one; that response is delimited by close.
+static void testStaleResend() {
+  shimTls.open = true;
+  shimTls.reply.clear();
+  uint32_t connects = h.connects;
+  CHECK(tgHttpStart(1, "/a"));
+  CHECK(h.reused);
+  shimTls.open = false;
+  CHECK(!tgHttpPoll());
+  CHECK(h.retried && h.connects == connects + 1);
+  reply("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nbody-until-close", 1460);
+  shimTls.open = false;   // closed after sending; the bytes are still readable
+  run();
+  CHECK(h.state == TGH_DONE && !strcmp(h.rx, "body-until-close"));
+  tgHttpFinish();
+}
+
+static void testFailures() {
+  // No response at all
+  uint32_t fails = h.fails;
+  shimTls.reply.clear();
+  CHECK(tgHttpStart(1, "/t"));
+  unsigned long t0 = shimMs;
+  run();
+  CHECK(h.state == TGH_FAIL && h.fails == fails + 1 && !shimTls.open);
+  CHECK(shimMs - t0 >= TG_IO_TMO_MS);
+  tgHttpFinish();
+
+  // Refused connection
+  shimTls.accept = false;
+  CHECK(tgHttpStart(1, "/t"));
+  CHECK(tgHttpPoll() && h.state == TGH_FAIL);
+  tgHttpFinish();
+  shimTls.accept = true;
+
+  // Larger than TG_RX_MAX
+  CHECK(tgHttpStart(1, "/big"));
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 5000\r\n\r\n" + std::string(5000, 'x'), 1460);
+  run();
+  CHECK(h.state == TGH_FAIL);
+  tgHttpFinish();
+}
+
+static void testIdleClose() {
+  CHECK(tgHttpStart(1, "/i"));
+  reply("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n1");
+  run();
+  CHECK(h.state == TGH_DONE);
+  tgHttpFinish();
+  CHECK(shimTls.open);
+  shimMs += TG_IDLE_CLOSE_MS + 1;
+  tgHttpPoll();
+  CHECK(!shimTls.open);
+}
+
+int main() {
+  shimMs = 1000;
+  tgHttpSetup();
+  testContentLength();
+  testChunked();
+  testNoLength();
+  testStaleResend();
+  testFailures();
+  testIdleClose();
+  printf("  requests %u, fails %u, connects %u\n", h.requests, h.fails, h.connects);
+  return testDone("test_telegram_client");
+}